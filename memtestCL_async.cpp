@@ -0,0 +1,305 @@
+/*
+ * memtestCL_async.cpp
+ * Non-blocking and sliced interfaces to the memtestMultiTester tests.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include "memtestCL_async.h"
+
+memtestAsyncTest::memtestAsyncTest(const memtestMultiTester& t) :
+    tester(t), chunk(0), op(0), readingCounts(false), cancelRequested(false), finished(false),
+    chunkErrors(0), opsDone(0), opsTotal(0), startUs(0), chunkStartUs(0), opStartUs(0), done(NULL), doneData(NULL) {}
+
+memtestAsyncTest::~memtestAsyncTest() {
+    // Kernels in flight may still write into counts
+    if (!finished) {
+        cancel();
+        wait();
+    }
+}
+
+// The plans were recorded by running the blocking test on the tester; recorded is
+// that test's return value
+void memtestAsyncTest::start(bool recorded) {
+    startUs = getTimeMicroseconds();
+    for (size_t c = 0; c < plans.size(); c++) opsTotal += plans[c].ops.size();
+    if (!recorded || plans.empty()) {
+        fail(CL_INVALID_MEM_OBJECT);
+        return;
+    }
+    tester.beginChunk(plans[0].result,0,plans[0].tester,chunkStartUs);
+    launchOp();
+}
+
+void memtestAsyncTest::launchOp() {
+    const memtestState* state = plans[chunk].tester;
+    const memtestOp& o = plans[chunk].ops[op];
+    state->bytesTouched += state->opBytes(o.kernel,o.params);
+    opStartUs = state->logLaunch(o.kernel,o.params,state->nBlocks);
+    cl_int status = backend()->launch(o.kernel,state->loopIters,o.params);
+    if (status != CL_SUCCESS) fail(status);
+}
+
+void memtestAsyncTest::fail(cl_int status) {
+    res.ok = false;
+    res.status = status;
+    finish();
+}
+
+void memtestAsyncTest::finish() {
+    // Whatever was launched last must complete before the handle lets go of counts
+    if (!plans.empty() && chunk < plans.size()) backend()->wait();
+    res.ms = (getTimeMicroseconds()-startUs)/1000.0;
+    res.cancelled = cancelRequested && res.ok && res.chunksDone < plans.size();
+    finished = true;
+    if (done) done(*this,doneData);
+}
+
+bool memtestAsyncTest::poll() {
+    while (!finished) {
+        bool complete;
+        cl_int status = backend()->poll(complete);
+        if (status != CL_SUCCESS) {
+            fail(status);
+            break;
+        }
+        if (!complete) break;
+
+        const memtestState* state = plans[chunk].tester;
+        const memtestOp& o = plans[chunk].ops[op];
+        if (isVerifyKernel(o.kernel) && !readingCounts) {
+            // The verify kernel is done; fetch its per-block counts
+            counts.resize(state->nBlocks);
+            status = backend()->launchReadCounts(&counts[0]);
+            if (status != CL_SUCCESS) {
+                fail(status);
+                break;
+            }
+            readingCounts = true;
+            continue;
+        }
+        uint opErrors = 0;
+        if (readingCounts) {
+            for (size_t b = 0; b < counts.size(); b++) opErrors += counts[b];
+            if (opErrors > 0) state->addRegionErrors(&counts[0],0,state->nBlocks);
+            chunkErrors += opErrors;
+            readingCounts = false;
+        }
+        state->logKernel(o.kernel,o.params,state->nBlocks,opStartUs,opErrors);
+        opsDone++;
+        if (++op == plans[chunk].ops.size()) {
+            res.errorCount += chunkErrors;
+            res.chunksDone++;
+            if (chunkErrors > 0 && !state->collectBitErrors()) {
+                fail(CL_INVALID_OPERATION);
+                break;
+            }
+            tester.endChunk(plans[chunk].result,state,chunkStartUs,chunkErrors);
+            chunkErrors = 0;
+            op = 0;
+            if (++chunk == plans.size()) {
+                finish();
+                break;
+            }
+            if (!cancelRequested) tester.beginChunk(plans[chunk].result,(uint)chunk,plans[chunk].tester,chunkStartUs);
+        }
+        if (cancelRequested) {
+            finish();
+            break;
+        }
+        launchOp();
+    }
+    return finished;
+}
+
+void memtestAsyncTest::wait() {
+    while (!poll()) backend()->wait();
+}
+
+memtestSliceTest::memtestSliceTest(const memtestMultiTester& t) :
+    tester(t), chunk(0), op(0), nextBlock(0), cancelRequested(false), finished(false),
+    chunkErrors(0), blocksDone(0), blocksTotal(0), startUs(0), chunkStartUs(0) {
+    for (int k = 0; k < MT_N_KERNELS; k++) usPerBlock[k] = 0;
+}
+
+void memtestSliceTest::start(bool recorded) {
+    startUs = getTimeMicroseconds();
+    for (size_t c = 0; c < plans.size(); c++) blocksTotal += (unsigned long long)plans[c].ops.size()*plans[c].tester->nBlocks;
+    if (!recorded || plans.empty()) {
+        finish(CL_INVALID_MEM_OBJECT);
+        return;
+    }
+    tester.beginChunk(plans[0].result,0,plans[0].tester,chunkStartUs);
+}
+
+void memtestSliceTest::finish(cl_int status) {
+    if (status != CL_SUCCESS) {
+        res.ok = false;
+        res.status = status;
+    }
+    res.ms = (getTimeMicroseconds()-startUs)/1000.0;
+    res.cancelled = cancelRequested && res.ok && res.chunksDone < plans.size();
+    finished = true;
+}
+
+// Work-groups of the current kernel that fit in budgetUs of device time; may be 0
+uint memtestSliceTest::sliceBlocks(double budgetUs) const {
+    const memtestOp& o = plans[chunk].ops[op];
+    const memtestState* state = plans[chunk].tester;
+    uint blocks = state->nBlocks - nextBlock;
+    // Backends that cannot launch part of a region run each kernel whole
+    if (!state->backend->canLaunchRange()) {
+        if (usPerBlock[o.kernel] > 0 && budgetUs < usPerBlock[o.kernel]*blocks) return 0;
+        return blocks;
+    }
+    if (memtestState::seedsPerBlock(o.kernel,o.params)) return 1;
+    // Measure each kernel on a single work-group first
+    if (usPerBlock[o.kernel] == 0) return 1;
+    double fit = budgetUs/usPerBlock[o.kernel];
+    if (fit < blocks) blocks = (uint)fit;
+    return blocks;
+}
+
+cl_int memtestSliceTest::runSlice(uint blocks) {
+    const memtestState* state = plans[chunk].tester;
+    memtestOp o = plans[chunk].ops[op];
+    const uint N = state->loopIters;
+    if (blocks < state->nBlocks) state->sliceParams(o.kernel,o.params,nextBlock);
+
+    memtestBackend* backend = state->backend;
+    const unsigned long long sliceStartUs = getTimeMicroseconds();
+    state->bytesTouched += state->opBytes(o.kernel,o.params)/state->nBlocks*blocks;
+    state->logLaunch(o.kernel,o.params,blocks);
+    cl_int status = (blocks == state->nBlocks) ? backend->launch(o.kernel,N,o.params)
+                                               : backend->launchRange(o.kernel,N,o.params,nextBlock,blocks);
+    if (status != CL_SUCCESS) return status;
+    uint sliceErrors = 0;
+    if (isVerifyKernel(o.kernel)) {
+        counts.resize(state->nBlocks);
+        status = backend->readCounts(&counts[0]);
+        for (uint b = 0; b < blocks && status == CL_SUCCESS; b++) sliceErrors += counts[b];
+        if (sliceErrors > 0) state->addRegionErrors(&counts[0],nextBlock,blocks);
+        chunkErrors += sliceErrors;
+    } else {
+        status = backend->wait();
+    }
+    if (status != CL_SUCCESS) return status;
+    state->logKernel(o.kernel,o.params,blocks,sliceStartUs,sliceErrors);
+    unsigned long long us = getTimeMicroseconds()-sliceStartUs;
+    usPerBlock[o.kernel] = (us ? us : 1)/(double)blocks;
+
+    blocksDone += blocks;
+    nextBlock += blocks;
+    if (nextBlock < state->nBlocks) return CL_SUCCESS;
+    nextBlock = 0;
+    if (++op < plans[chunk].ops.size()) return CL_SUCCESS;
+    op = 0;
+    res.errorCount += chunkErrors;
+    res.chunksDone++;
+    if (chunkErrors > 0 && !state->collectBitErrors()) return CL_INVALID_OPERATION;
+    tester.endChunk(plans[chunk].result,state,chunkStartUs,chunkErrors);
+    chunkErrors = 0;
+    if (++chunk < plans.size()) tester.beginChunk(plans[chunk].result,(uint)chunk,plans[chunk].tester,chunkStartUs);
+    return CL_SUCCESS;
+}
+
+bool memtestSliceTest::step(unsigned maxUs) {
+    const unsigned long long stepStartUs = getTimeMicroseconds();
+    bool ran = false;
+    while (!finished) {
+        if (cancelRequested) {
+            finish(CL_SUCCESS);
+            break;
+        }
+        const unsigned long long used = getTimeMicroseconds()-stepStartUs;
+        if (ran && used >= maxUs) break;
+        uint blocks = sliceBlocks(used < maxUs ? (double)(maxUs-used) : 0.0);
+        if (blocks == 0) {
+            if (ran) break;
+            // Run at least the smallest launch the backend can make
+            const memtestState* state = plans[chunk].tester;
+            blocks = state->backend->canLaunchRange() ? 1 : state->nBlocks;
+        }
+        cl_int status = runSlice(blocks);
+        if (status != CL_SUCCESS) {
+            finish(status);
+            break;
+        }
+        ran = true;
+        if (chunk == plans.size()) finish(CL_SUCCESS);
+    }
+    return finished;
+}
+
+// Test launchers {{{
+// Each one runs the blocking test with recording on, which captures the kernel
+// launches it would make on every chunk without running them
+#define RECORD_TEST(handle,call) \
+    uint unused; \
+    handle* t = new handle(tester); \
+    tester.setRecording(&t->plans); \
+    bool recorded = tester.call; \
+    tester.setRecording(NULL); \
+    t->start(recorded); \
+    return t;
+
+memtestAsyncTest* memtestAsyncTester::gpuShortLCG0(const uint repeats) {
+    RECORD_TEST(memtestAsyncTest,gpuShortLCG0(unused,repeats))
+}
+memtestAsyncTest* memtestAsyncTester::gpuShortLCG0Shmem(const uint repeats) {
+    RECORD_TEST(memtestAsyncTest,gpuShortLCG0Shmem(unused,repeats))
+}
+memtestAsyncTest* memtestAsyncTester::gpuMovingInversionsOnesZeros() {
+    RECORD_TEST(memtestAsyncTest,gpuMovingInversionsOnesZeros(unused))
+}
+memtestAsyncTest* memtestAsyncTester::gpuWalking8BitM86(const uint shift) {
+    RECORD_TEST(memtestAsyncTest,gpuWalking8BitM86(unused,shift))
+}
+memtestAsyncTest* memtestAsyncTester::gpuWalking8Bit(const bool ones,const uint shift) {
+    RECORD_TEST(memtestAsyncTest,gpuWalking8Bit(unused,ones,shift))
+}
+memtestAsyncTest* memtestAsyncTester::gpuMovingInversionsRandom() {
+    RECORD_TEST(memtestAsyncTest,gpuMovingInversionsRandom(unused))
+}
+memtestAsyncTest* memtestAsyncTester::gpuWalking32Bit(const bool ones,const uint shift) {
+    RECORD_TEST(memtestAsyncTest,gpuWalking32Bit(unused,ones,shift))
+}
+memtestAsyncTest* memtestAsyncTester::gpuRandomBlocks(const uint seed) {
+    RECORD_TEST(memtestAsyncTest,gpuRandomBlocks(unused,seed))
+}
+memtestAsyncTest* memtestAsyncTester::gpuModuloX(const uint shift,const uint pattern,const uint modulus,const uint overwriteIters) {
+    RECORD_TEST(memtestAsyncTest,gpuModuloX(unused,shift,pattern,modulus,overwriteIters))
+}
+memtestSliceTest* memtestSliceTester::gpuShortLCG0(const uint repeats) {
+    RECORD_TEST(memtestSliceTest,gpuShortLCG0(unused,repeats))
+}
+memtestSliceTest* memtestSliceTester::gpuShortLCG0Shmem(const uint repeats) {
+    RECORD_TEST(memtestSliceTest,gpuShortLCG0Shmem(unused,repeats))
+}
+memtestSliceTest* memtestSliceTester::gpuMovingInversionsOnesZeros() {
+    RECORD_TEST(memtestSliceTest,gpuMovingInversionsOnesZeros(unused))
+}
+memtestSliceTest* memtestSliceTester::gpuWalking8BitM86(const uint shift) {
+    RECORD_TEST(memtestSliceTest,gpuWalking8BitM86(unused,shift))
+}
+memtestSliceTest* memtestSliceTester::gpuWalking8Bit(const bool ones,const uint shift) {
+    RECORD_TEST(memtestSliceTest,gpuWalking8Bit(unused,ones,shift))
+}
+memtestSliceTest* memtestSliceTester::gpuMovingInversionsRandom() {
+    RECORD_TEST(memtestSliceTest,gpuMovingInversionsRandom(unused))
+}
+memtestSliceTest* memtestSliceTester::gpuWalking32Bit(const bool ones,const uint shift) {
+    RECORD_TEST(memtestSliceTest,gpuWalking32Bit(unused,ones,shift))
+}
+memtestSliceTest* memtestSliceTester::gpuRandomBlocks(const uint seed) {
+    RECORD_TEST(memtestSliceTest,gpuRandomBlocks(unused,seed))
+}
+memtestSliceTest* memtestSliceTester::gpuModuloX(const uint shift,const uint pattern,const uint modulus,const uint overwriteIters) {
+    RECORD_TEST(memtestSliceTest,gpuModuloX(unused,shift,pattern,modulus,overwriteIters))
+}
+#undef RECORD_TEST
+//}}}
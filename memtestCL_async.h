@@ -0,0 +1,160 @@
+/*
+ * memtestCL_async.h
+ * Non-blocking and sliced interfaces to the memtestMultiTester tests, for
+ * applications that embed MemtestCL and drive it from their own event loop.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_ASYNC_H_
+#define _MEMTESTCL_ASYNC_H_
+
+#include "memtestCL_core.h"
+
+// Outcome of an asynchronous test
+struct memtestAsyncResult {
+    bool ok;                    // every kernel ran; false on an OpenCL error
+    bool cancelled;             // stopped early by cancel()
+    cl_int status;              // first OpenCL error, or CL_SUCCESS
+    uint errorCount;            // errors found in the chunks tested
+    uint chunksDone;            // chunks tested completely
+    double ms;
+    memtestAsyncResult() : ok(true), cancelled(false), status(CL_SUCCESS), errorCount(0), chunksDone(0), ms(0) {}
+};
+
+// Handle to one test running over every chunk of a memtestMultiTester. Nothing runs
+// on threads of its own: each call to poll() checks the device without blocking and
+// enqueues the next kernel once the previous one has completed, so the caller's own
+// work can share the queue. Listeners of the tester are notified as chunks complete.
+class memtestAsyncTest { //{{{
+    friend class memtestAsyncTester;
+public:
+    typedef void (*callback)(memtestAsyncTest& test,void* userData);
+protected:
+    const memtestMultiTester& tester;
+    vector<memtestChunkPlan> plans;
+    size_t chunk;
+    size_t op;
+    bool readingCounts;
+    bool cancelRequested;
+    bool finished;
+    vector<uint> counts;
+    uint chunkErrors;
+    size_t opsDone;
+    size_t opsTotal;
+    unsigned long long startUs;
+    unsigned long long chunkStartUs;
+    unsigned long long opStartUs;   // for the event log
+    memtestAsyncResult res;
+    callback done;
+    void* doneData;
+
+    memtestAsyncTest(const memtestMultiTester& t);
+    memtestBackend* backend() const {return plans[chunk].tester->backend;}
+    void start(bool recorded);
+    void launchOp();
+    void fail(cl_int status);
+    void finish();
+public:
+    // Cancels the test and waits for the kernel in flight, if it has not finished
+    ~memtestAsyncTest();
+
+    // Called once, from poll() or wait(), when the test finishes for any reason
+    void setCallback(callback cb,void* userData) {done = cb; doneData = userData;}
+    // Advances the test as far as possible without blocking; true once finished
+    bool poll();
+    // Blocks until the test has finished
+    void wait();
+    // Stops the test after the kernel in flight; the chunk it belongs to is not counted
+    void cancel() {cancelRequested = true;}
+    bool isFinished() const {return finished;}
+    // Fraction of the test's kernels completed, 0 to 1
+    double progress() const {return opsTotal ? (double)opsDone/opsTotal : 1.0;}
+    const memtestAsyncResult& result() const {return res;}
+}; //}}}
+
+// Starts the tests of a memtestMultiTester asynchronously. Each method takes the
+// parameters of the blocking memtestMultiTester method of the same name, and returns
+// a handle that the caller deletes. Run one test at a time on each tester.
+class memtestAsyncTester { //{{{
+protected:
+    memtestMultiTester& tester;
+public:
+    memtestAsyncTester(memtestMultiTester& t) : tester(t) {}
+
+    memtestAsyncTest* gpuShortLCG0(const uint repeats);
+    memtestAsyncTest* gpuShortLCG0Shmem(const uint repeats);
+    memtestAsyncTest* gpuMovingInversionsOnesZeros();
+    memtestAsyncTest* gpuWalking8BitM86(const uint shift);
+    memtestAsyncTest* gpuWalking8Bit(const bool ones,const uint shift);
+    memtestAsyncTest* gpuMovingInversionsRandom();
+    memtestAsyncTest* gpuWalking32Bit(const bool ones,const uint shift);
+    memtestAsyncTest* gpuRandomBlocks(const uint seed);
+    memtestAsyncTest* gpuModuloX(const uint shift,const uint pattern,const uint modulus,const uint overwriteIters);
+}; //}}}
+
+// Handle to one test over every chunk of a memtestMultiTester, run cooperatively in
+// slices: each kernel of the test is split into launches over a few work-groups at a
+// time, sized from the measured speed of that kernel so that a call to step() keeps
+// the device busy for about the time it is given. Error counts accumulate across
+// slices, so the result is that of the blocking test. Between steps the queue is free
+// for the caller's own kernels. On a backend that cannot launch part of a region, each
+// slice is a whole kernel.
+class memtestSliceTest { //{{{
+    friend class memtestSliceTester;
+protected:
+    const memtestMultiTester& tester;
+    vector<memtestChunkPlan> plans;
+    size_t chunk;
+    size_t op;
+    uint nextBlock;             // first work-group of the current kernel not yet run
+    bool cancelRequested;
+    bool finished;
+    vector<uint> counts;
+    uint chunkErrors;
+    unsigned long long blocksDone;
+    unsigned long long blocksTotal;
+    // Measured time per work-group of each kernel, or 0 before its first slice
+    double usPerBlock[MT_N_KERNELS];
+    unsigned long long startUs;
+    unsigned long long chunkStartUs;
+    memtestAsyncResult res;
+
+    memtestSliceTest(const memtestMultiTester& t);
+    void start(bool recorded);
+    uint sliceBlocks(double budgetUs) const;
+    cl_int runSlice(uint blocks);
+    void finish(cl_int status);
+public:
+    // Runs slices until about maxUs of device time has been used, but always at least
+    // one launch; blocks until they complete. True once the test has finished.
+    bool step(unsigned maxUs);
+    // Stops the test at the next step(); the chunk in progress is not counted
+    void cancel() {cancelRequested = true;}
+    bool isFinished() const {return finished;}
+    // Fraction of the test's work-groups completed, 0 to 1
+    double progress() const {return blocksTotal ? (double)blocksDone/blocksTotal : 1.0;}
+    const memtestAsyncResult& result() const {return res;}
+}; //}}}
+
+// Starts the tests of a memtestMultiTester in slices, as memtestAsyncTester does
+class memtestSliceTester { //{{{
+protected:
+    memtestMultiTester& tester;
+public:
+    memtestSliceTester(memtestMultiTester& t) : tester(t) {}
+
+    memtestSliceTest* gpuShortLCG0(const uint repeats);
+    memtestSliceTest* gpuShortLCG0Shmem(const uint repeats);
+    memtestSliceTest* gpuMovingInversionsOnesZeros();
+    memtestSliceTest* gpuWalking8BitM86(const uint shift);
+    memtestSliceTest* gpuWalking8Bit(const bool ones,const uint shift);
+    memtestSliceTest* gpuMovingInversionsRandom();
+    memtestSliceTest* gpuWalking32Bit(const bool ones,const uint shift);
+    memtestSliceTest* gpuRandomBlocks(const uint seed);
+    memtestSliceTest* gpuModuloX(const uint shift,const uint pattern,const uint modulus,const uint overwriteIters);
+}; //}}}
+
+#endif
@@ -0,0 +1,607 @@
+/*
+ * memtestCL_bench.cpp
+ * Kernel micro-benchmarks for MemtestCL: times every test kernel over a sweep
+ * of region sizes and launch geometries, reports median and 95th-percentile
+ * throughput and launch overhead, and compares the results with a stored JSON
+ * baseline so that driver updates or kernel changes that slow a test down are
+ * caught. Runs on any OpenCL device, including CPU runtimes such as PoCL, or
+ * on the simulated backend.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#include "ezOptionParser.hpp"
+
+#include "memtestCL_core.h"
+#include "memtestCL_sim.h"
+#include "memtestCL_output.h"
+
+// Kernels benchmarked, with representative parameters. Each verify kernel follows the
+// write kernel that leaves the pattern it expects, so that it is timed on the
+// error-free path, as in a passing test.
+static const struct {
+    memtestKernel kernel;
+    uint params[5];
+} benchKernels[] = {
+    {MT_WRITE_CONSTANT,          {0x5A5A5A5A}},
+    {MT_VERIFY_CONSTANT,         {0x5A5A5A5A}},
+    {MT_LOGIC,                   {1,1024}},
+    {MT_LOGIC_SHARED,            {1,1024}},
+    {MT_WRITE_PAIRED_CONSTANTS,  {0x01020408,0xFEFDFBF7}},
+    {MT_VERIFY_PAIRED_CONSTANTS, {0x01020408,0xFEFDFBF7}},
+    {MT_WRITE_W32,               {1,7}},
+    {MT_VERIFY_W32,              {1,7}},
+    {MT_WRITE_RANDOM,            {0x2545F491}},
+    {MT_VERIFY_RANDOM,           {0x2545F491}},
+    {MT_WRITE_MOD,               {3,0xC3C3C3C3,0x3C3C3C3C,20,2}},
+    {MT_VERIFY_MOD,              {3,0xC3C3C3C3,20}}
+};
+static const int n_bench_kernels = sizeof(benchKernels)/sizeof(benchKernels[0]);
+
+static const uint* benchParams(memtestKernel k) {
+    for (int i = 0; i < n_bench_kernels; i++) {
+        if (benchKernels[i].kernel == k) return benchKernels[i].params;
+    }
+    return benchKernels[0].params;
+}
+
+struct benchResult {
+    std::string kernel;
+    uint megs;
+    uint blocks;
+    uint threads;
+    double medianGBps;
+    double p95GBps;     // throughput of the 95th-percentile (slow) repetition
+    double launchUs;    // median time of a launch touching one word per work-item
+    benchResult() : megs(0), blocks(0), threads(0), medianGBps(0), p95GBps(0), launchUs(0) {}
+};
+
+// Runs one launch to completion. On OpenCL devices clFinish waits without the polling
+// sleeps of memtestBackend::wait, which would otherwise dominate short kernels.
+static cl_int runOnce(memtestBackend* backend,cl_command_queue cq,memtestKernel k,uint N,const uint* p) {
+    cl_int status = backend->launch(k,N,p);
+    if (status != CL_SUCCESS) return status;
+    if (cq) {
+        status = clFinish(cq);
+        if (status != CL_SUCCESS) return status;
+    }
+    // Releases the completed launch
+    return backend->wait();
+}
+
+// Times reps launches after warmup untimed ones; us holds the times sorted
+static cl_int timeKernel(memtestBackend* backend,cl_command_queue cq,memtestKernel k,uint N,const uint* p,int warmup,int reps,vector<double>& us) {
+    us.clear();
+    for (int r = 0; r < warmup; r++) {
+        cl_int status = runOnce(backend,cq,k,N,p);
+        if (status != CL_SUCCESS) return status;
+    }
+    for (int r = 0; r < reps; r++) {
+        const unsigned long long start = getTimeMicroseconds();
+        cl_int status = runOnce(backend,cq,k,N,p);
+        if (status != CL_SUCCESS) return status;
+        const unsigned long long end = getTimeMicroseconds();
+        us.push_back((end > start) ? (double)(end-start) : 1.0);
+    }
+    std::sort(us.begin(),us.end());
+    return CL_SUCCESS;
+}
+
+static double percentile(const vector<double>& sorted,double q) {
+    size_t i = (size_t)(q*sorted.size()+0.999999);
+    if (i > 0) i--;
+    if (i >= sorted.size()) i = sorted.size()-1;
+    return sorted[i];
+}
+
+// Baseline files {{{
+// {"device": "...", "driver": "...", "results": [
+//   {"kernel": "deviceWriteConstant", "mb": 64, "blocks": 1024, "threads": 512, "median_gbps": 1.5, "p95_gbps": 1.4, "launch_us": 12},
+//   ...
+// ]}
+// Value of "key" in a flat JSON object
+static size_t jsonValue(const std::string& obj,const char* key) {
+    const std::string pattern = std::string("\"") + key + "\"";
+    size_t at = obj.find(pattern);
+    if (at == std::string::npos) return at;
+    at = obj.find(':',at+pattern.size());
+    if (at == std::string::npos) return at;
+    at++;
+    while (at < obj.size() && (obj[at] == ' ' || obj[at] == '\t')) at++;
+    return at;
+}
+static bool jsonNumber(const std::string& obj,const char* key,double& value) {
+    size_t at = jsonValue(obj,key);
+    if (at == std::string::npos) return false;
+    const char* start = obj.c_str()+at;
+    char* end;
+    value = strtod(start,&end);
+    return end != start;
+}
+static bool jsonString(const std::string& obj,const char* key,std::string& value) {
+    size_t at = jsonValue(obj,key);
+    if (at == std::string::npos || obj[at] != '"') return false;
+    value.clear();
+    for (at++; at < obj.size() && obj[at] != '"'; at++) {
+        if (obj[at] == '\\' && at+1 < obj.size()) {
+            at++;
+            // jsonQuote writes control characters as \u00XX
+            if (obj[at] == 'u' && at+4 < obj.size()) {
+                value += (char)strtol(obj.substr(at+1,4).c_str(),NULL,16);
+                at += 4;
+                continue;
+            }
+        }
+        value += obj[at];
+    }
+    return at < obj.size();
+}
+
+static bool saveBaseline(const char* filename,const std::string& device,const std::string& driver,const vector<benchResult>& results) {
+    FILE* f = fopen(filename,"w");
+    if (f == NULL) return false;
+    fprintf(f,"{\"device\": %s, \"driver\": %s, \"results\": [\n",jsonQuote(device).c_str(),jsonQuote(driver).c_str());
+    for (size_t i = 0; i < results.size(); i++) {
+        const benchResult& r = results[i];
+        fprintf(f,"  {\"kernel\": %s, \"mb\": %u, \"blocks\": %u, \"threads\": %u, \"median_gbps\": %.6g, \"p95_gbps\": %.6g, \"launch_us\": %.6g}%s\n",
+                jsonQuote(r.kernel).c_str(),r.megs,r.blocks,r.threads,r.medianGBps,r.p95GBps,r.launchUs,(i+1 < results.size()) ? "," : "");
+    }
+    fprintf(f,"]}\n");
+    return fclose(f) == 0;
+}
+
+static bool loadBaseline(const char* filename,std::string& device,std::string& driver,vector<benchResult>& results,std::string& error) {
+    FILE* f = fopen(filename,"r");
+    if (f == NULL) {
+        error = "cannot open file";
+        return false;
+    }
+    std::string text;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf,1,sizeof(buf),f)) > 0) text.append(buf,n);
+    fclose(f);
+
+    size_t at = text.find("\"results\"");
+    if (at == std::string::npos) {
+        error = "no results";
+        return false;
+    }
+    // Everything before the results is the header object
+    const std::string header = text.substr(0,at);
+    jsonString(header,"device",device);
+    jsonString(header,"driver",driver);
+    results.clear();
+    while ((at = text.find('{',at)) != std::string::npos) {
+        size_t end = text.find('}',at);
+        if (end == std::string::npos) break;
+        const std::string obj = text.substr(at,end-at+1);
+        benchResult r;
+        double megs, blocks, threads;
+        if (!jsonString(obj,"kernel",r.kernel) || !jsonNumber(obj,"mb",megs) || !jsonNumber(obj,"blocks",blocks) ||
+            !jsonNumber(obj,"threads",threads) || !jsonNumber(obj,"median_gbps",r.medianGBps)) {
+            error = "malformed result: " + obj;
+            return false;
+        }
+        r.megs = (uint)megs;
+        r.blocks = (uint)blocks;
+        r.threads = (uint)threads;
+        jsonNumber(obj,"p95_gbps",r.p95GBps);
+        jsonNumber(obj,"launch_us",r.launchUs);
+        results.push_back(r);
+        at = end+1;
+    }
+    return true;
+}
+//}}}
+
+// Reports results that moved past threshold (a fraction) from the baseline; returns the
+// number of regressions. Launch overhead only counts when it grew by at least 5 us too,
+// since a few microseconds of scheduling noise are large fractions of it.
+static int compareBaseline(const vector<benchResult>& results,const vector<benchResult>& baseline,double threshold) {
+    int regressions = 0, faster = 0, missing = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        const benchResult& r = results[i];
+        const benchResult* b = NULL;
+        for (size_t j = 0; j < baseline.size() && !b; j++) {
+            if (baseline[j].kernel == r.kernel && baseline[j].megs == r.megs && baseline[j].blocks == r.blocks && baseline[j].threads == r.threads) b = &baseline[j];
+        }
+        if (b == NULL) {
+            missing++;
+            continue;
+        }
+        if (r.medianGBps < b->medianGBps*(1-threshold)) {
+            printf("REGRESSION: %s %u MiB %ux%u: median %.2f GB/s, baseline %.2f GB/s (%+.1f%%)\n",
+                   r.kernel.c_str(),r.megs,r.blocks,r.threads,r.medianGBps,b->medianGBps,100*(r.medianGBps/b->medianGBps-1));
+            regressions++;
+        } else if (r.medianGBps > b->medianGBps*(1+threshold)) {
+            faster++;
+        }
+        if (b->launchUs > 0 && r.launchUs > b->launchUs*(1+threshold) && r.launchUs > b->launchUs+5) {
+            printf("REGRESSION: %s %u MiB %ux%u: launch overhead %.1f us, baseline %.1f us (%+.1f%%)\n",
+                   r.kernel.c_str(),r.megs,r.blocks,r.threads,r.launchUs,b->launchUs,100*(r.launchUs/b->launchUs-1));
+            regressions++;
+        }
+    }
+    printf("Compared %u results with the baseline: %d regressions past %.0f%%, %d faster, %d not in the baseline\n",
+           (uint)results.size(),regressions,threshold*100,faster,missing);
+    return regressions;
+}
+
+// Creates a context and in-order queue on device devIdx (of any type) of platform platIdx
+static bool initialize_CL(int platIdx,int devIdx,cl_context& ctx,cl_device_id& dev,cl_command_queue& cq) { //{{{
+    cl_platform_id platforms[16];
+    cl_uint num_platforms = 0;
+    clGetPlatformIDs(16,platforms,&num_platforms);
+    if (platIdx < 0 || platIdx >= (int)num_platforms) {
+        printf("Error: OpenCL platform %d not available (%u platforms)\n",platIdx,num_platforms);
+        return false;
+    }
+    cl_device_id devids[32];
+    cl_uint num_devices = 0;
+    clGetDeviceIDs(platforms[platIdx],CL_DEVICE_TYPE_ALL,32,devids,&num_devices);
+    if (devIdx < 0 || devIdx >= (int)num_devices) {
+        printf("Error: OpenCL device %d not available on platform %d (%u devices)\n",devIdx,platIdx,num_devices);
+        return false;
+    }
+    dev = devids[devIdx];
+    cl_context_properties ctxprops[3] = {CL_CONTEXT_PLATFORM,(cl_context_properties)platforms[platIdx],0};
+    cl_int err;
+    ctx = clCreateContext(ctxprops,1,&dev,NULL,NULL,&err);
+    if (err != CL_SUCCESS) {
+        printf("Error creating context: %s\n",descriptionOfError(err));
+        return false;
+    }
+    cq = clCreateCommandQueue(ctx,dev,0,&err);
+    if (err != CL_SUCCESS) {
+        printf("Error creating command queue: %s\n",descriptionOfError(err));
+        clReleaseContext(ctx);
+        return false;
+    }
+    return true;
+} //}}}
+
+// Host overhead {{{
+// Measurements of the host side of launching and synchronizing, on empty kernels (N = 0)
+// of a single work-group, so that device time does not hide it.
+static void printOverhead(const char* name,vector<double>& us) {
+    std::sort(us.begin(),us.end());
+    printf("%-48s %10.1f %10.1f %10.1f\n",name,percentile(us,0.5),percentile(us,0.95),us[0]);
+}
+
+// Ways of waiting for a launch to complete
+enum benchWait {WAIT_SOFTWAIT, WAIT_SOFTWAIT_SPIN, WAIT_EVENTS, WAIT_FINISH, N_BENCH_WAITS};
+static const char* benchWaitNames[N_BENCH_WAITS] = {
+    "softwaitForEvents, 1 ms sleeps", "softwaitForEvents, no sleeps", "clWaitForEvents", "clFinish"
+};
+
+// Waits for event and releases it
+static cl_int waitFor(cl_event event,cl_command_queue cq,int strategy) {
+    cl_int status;
+    switch (strategy) {
+        case WAIT_SOFTWAIT:      return softwaitForEvents(1,&event,&cq);
+        case WAIT_SOFTWAIT_SPIN: return softwaitForEvents(1,&event,&cq,0);
+        case WAIT_EVENTS:        status = clWaitForEvents(1,&event); break;
+        default:                 status = clFinish(cq); break;
+    }
+    clReleaseEvent(event);
+    return status;
+}
+
+// Argument setting, enqueueing, each wait strategy and the error count readback, through
+// memtestFunctions as memtestCLBackend uses it
+static bool functionsOverhead(cl_context ctx,cl_device_id dev,cl_command_queue cq,uint nThreads,int warmup,int reps) {
+    memtestFunctions memtest(ctx,dev,cq);
+    const uint nBlocks = 1;
+    cl_int status, err[3];
+    cl_mem base = clCreateBuffer(ctx,CL_MEM_READ_WRITE,sizeof(uint)*nThreads,NULL,&err[0]);
+    cl_mem blockErrors = clCreateBuffer(ctx,CL_MEM_READ_WRITE,sizeof(uint)*nBlocks,NULL,&err[1]);
+    cl_mem bitErrors = clCreateBuffer(ctx,CL_MEM_READ_WRITE,sizeof(uint)*MT_BIT_LANES,NULL,&err[2]);
+    bool ok = (err[0] == CL_SUCCESS && err[1] == CL_SUCCESS && err[2] == CL_SUCCESS);
+    vector<double> us;
+    char name[128];
+
+    // The kernels with the fewest and the most arguments
+    const memtestKernel argKernels[] = {MT_WRITE_CONSTANT, MT_VERIFY_RANDOM};
+    for (int i = 0; i < 2 && ok; i++) {
+        us.clear();
+        for (int r = 0; r < warmup+reps && ok; r++) {
+            const unsigned long long start = getTimeMicroseconds();
+            status = memtest.setLaunchArgs(argKernels[i],nThreads,base,0,benchParams(argKernels[i]),blockErrors,bitErrors);
+            const unsigned long long end = getTimeMicroseconds();
+            ok = (status == CL_SUCCESS);
+            if (r >= warmup) us.push_back((double)(end-start));
+        }
+        sprintf(name,"set arguments, %s",kernelName(argKernels[i]));
+        if (ok) printOverhead(name,us);
+    }
+
+    // Enqueueing alone: argument setting, clEnqueueNDRangeKernel and its event
+    us.clear();
+    for (int r = 0; r < warmup+reps && ok; r++) {
+        const unsigned long long start = getTimeMicroseconds();
+        cl_event event = memtest.launch(MT_WRITE_CONSTANT,nBlocks,nThreads,base,0,benchParams(MT_WRITE_CONSTANT),NULL,NULL,status);
+        const unsigned long long end = getTimeMicroseconds();
+        ok = (status == CL_SUCCESS);
+        if (ok) ok = (waitFor(event,cq,WAIT_FINISH) == CL_SUCCESS);
+        if (r >= warmup) us.push_back((double)(end-start));
+    }
+    if (ok) printOverhead("launch, enqueue only",us);
+
+    // Launch to completion
+    for (int w = 0; w < N_BENCH_WAITS && ok; w++) {
+        us.clear();
+        for (int r = 0; r < warmup+reps && ok; r++) {
+            const unsigned long long start = getTimeMicroseconds();
+            cl_event event = memtest.launch(MT_WRITE_CONSTANT,nBlocks,nThreads,base,0,benchParams(MT_WRITE_CONSTANT),NULL,NULL,status);
+            ok = (status == CL_SUCCESS);
+            if (ok) ok = (waitFor(event,cq,w) == CL_SUCCESS);
+            const unsigned long long end = getTimeMicroseconds();
+            if (r >= warmup) us.push_back((double)(end-start));
+        }
+        sprintf(name,"empty kernel, %s",benchWaitNames[w]);
+        if (ok) printOverhead(name,us);
+    }
+
+    // Blocking readback of the counts of a completed verify kernel
+    us.clear();
+    uint counts[nBlocks];
+    for (int r = 0; r < warmup+reps && ok; r++) {
+        cl_event event = memtest.launch(MT_VERIFY_CONSTANT,nBlocks,nThreads,base,0,benchParams(MT_VERIFY_CONSTANT),blockErrors,bitErrors,status);
+        ok = (status == CL_SUCCESS);
+        if (ok) ok = (waitFor(event,cq,WAIT_FINISH) == CL_SUCCESS);
+        const unsigned long long start = getTimeMicroseconds();
+        if (ok) memtest.readErrorCounts(nBlocks,blockErrors,counts,status);
+        const unsigned long long end = getTimeMicroseconds();
+        ok = ok && (status == CL_SUCCESS);
+        if (r >= warmup) us.push_back((double)(end-start));
+    }
+    if (ok) printOverhead("error count readback",us);
+
+    if (err[0] == CL_SUCCESS) clReleaseMemObject(base);
+    if (err[1] == CL_SUCCESS) clReleaseMemObject(blockErrors);
+    if (err[2] == CL_SUCCESS) clReleaseMemObject(bitErrors);
+    return ok;
+}
+
+// Launch to completion and readback through memtestBackend, as memtestState and the
+// asynchronous tests use it
+static bool backendOverhead(memtestBackend* backend,uint nThreads,int warmup,int reps) {
+    if (backend->allocate(1,1,nThreads) != CL_SUCCESS) return false;
+    const uint* params = benchParams(MT_VERIFY_CONSTANT);
+    vector<double> us[4];
+    uint counts[1];
+    bool ok = true;
+    for (int r = 0; r < warmup+reps && ok; r++) {
+        unsigned long long t[5];
+        bool done = false;
+        t[0] = getTimeMicroseconds();
+        ok = (backend->launch(MT_VERIFY_CONSTANT,0,params) == CL_SUCCESS && backend->wait() == CL_SUCCESS);
+        t[1] = getTimeMicroseconds();
+        ok = ok && (backend->launch(MT_VERIFY_CONSTANT,0,params) == CL_SUCCESS);
+        while (ok && !done) ok = (backend->poll(done) == CL_SUCCESS);
+        t[2] = getTimeMicroseconds();
+        ok = ok && (backend->readCounts(counts) == CL_SUCCESS);
+        t[3] = getTimeMicroseconds();
+        ok = ok && (backend->launchReadCounts(counts) == CL_SUCCESS && backend->wait() == CL_SUCCESS);
+        t[4] = getTimeMicroseconds();
+        if (r < warmup) continue;
+        for (int i = 0; i < 4; i++) us[i].push_back((double)(t[i+1]-t[i]));
+    }
+    backend->deallocate();
+    if (!ok) return false;
+    printOverhead("backend launch and wait",us[0]);
+    printOverhead("backend launch, polled until done",us[1]);
+    printOverhead("backend readCounts",us[2]);
+    printOverhead("backend launchReadCounts and wait",us[3]);
+    return true;
+}
+//}}}
+
+void print_usage() { //{{{
+    printf("Usage: memtestCL_bench [options]\n");
+    printf("Times every MemtestCL kernel over each region size and launch geometry.\n");
+    printf("    -p, --platform N     : OpenCL platform (default 0)\n");
+    printf("    -g, --gpu N          : OpenCL device of any type, including CPUs (default 0)\n");
+    printf("        --simulate       : benchmark the simulated backend instead\n");
+    printf("        --sizes MB,...   : region sizes (default 16,64,256)\n");
+    printf("        --blocks N,...   : work-groups per launch (default 256,1024)\n");
+    printf("        --threads N,...  : work-items per work-group (default 64,256,512)\n");
+    printf("        --warmup N       : untimed launches before each measurement (default 2)\n");
+    printf("        --reps N         : timed launches per measurement (default 10)\n");
+    printf("        --save FILE      : write the results as a JSON baseline\n");
+    printf("        --baseline FILE  : compare with a JSON baseline; exit status 1 on regressions\n");
+    printf("        --threshold F    : relative change that counts as a regression (default 0.1)\n");
+    printf("        --overhead       : time the host side of launches, waits and readbacks instead\n");
+    printf("                           (--threads sets the work-group size, --reps defaults to 200)\n");
+} //}}}
+
+int main(int argc,const char** argv) {
+    int platID = 0, gpuID = 0;
+    bool simulate = false;
+    vector<int> sizes, blockCounts, threadCounts;
+    int warmup = 2, reps = 10;
+    double threshold = 0.1;
+    std::string saveFile, baselineFile;
+
+    ez::ezOptionParser opt;
+    opt.add("0",0,1,0,"OpenCL platform\n","--platform","-p");
+    opt.add("0",0,1,0,"OpenCL device\n","--gpu","-g");
+    opt.add("",0,0,0,"benchmark the simulated backend\n","--simulate");
+    opt.add("16,64,256",0,-1,',',"region sizes in MiB\n","--sizes");
+    opt.add("256,1024",0,-1,',',"work-groups per launch\n","--blocks");
+    opt.add("64,256,512",0,-1,',',"work-items per work-group\n","--threads");
+    opt.add("2",0,1,0,"untimed launches before each measurement\n","--warmup");
+    opt.add("10",0,1,0,"timed launches per measurement\n","--reps");
+    opt.add("",0,1,0,"write the results as a JSON baseline\n","--save");
+    opt.add("",0,1,0,"compare with a JSON baseline\n","--baseline");
+    opt.add("0.1",0,1,0,"relative change that counts as a regression\n","--threshold");
+    opt.add("",0,0,0,"time the host side of launches instead\n","--overhead");
+    opt.add("",0,0,0,"show usage\n","--help","-h");
+    opt.parse(argc,argv);
+    if (opt.isSet("--help") || opt.lastArgs.size() > 0) {
+        print_usage();
+        return opt.isSet("--help") ? 0 : 2;
+    }
+    opt.get("--platform")->getInt(platID);
+    opt.get("--gpu")->getInt(gpuID);
+    simulate = opt.isSet("--simulate");
+    opt.get("--sizes")->getInts(sizes);
+    opt.get("--blocks")->getInts(blockCounts);
+    opt.get("--threads")->getInts(threadCounts);
+    opt.get("--warmup")->getInt(warmup);
+    opt.get("--reps")->getInt(reps);
+    opt.get("--threshold")->getDouble(threshold);
+    const bool overhead = opt.isSet("--overhead");
+    if (overhead && !opt.isSet("--reps")) reps = 200;
+    if (opt.isSet("--save")) opt.get("--save")->getString(saveFile);
+    if (opt.isSet("--baseline")) opt.get("--baseline")->getString(baselineFile);
+    if (sizes.empty() || blockCounts.empty() || threadCounts.empty() || warmup < 0 || reps <= 0 || threshold <= 0) {
+        printf("Error: sizes, blocks and threads must be given, --reps and --threshold must be positive\n");
+        return 2;
+    }
+    for (size_t i = 0; i < sizes.size(); i++) {
+        if (sizes[i] <= 0) {
+            printf("Error: --sizes must be positive\n");
+            return 2;
+        }
+    }
+    for (size_t i = 0; i < blockCounts.size(); i++) {
+        if (blockCounts[i] <= 0) {
+            printf("Error: --blocks must be positive\n");
+            return 2;
+        }
+    }
+    for (size_t i = 0; i < threadCounts.size(); i++) {
+        if (threadCounts[i] <= 0) {
+            printf("Error: --threads must be positive\n");
+            return 2;
+        }
+    }
+
+    vector<benchResult> baseline;
+    std::string baselineDevice, baselineDriver;
+    if (!baselineFile.empty()) {
+        std::string error;
+        if (!loadBaseline(baselineFile.c_str(),baselineDevice,baselineDriver,baseline,error)) {
+            printf("Error: could not read baseline %s: %s\n",baselineFile.c_str(),error.c_str());
+            return 2;
+        }
+    }
+
+    cl_context ctx = NULL;
+    cl_device_id dev = NULL;
+    cl_command_queue cq = NULL;
+    memtestBackend* backend;
+    char devname[256] = "host memory", driver[256] = "";
+    size_t maxThreads = 0;
+    if (simulate) {
+        memtestSimParams simParams;
+        for (size_t i = 0; i < sizes.size(); i++) {
+            if ((uint)sizes[i] > simParams.maxAllocMB) simParams.maxAllocMB = sizes[i];
+        }
+        backend = new memtestSimBackend(simParams);
+    } else {
+        if (!initialize_CL(platID,gpuID,ctx,dev,cq)) return 2;
+        clGetDeviceInfo(dev,CL_DEVICE_NAME,sizeof(devname),devname,NULL);
+        clGetDeviceInfo(dev,CL_DRIVER_VERSION,sizeof(driver),driver,NULL);
+        clGetDeviceInfo(dev,CL_DEVICE_MAX_WORK_GROUP_SIZE,sizeof(maxThreads),&maxThreads,NULL);
+        backend = new memtestCLBackend(ctx,dev,cq);
+    }
+    printf("Benchmarking %s on %s%s%s\n",backend->name(),devname,driver[0] ? ", driver " : "",driver);
+    if (overhead) {
+        const uint nThreads = (maxThreads && (size_t)threadCounts[0] > maxThreads) ? (uint)maxThreads : threadCounts[0];
+        printf("Host overhead of empty kernels of one %u-item work-group, over %d repetitions:\n",nThreads,reps);
+        printf("%-48s %10s %10s %10s\n","","median us","p95 us","min us");
+        bool ok = simulate || functionsOverhead(ctx,dev,cq,nThreads,warmup,reps);
+        ok = ok && backendOverhead(backend,nThreads,warmup,reps);
+        delete backend;
+        if (cq) clReleaseCommandQueue(cq);
+        if (ctx) clReleaseContext(ctx);
+        if (!ok) printf("Error: an overhead measurement failed\n");
+        return ok ? 0 : 2;
+    }
+    if (!baselineFile.empty() && (baselineDevice != devname || baselineDriver != driver))
+        printf("Note: baseline was recorded on %s, driver %s\n",baselineDevice.c_str(),baselineDriver.c_str());
+    printf("%-28s %8s %11s %12s %12s %12s\n","kernel","MiB","geometry","median GB/s","p95 GB/s","launch us");
+
+    vector<benchResult> results;
+    vector<double> us;
+    bool failed = false;
+    for (size_t s = 0; s < sizes.size() && !failed; s++) {
+        const unsigned long long words = sizes[s]*262144ULL;
+        for (size_t b = 0; b < blockCounts.size() && !failed; b++) {
+            for (size_t t = 0; t < threadCounts.size() && !failed; t++) {
+                const uint blocks = blockCounts[b], threads = threadCounts[t];
+                // Every work-item must get the same whole number of words
+                if (words % ((unsigned long long)blocks*threads) != 0) continue;
+                if (maxThreads && threads > maxThreads) continue;
+                const uint N = (uint)(words/((unsigned long long)blocks*threads));
+                if (backend->allocate(sizes[s],blocks,threads) != CL_SUCCESS) {
+                    printf("Error: could not allocate %d MiB\n",sizes[s]);
+                    failed = true;
+                    break;
+                }
+                for (int k = 0; k < n_bench_kernels && !failed; k++) {
+                    const memtestKernel kernel = benchKernels[k].kernel;
+                    const uint* params = benchKernels[k].params;
+                    benchResult r;
+                    r.kernel = kernelName(kernel);
+                    r.megs = sizes[s];
+                    r.blocks = blocks;
+                    r.threads = threads;
+                    cl_int status = timeKernel(backend,cq,kernel,1,params,warmup,reps,us);
+                    if (status == CL_SUCCESS) {
+                        r.launchUs = percentile(us,0.5);
+                        status = timeKernel(backend,cq,kernel,N,params,warmup,reps,us);
+                    }
+                    if (status != CL_SUCCESS) {
+                        // Typically a geometry the kernel cannot run with
+                        printf("%-28s %8u %5ux%-5u  failed: %s\n",r.kernel.c_str(),r.megs,blocks,threads,descriptionOfError(status));
+                        continue;
+                    }
+                    const double bytes = (double)memtestState::opBytes(kernel,params,words);
+                    r.medianGBps = bytes/(percentile(us,0.5)*1e3);
+                    r.p95GBps = bytes/(percentile(us,0.95)*1e3);
+                    printf("%-28s %8u %5ux%-5u %12.2f %12.2f %12.1f\n",r.kernel.c_str(),r.megs,blocks,threads,r.medianGBps,r.p95GBps,r.launchUs);
+                    if (isVerifyKernel(kernel)) {
+                        vector<uint> counts(blocks);
+                        uint errors = 0;
+                        if (backend->readCounts(&counts[0]) == CL_SUCCESS) {
+                            for (uint i = 0; i < blocks; i++) errors += counts[i];
+                        }
+                        if (errors) printf("Warning: %s found %u errors; it was timed on the error path\n",r.kernel.c_str(),errors);
+                    }
+                    results.push_back(r);
+                }
+                backend->deallocate();
+            }
+        }
+    }
+    delete backend;
+    if (cq) clReleaseCommandQueue(cq);
+    if (ctx) clReleaseContext(ctx);
+    if (failed) return 2;
+    if (results.empty()) {
+        printf("Error: no size, block and thread count combination divides the regions evenly\n");
+        return 2;
+    }
+
+    if (!saveFile.empty()) {
+        if (saveBaseline(saveFile.c_str(),devname,driver,results))
+            printf("Saved %u results to %s\n",(uint)results.size(),saveFile.c_str());
+        else
+            printf("Warning: could not write %s\n",saveFile.c_str());
+    }
+    if (!baselineFile.empty() && compareBaseline(results,baseline,threshold) > 0) return 1;
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * memtestCL_checkpoint.cpp
+ * Checkpoint files for MemtestCL runs.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include "memtestCL_checkpoint.h"
+#include <string.h>
+
+static const char* checkpointMagic = "MemtestCL checkpoint 1";
+
+bool memtestCheckpoint::save(const char* filename) const {
+    const std::string tmpname = std::string(filename) + ".tmp";
+    FILE* f = fopen(tmpname.c_str(),"w");
+    if (f == NULL) return false;
+
+    fprintf(f,"%s\n",checkpointMagic);
+    fprintf(f,"device %s\n",device.c_str());
+    fprintf(f,"config %d %d %d %u %u %d %.17g\n",(int)simulate,platform,gpu,megs,maxIters,durationSeconds,budgetSeconds);
+    fprintf(f,"progress %llu %u %u %u %u %d %llu %llu %llu\n",elapsedMs,iter,position,step,partialErrors,(int)iterFailed,accumulatedErrors,itersFailed,partialMs);
+    fprintf(f,"schedule %u",(uint)schedule.size());
+    for (size_t i = 0; i < schedule.size(); i++)
+        fprintf(f," %d %u %u",schedule[i].test,schedule[i].firstStep,schedule[i].nSteps);
+    fprintf(f,"\n");
+    fprintf(f,"tests %u\n",(uint)tests.size());
+    for (size_t t = 0; t < tests.size(); t++) {
+        const memtestCheckpointTest& c = tests[t];
+        fprintf(f,"%llu %llu %u %.17g %u %.17g %.17g %.17g %.17g\n",c.errorCount,c.failedIters,c.stepsRun,c.ms,c.nextStep,
+                c.history.steps,c.history.gbSteps,c.history.ms,c.history.errors);
+    }
+    // Only written when tests were deselected; checkpoints without it run every test
+    uint nSkipped = 0;
+    for (size_t t = 0; t < tests.size(); t++) nSkipped += tests[t].skipped ? 1 : 0;
+    if (nSkipped > 0) {
+        fprintf(f,"skipped %u",nSkipped);
+        for (size_t t = 0; t < tests.size(); t++)
+            if (tests[t].skipped) fprintf(f," %u",(uint)t);
+        fprintf(f,"\n");
+    }
+
+    bool ok = !ferror(f);
+    if (fclose(f) != 0) ok = false;
+    #if defined(WINDOWS) || defined(WINNV)
+    // rename() does not replace existing files on Windows
+    if (ok) remove(filename);
+    #endif
+    if (ok && rename(tmpname.c_str(),filename) != 0) ok = false;
+    if (!ok) remove(tmpname.c_str());
+    return ok;
+}
+
+// Range checks on a loaded checkpoint, so that a damaged file cannot index past the tests
+bool memtestCheckpoint::valid() const {
+    if (platform < -1 || gpu < 0 || megs == 0 || durationSeconds < 0 || !(budgetSeconds >= 0)) return false;
+    if (tests.size() != (size_t)memtestNTests || iter > maxIters) return false;
+    for (size_t i = 0; i < schedule.size(); i++) {
+        const memtestScheduledTest& s = schedule[i];
+        if (s.test < 0 || s.test >= memtestNTests) return false;
+        if (s.firstStep >= memtestTests[s.test].steps || s.nSteps > memtestTests[s.test].steps) return false;
+    }
+    if (position > schedule.size()) return false;
+    if (position < schedule.size() && step > schedule[position].nSteps) return false;
+    for (size_t t = 0; t < tests.size(); t++) {
+        const memtestCheckpointTest& c = tests[t];
+        if (c.nextStep >= memtestTests[t].steps || !(c.ms >= 0)) return false;
+        if (!(c.history.steps >= 0 && c.history.gbSteps >= 0 && c.history.ms >= 0 && c.history.errors >= 0)) return false;
+    }
+    return true;
+}
+
+bool memtestCheckpoint::load(const char* filename) {
+    FILE* f = fopen(filename,"r");
+    if (f == NULL) return false;
+    char line[1024];
+    bool ok = false;
+    int sim,failed;
+    uint n;
+
+    do {
+        if (!fgets(line,sizeof(line),f) || strncmp(line,checkpointMagic,strlen(checkpointMagic)) != 0) break;
+        if (!fgets(line,sizeof(line),f) || strncmp(line,"device ",7) != 0) break;
+        device = line+7;
+        if (!device.empty() && device[device.size()-1] == '\n') device.erase(device.size()-1);
+        if (fscanf(f," config %d %d %d %u %u %d %lg",&sim,&platform,&gpu,&megs,&maxIters,&durationSeconds,&budgetSeconds) != 7) break;
+        simulate = (sim != 0);
+        // Checkpoints from before partialMs was kept end the line after itersFailed
+        partialMs = 0;
+        const int nProgress = fscanf(f," progress %llu %u %u %u %u %d %llu %llu %llu",&elapsedMs,&iter,&position,&step,&partialErrors,&failed,
+                                     &accumulatedErrors,&itersFailed,&partialMs);
+        if (nProgress != 8 && nProgress != 9) break;
+        iterFailed = (failed != 0);
+        if (fscanf(f," schedule %u",&n) != 1) break;
+        schedule.resize(n);
+        uint i;
+        for (i = 0; i < n; i++)
+            if (fscanf(f,"%d %u %u",&schedule[i].test,&schedule[i].firstStep,&schedule[i].nSteps) != 3) break;
+        if (i < n) break;
+        if (fscanf(f," tests %u",&n) != 1) break;
+        tests.resize(n);
+        for (i = 0; i < n; i++) {
+            memtestCheckpointTest& c = tests[i];
+            if (fscanf(f,"%llu %llu %u %lg %u %lg %lg %lg %lg",&c.errorCount,&c.failedIters,&c.stepsRun,&c.ms,&c.nextStep,
+                       &c.history.steps,&c.history.gbSteps,&c.history.ms,&c.history.errors) != 9) break;
+        }
+        if (i < n) break;
+        if (fscanf(f," skipped %u",&n) == 1) {
+            uint t;
+            for (i = 0; i < n; i++) {
+                if (fscanf(f,"%u",&t) != 1 || t >= tests.size()) break;
+                tests[t].skipped = true;
+            }
+            if (i < n) break;
+        }
+        ok = valid();
+    } while (0);
+
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,66 @@
+/*
+ * memtestCL_checkpoint.h
+ * Checkpoint files for MemtestCL runs, so that long burn-in runs can be
+ * resumed after the process is killed or the node reboots.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_CHECKPOINT_H_
+#define _MEMTESTCL_CHECKPOINT_H_
+
+#include "memtestCL_sched.h"
+#include <string>
+
+// Counters and scheduler state of one test
+struct memtestCheckpointTest {
+    unsigned long long errorCount;  // total incorrect bits
+    unsigned long long failedIters; // iterations in which the test found errors
+    uint stepsRun;
+    double ms;
+    uint nextStep;              // scheduler rotation
+    memtestTestHistory history; // scheduler history, including this run
+    bool skipped;               // deselected for this run
+    memtestCheckpointTest() : errorCount(0), failedIters(0), stepsRun(0), ms(0), nextStep(0), skipped(false) {}
+};
+
+// Everything needed to continue a run exactly where it stopped. The random patterns
+// of each test step are seeded from the iteration, test and step numbers, so the
+// position in the run is also the state of the random number generator.
+struct memtestCheckpoint {
+    // Run configuration
+    std::string device;
+    bool simulate;
+    int platform;
+    int gpu;
+    uint megs;
+    uint maxIters;
+    int durationSeconds;
+    double budgetSeconds;
+    // Progress
+    unsigned long long elapsedMs;
+    uint iter;                  // current iteration (0-based)
+    uint position;              // next entry of schedule to run
+    uint step;                  // next step within that entry
+    uint partialErrors;         // errors found so far by the interrupted entry
+    unsigned long long partialMs; // and the time it had run for
+    bool iterFailed;            // whether the current iteration has found errors
+    unsigned long long accumulatedErrors;
+    unsigned long long itersFailed;
+    vector<memtestScheduledTest> schedule; // plan of the current iteration
+    vector<memtestCheckpointTest> tests;
+
+    memtestCheckpoint() : simulate(false), platform(0), gpu(0), megs(0), maxIters(0), durationSeconds(0), budgetSeconds(0),
+        elapsedMs(0), iter(0), position(0), step(0), partialErrors(0), partialMs(0), iterFailed(false), accumulatedErrors(0), itersFailed(0) {}
+
+    // Written to a temporary file that is then renamed over filename, so that a crash
+    // while checkpointing leaves the previous checkpoint intact. Both return false on
+    // I/O errors or (for load) a malformed file or one with out-of-range fields.
+    bool save(const char* filename) const;
+    bool load(const char* filename);
+    bool valid() const;
+};
+
+#endif
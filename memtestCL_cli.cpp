@@ -16,10 +16,23 @@
 #include <assert.h>
 #include <string.h>
 #include <ctype.h>
+#include <signal.h>
 
 #include "ezOptionParser.hpp"
 
 #include "memtestCL_core.h"
+#include "memtestCL_sim.h"
+#include "memtestCL_faults.h"
+#include "memtestCL_sched.h"
+#include "memtestCL_checkpoint.h"
+#include "memtestCL_output.h"
+#include "memtestCL_metrics.h"
+#include "memtestCL_daemon.h"
+#include "memtestCL_scavenge.h"
+#include "memtestCL_plan.h"
+#include "memtestCL_stats.h"
+#include "memtestCL_eventlog.h"
+#include "memtestCL_trace.h"
 
 // For isatty
 #ifdef WINDOWS
@@ -64,6 +77,217 @@ int getint_range(const char* prompt,const int min,const int max)
     return sel;
 } //}}}
 
+// Marks the tests named in a comma-separated list of keys or names; returns false
+// and the offending entry if one is not a test {{{
+static bool parseTestList(const std::string& list,vector<bool>& chosen,std::string& bad) {
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = list.find(',',pos);
+        if (comma == std::string::npos) comma = list.size();
+        const std::string entry = list.substr(pos,comma-pos);
+        const int t = memtestFindTest(entry);
+        if (t < 0) {
+            bad = entry;
+            return false;
+        }
+        chosen[t] = true;
+        pos = comma+1;
+    }
+    return true;
+} //}}}
+
+// Test history lives in the user's home directory unless --history says otherwise
+std::string defaultHistoryPath() { //{{{
+    #if defined(WINDOWS) || defined(WINNV)
+    const char* home = getenv("USERPROFILE");
+    #else
+    const char* home = getenv("HOME");
+    #endif
+    if (home == NULL) return ".memtestcl_history";
+    return std::string(home) + "/.memtestcl_history";
+} //}}}
+
+// Set by SIGINT/SIGTERM to end the run cleanly at the next test step
+static volatile sig_atomic_t stopRequested = 0;
+static memtestDaemon* daemonState = NULL;
+static void requestStop(int sig) {
+    stopRequested = 1;
+    if (daemonState) daemonState->requestStop();
+    // A second signal kills the process as usual
+    signal(sig,SIG_DFL);
+}
+
+#ifdef SIGUSR1
+// SIGUSR1 and SIGUSR2 free and retake device memory in daemon mode
+static void requestRelease(int) {
+    if (daemonState) daemonState->requestRelease();
+}
+static void requestResume(int) {
+    if (daemonState) daemonState->requestResume();
+}
+#endif
+
+// Frees device memory until the daemon is told to resume, then allocates it again {{{
+static void releaseDevice(memtestMultiTester* tester,uint megs,memtestDaemon& daemon,memtestResultSink* sink,memtestMetrics* metrics) {
+    tester->deallocate();
+    printf("\tReleased device memory\n");
+    if (sink) sink->daemonState("released",0);
+    if (metrics) metrics->setAllocated(0);
+    while (daemon.waitWhileReleased()) {
+        if (tester->allocate(megs)) {
+            printf("\tReacquired %u MiB of device memory\n",tester->size());
+            if (sink) sink->daemonState("running",tester->size());
+            if (metrics) metrics->setAllocated(tester->size());
+            return;
+        }
+        // The memory is still in use elsewhere; try again after a pause
+        for (int w = 0; w < 50 && !daemon.stopRequested(); w++) SLEEPMS(memtestDaemon::poll_ms);
+    }
+} //}}}
+
+// Frees every scavenged chunk, then grows back into free memory once released {{{
+static void releaseScavenged(memtestMultiTester* tester,memtestScavenger& scavenger,memtestDaemon& daemon,memtestResultSink* sink,memtestMetrics* metrics) {
+    scavenger.release(*tester);
+    printf("\tReleased device memory in %u ms%s\n",scavenger.lastReleaseLatency(),scavenger.lastReleaseLate() ? " (over the target)" : "");
+    if (sink) sink->daemonState("released",0);
+    if (metrics) metrics->setAllocated(0);
+    if (daemon.waitWhileReleased() && scavenger.growFirst(*tester)) {
+        printf("\tScavenging again from %u MiB of device memory\n",tester->size());
+        if (sink) sink->daemonState("running",tester->size());
+        if (metrics) metrics->setAllocated(tester->size());
+    }
+} //}}}
+
+// Seed of the random patterns of one test step
+static unsigned stepSeed(uint iter,int test,uint step) {
+    return (iter*2654435761u) ^ (test*40503u) ^ (step*97u) ^ 1u;
+}
+
+// Runs one step of test t from the given seed. When a device fault that the tester
+// recovered from (see --recover) cuts the step short, the step goes on from the chunk
+// that faulted, a few times at most; the chunks done before are not run (or reported) again.
+static bool runStep(memtestMultiTester* tester,int t,uint step,unsigned seed,uint& errorCount) {
+    const int maxRepeats = 3;
+    uint partialErrorCount;
+    bool ok = false;
+    errorCount = 0;
+    for (int repeat = 0; ; repeat++) {
+        const unsigned long long faults = tester->deviceFaults();
+        srand(seed);
+        ok = memtestTests[t].run(tester,step,partialErrorCount);
+        errorCount += partialErrorCount;
+        if (ok || repeat == maxRepeats || tester->deviceFaults() == faults) break;
+        printf("\t%s: device fault (hung or failed kernel), device state recreated; repeating step %u from chunk %u\n",memtestTests[t].name,step,tester->failedChunk());
+        tester->setFirstChunk(tester->failedChunk());
+    }
+    tester->setFirstChunk(0);
+    return ok;
+}
+
+// Runs the phases of a test plan on the tester's memory, counting into run like
+// iterations do; passes is the number of passes run. False if a test could not run. {{{
+static bool runPlan(const memtestPlan& plan,memtestMultiTester* tester,memtestCheckpoint& run,memtestStats& stats,memtestResultSink* sink,memtestMetrics* metrics,memtestEventLog* eventLog,memtestTrace* trace,uint& passes) {
+    const uint allocated = tester->size();
+    // Time per GiB-step of each test so far, to keep steps within phase budgets
+    vector<double> gbSteps(memtestNTests,0), ms(memtestNTests,0);
+    double maxMsPerGB = 0;
+    passes = 0;
+    for (size_t ph = 0; ph < plan.phases.size() && !stopRequested; ph++) {
+        const memtestPlanPhase& p = plan.phases[ph];
+        const uint megs = tester->setTestedSize((uint)(p.memory*allocated) < 2 ? 2 : (uint)(p.memory*allocated));
+        const double gb = megs/1024.0;
+        const unsigned int phaseStart = getTimeMilliseconds();
+        bool phaseOver = false, planOver = false;
+        printf("Phase %u of %u (%s): %u passes on %u MiB of memory\n",(uint)ph+1,(uint)plan.phases.size(),p.name.c_str(),p.repeat,megs);
+        for (uint rep = 0; rep < p.repeat && !phaseOver && !stopRequested; rep++, passes++) {
+            const unsigned int passStart = getTimeMilliseconds();
+            unsigned long long passErrors = 0;
+            if (eventLog) eventLog->setIteration(passes);
+            printf("Pass %u of %u: %llu errors so far\n",rep+1,p.repeat,run.accumulatedErrors);
+            for (size_t e = 0; e < p.tests.size() && !stopRequested; e++) {
+                const int t = p.tests[e].test;
+                const uint steps = memtestTests[t].steps;
+                uint errorCount = 0,stepErrors,i;
+                const unsigned int start = getTimeMilliseconds();
+                for (i = 0; i < p.tests[e].nSteps && !stopRequested; i++) {
+                    if (p.seconds > 0) {
+                        const double estimate = (gbSteps[t] > 0 ? ms[t]/gbSteps[t] : maxMsPerGB)*gb;
+                        if (getTimeMilliseconds()-phaseStart + estimate > p.seconds*1000.0) {
+                            if (trace) trace->hostInstant("schedule","phase over",std::string("\"skipped\": ")+jsonQuote(memtestTests[t].name));
+                            phaseOver = true;
+                            break;
+                        }
+                    }
+                    const uint step = (p.tests[e].firstStep+i)%steps;
+                    if (sink) sink->setContext(passes,t,memtestTests[t].name,step);
+                    if (metrics) metrics->setTest(t);
+                    const unsigned int stepStart = getTimeMilliseconds();
+                    if (!runStep(tester,t,step,stepSeed(p.seed ? p.seed+rep : passes,t,step),stepErrors)) {
+                        printf("Could not execute test %s; quitting\n",memtestTests[t].name);
+                        tester->setTestedSize(0);
+                        return false;
+                    }
+                    const unsigned int stepMs = getTimeMilliseconds()-stepStart;
+                    run.tests[t].stepsRun++;
+                    run.tests[t].ms += stepMs;
+                    gbSteps[t] += gb;
+                    ms[t] += stepMs;
+                    if (stepMs/gb > maxMsPerGB) maxMsPerGB = stepMs/gb;
+                    errorCount += stepErrors;
+                }
+                const unsigned int end = getTimeMilliseconds();
+                if (i == 0) {
+                    if (!stopRequested) printf("\t%s: skipped, would not finish within the phase\n",memtestTests[t].name);
+                    continue;
+                }
+                stats.record(t,errorCount,gb,end-start,end);
+                passErrors += errorCount;
+                run.tests[t].errorCount += errorCount;
+                run.tests[t].failedIters += (errorCount) ? 1 : 0;
+                if (i < steps)
+                    printf("\t%s: %u errors (%u ms, %u of %u steps)\n",memtestTests[t].name,errorCount,end-start,i,steps);
+                else
+                    printf("\t%s: %u errors (%u ms)\n",memtestTests[t].name,errorCount,end-start);
+            }
+            run.accumulatedErrors += passErrors;
+            if (passErrors) run.itersFailed++;
+            if (sink) sink->iterationDone(passes,passErrors,passErrors != 0,getTimeMilliseconds()-passStart);
+            if (eventLog) eventLog->iterationDone(passErrors,getTimeMilliseconds()-passStart);
+            if (metrics) metrics->iterationDone(passErrors != 0);
+            if (passErrors && p.onError != PLAN_CONTINUE) {
+                phaseOver = true;
+                planOver = (p.onError == PLAN_STOP);
+                printf("Errors found; %s\n",planOver ? "ending the plan" : "going on to the next phase");
+            }
+        }
+        printf("\n");
+        if (planOver) break;
+    }
+    if (stopRequested) printf("Interrupted during pass %u\n",passes);
+    tester->setTestedSize(0);
+    return true;
+} //}}}
+
+static void saveCheckpoint(const std::string& path,memtestCheckpoint& run,const memtestScheduler* scheduler,const vector<memtestScheduledTest>& schedule,
+                           uint iter,uint position,uint step,uint partialErrors,unsigned int partialMs,bool iterFailed,unsigned int runStart) { //{{{
+    run.elapsedMs = getTimeMilliseconds()-runStart;
+    run.iter = iter;
+    run.position = position;
+    run.step = step;
+    run.partialErrors = partialErrors;
+    run.partialMs = partialMs;
+    run.iterFailed = iterFailed;
+    run.schedule = schedule;
+    if (scheduler) {
+        for (size_t t = 0; t < run.tests.size(); t++) {
+            run.tests[t].nextStep = scheduler->getNextStep(t);
+            run.tests[t].history = scheduler->getHistory(t);
+        }
+    }
+    if (!run.save(path.c_str()))
+        printf("Warning: could not write checkpoint to %s\n",path.c_str());
+} //}}}
+
 void print_usage(void) { //{{{
     printf("     -------------------------------------------------------------\n");
     printf("     |                       MemtestCL v1.00                     |\n");
@@ -79,6 +303,61 @@ void print_usage(void) { //{{{
     printf("        --gpu N ,-g N        : run test on the Nth (from 0) OpenCL device\n");
     printf("                               on selected platform\n");
     printf("        --license ,-l        : show license terms for this build\n");
+    printf("        --simulate           : run on a simulated device in host memory\n");
+    printf("                               instead of an OpenCL device\n");
+    printf("        --sim-bandwidth MBPS : memory bandwidth of the simulated device\n");
+    printf("        --sim-latency US     : kernel launch latency of the simulated device\n");
+    printf("        --sim-hang N         : make the Nth kernel launch of the simulated device hang\n");
+    printf("        --duration SECONDS   : run iterations until this much time has passed,\n");
+    printf("                               never starting a test that cannot finish in time\n");
+    printf("        --budget SECONDS     : time budget per iteration; tests are weighted by their\n");
+    printf("                               historical errors found per second on this device\n");
+    printf("        --min-coverage F     : fraction of each test run per iteration under --budget\n");
+    printf("        --screen RATE        : stop as soon as the board is accepted or rejected\n");
+    printf("                               against RATE failing test runs per GiB-hour\n");
+    printf("        --screen-ratio R     : accept below RATE/R (default 4)\n");
+    printf("        --screen-confidence C: confidence of the --screen decision (default 0.95)\n");
+    printf("        --region-size MB     : granularity of the error heatmap (default 64)\n");
+    printf("        --launch-limit MS    : split kernels into launches of at most about MS ms,\n");
+    printf("                               for GPUs with a display watchdog (default 0: off)\n");
+    printf("        --recover            : on a hung or failed kernel, recreate the device state\n");
+    printf("                               and repeat the test step instead of quitting\n");
+    printf("        --hang-factor F      : under --recover, a kernel is hung once it has run F\n");
+    printf("                               times longer than before (default 10)\n");
+    printf("        --history FILE       : test history file (default ~/.memtestcl_history)\n");
+    printf("        --checkpoint FILE    : periodically save the progress of the run to FILE\n");
+    printf("        --checkpoint-interval SECONDS : time between checkpoints (default 60)\n");
+    printf("        --resume             : continue the run saved in the --checkpoint file\n");
+    printf("        --output FILE        : write JSON Lines (or CSV) records of every test to FILE\n");
+    printf("        --output-format FMT  : jsonl or csv (default: csv if FILE ends in .csv)\n");
+    printf("        --event-log FILE     : log every kernel launch to a crash-safe binary ring in FILE,\n");
+    printf("                               read with memtestCL_logdump\n");
+    printf("        --event-log-records N: records the --event-log ring holds (default 65536)\n");
+    printf("        --trace FILE         : write a timeline of every queue operation to FILE as\n");
+    printf("                               Chrome trace JSON, for chrome://tracing or Perfetto\n");
+    printf("        --metrics ADDRESS    : serve live Prometheus metrics over HTTP on ADDRESS:\n");
+    printf("                               unix:PATH, PORT (localhost only) or HOST:PORT\n");
+    printf("        --daemon             : test continuously in the background of other work,\n");
+    printf("                               one test step at a time; SIGUSR1 frees device\n");
+    printf("                               memory and SIGUSR2 takes it back\n");
+    printf("        --duty-cycle F       : largest fraction of time --daemon keeps the device\n");
+    printf("                               busy (default 0.05)\n");
+    printf("        --control ADDRESS    : --daemon control socket (unix:PATH, PORT or HOST:PORT)\n");
+    printf("                               accepting release, resume, status and stop\n");
+    printf("        --scavenge           : as --daemon, but test only free device memory, growing\n");
+    printf("                               one chunk at a time up to [MB] (default: all of it)\n");
+    printf("        --pressure-file FILE : --scavenge frees its memory while FILE exists\n");
+    printf("        --release-target MS  : --scavenge release latency target (default 100)\n");
+    printf("        --scavenge-chunk MB  : largest chunk --scavenge allocates (default 128)\n");
+    printf("        --plan FILE          : run the phases of a test plan file instead of iterations\n");
+    printf("        --tests LIST         : run only these tests (comma-separated, see --list-tests)\n");
+    printf("        --skip LIST          : do not run these tests\n");
+    printf("        --list-tests         : list the tests with their steps and cost, then exit\n");
+    printf("        --skip-self-test     : do not check at startup that injected errors are detected\n");
+    printf("        --fault-coverage N   : measure which injected faults each test detects,\n");
+    printf("                               over N faults of each type, then exit\n");
+    printf("        --fault-rate P       : flip probability per write pass of the\n");
+    printf("                               transient faults used by --fault-coverage\n");
     printf("\n");
 } //}}}
 
@@ -170,6 +449,44 @@ int main(int argc,const char** argv) {
     int ramclock=-1,coreclock=-1;
     int commAuthorized=-1;
     int commBanned=0;
+    bool simulate=false;
+    memtestSimParams simParams;
+    bool runSelfTest=true;
+    double budgetSeconds=0;
+    int durationSeconds=0;
+    double minCoverage=0.125;
+    std::string historyFile;
+    std::string checkpointFile;
+    int checkpointInterval=60;
+    bool resume=false;
+    memtestCheckpoint run;
+    std::string outputFile;
+    std::string outputFormat;
+    std::string eventLogFile;
+    int eventLogRecords=65536;
+    std::string traceFile;
+    std::string metricsAddress;
+    bool daemonMode=false;
+    double dutyCycle=0.05;
+    std::string controlAddress;
+    bool scavenge=false;
+    std::string pressureFile;
+    int releaseTargetMs=100;
+    int scavengeChunkMB=128;
+    std::string planFile;
+    memtestPlan plan;
+    std::string testList;
+    std::string skipList;
+    vector<bool> selected(memtestNTests,true);
+    int faultTrials=0;
+    double screenRate=0;
+    double screenRatio=4;
+    double screenConfidence=0.95;
+    int regionMB=64;
+    int launchLimitMs=0;
+    bool recoverFaults=false;
+    double hangFactor=10;
+    memtestCoverageConfig coverageConfig;
     
     print_usage(); 
     
@@ -205,6 +522,348 @@ int main(int argc,const char** argv) {
         "--license"
     );
 
+    opt.add(
+        "", // Default.
+        0, // Required?
+        0, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "run on a simulated device in host memory\n", // Help description.
+        "--simulate"
+    );
+
+    opt.add(
+        "100000", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "memory bandwidth of the simulated device in MB/s\n", // Help description.
+        "--sim-bandwidth"
+    );
+
+    opt.add(
+        "10", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "kernel launch latency of the simulated device in microseconds\n", // Help description.
+        "--sim-latency"
+    );
+
+    opt.add(
+        "0", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "the Nth kernel launch on each simulated device hangs until recovered\n", // Help description.
+        "--sim-hang"
+    );
+
+    opt.add(
+        "0", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "run iterations until this many seconds have passed\n", // Help description.
+        "--duration"
+    );
+
+    opt.add(
+        "0", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "time budget per iteration in seconds, split across tests by historical errors found per second\n", // Help description.
+        "--budget"
+    );
+
+    opt.add(
+        "0.125", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "fraction of each test run in every iteration under --budget\n", // Help description.
+        "--min-coverage"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "file recording the cost and error yield of each test per device model\n", // Help description.
+        "--history"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "periodically save the progress of the run to this file\n", // Help description.
+        "--checkpoint"
+    );
+
+    opt.add(
+        "60", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "seconds between checkpoints\n", // Help description.
+        "--checkpoint-interval"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        0, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "continue the run saved in the --checkpoint file\n", // Help description.
+        "--resume"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "write machine-readable records of every test to this file (- for stdout)\n", // Help description.
+        "--output"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "format of --output: jsonl or csv\n", // Help description.
+        "--output-format"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "log every kernel launch to a crash-safe binary ring in this file\n", // Help description.
+        "--event-log"
+    );
+
+    opt.add(
+        "65536", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "records the --event-log ring holds\n", // Help description.
+        "--event-log-records"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "write a Chrome trace-event timeline of every queue operation to this file\n", // Help description.
+        "--trace"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "serve live Prometheus metrics on unix:PATH, PORT or HOST:PORT\n", // Help description.
+        "--metrics"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        0, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "test continuously at a limited duty cycle, releasing device memory on request\n", // Help description.
+        "--daemon"
+    );
+
+    opt.add(
+        "0.05", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "largest fraction of time --daemon keeps the device busy\n", // Help description.
+        "--duty-cycle"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "control socket of --daemon: unix:PATH, PORT or HOST:PORT\n", // Help description.
+        "--control"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        0, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "daemon mode over free device memory only, growing into it one chunk at a time\n", // Help description.
+        "--scavenge"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "file whose existence makes --scavenge free its memory\n", // Help description.
+        "--pressure-file"
+    );
+
+    opt.add(
+        "100", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "release latency target of --scavenge, in milliseconds\n", // Help description.
+        "--release-target"
+    );
+
+    opt.add(
+        "128", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "largest chunk --scavenge allocates, in MiB\n", // Help description.
+        "--scavenge-chunk"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "test plan file to run\n", // Help description.
+        "--plan"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "comma-separated keys or names of the tests to run\n", // Help description.
+        "--tests"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "comma-separated keys or names of tests not to run\n", // Help description.
+        "--skip"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        0, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "list the available tests and exit\n", // Help description.
+        "--list-tests"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        0, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "do not check at startup that injected errors are detected\n", // Help description.
+        "--skip-self-test"
+    );
+
+    opt.add(
+        "8", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "measure which injected faults each test detects, over N faults of each type\n", // Help description.
+        "--fault-coverage"
+    );
+
+    opt.add(
+        "0.05", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "flip probability per write pass of injected transient faults\n", // Help description.
+        "--fault-rate"
+    );
+
+    opt.add(
+        "0", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "failing test runs per GiB-hour at which --screen rejects a board\n", // Help description.
+        "--screen"
+    );
+
+    opt.add(
+        "4", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "ratio between the reject and accept rates of --screen\n", // Help description.
+        "--screen-ratio"
+    );
+
+    opt.add(
+        "0.95", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "confidence of the --screen decision\n", // Help description.
+        "--screen-confidence"
+    );
+
+    opt.add(
+        "64", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "size in MiB of the regions of the error heatmap\n", // Help description.
+        "--region-size"
+    );
+
+    opt.add(
+        "0", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "longest time in ms a kernel launch should take (0 for whole-region launches)\n", // Help description.
+        "--launch-limit"
+    );
+
+    opt.add(
+        "", // Default.
+        0, // Required?
+        0, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "recreate the device state after a hung or failed kernel and repeat the step\n", // Help description.
+        "--recover"
+    );
+
+    opt.add(
+        "10", // Default.
+        0, // Required?
+        1, // Number of args expected.
+        0, // Delimiter if expecting multiple args.
+        "multiple of its previous duration after which a kernel is taken for hung\n", // Help description.
+        "--hang-factor"
+    );
+
     opt.parse(argc, argv);
     std::string lastArg;
     if(opt.isSet("-p"))
@@ -213,8 +872,94 @@ int main(int argc,const char** argv) {
         opt.get("-g")->getInt(gpuID);
     if(opt.isSet("-l"))
         opt.get("-g")->getInt(showLicense);
+    if(opt.isSet("--simulate"))
+        simulate = true;
+    if(opt.isSet("--sim-bandwidth"))
+        opt.get("--sim-bandwidth")->getDouble(simParams.bandwidthMBps);
+    if(opt.isSet("--sim-latency"))
+        opt.get("--sim-latency")->getDouble(simParams.launchLatencyUs);
+    if(opt.isSet("--duration"))
+        opt.get("--duration")->getInt(durationSeconds);
+    if(opt.isSet("--budget"))
+        opt.get("--budget")->getDouble(budgetSeconds);
+    if(opt.isSet("--min-coverage"))
+        opt.get("--min-coverage")->getDouble(minCoverage);
+    if(opt.isSet("--history"))
+        opt.get("--history")->getString(historyFile);
+    if(opt.isSet("--checkpoint"))
+        opt.get("--checkpoint")->getString(checkpointFile);
+    if(opt.isSet("--checkpoint-interval"))
+        opt.get("--checkpoint-interval")->getInt(checkpointInterval);
+    if(opt.isSet("--resume"))
+        resume = true;
+    if(opt.isSet("--output"))
+        opt.get("--output")->getString(outputFile);
+    if(opt.isSet("--output-format"))
+        opt.get("--output-format")->getString(outputFormat);
+    if(opt.isSet("--event-log"))
+        opt.get("--event-log")->getString(eventLogFile);
+    if(opt.isSet("--event-log-records"))
+        opt.get("--event-log-records")->getInt(eventLogRecords);
+    if(opt.isSet("--trace"))
+        opt.get("--trace")->getString(traceFile);
+    if(opt.isSet("--metrics"))
+        opt.get("--metrics")->getString(metricsAddress);
+    if(opt.isSet("--daemon"))
+        daemonMode = true;
+    if(opt.isSet("--duty-cycle"))
+        opt.get("--duty-cycle")->getDouble(dutyCycle);
+    if(opt.isSet("--control"))
+        opt.get("--control")->getString(controlAddress);
+    if(opt.isSet("--scavenge"))
+        scavenge = daemonMode = true;
+    if(opt.isSet("--pressure-file"))
+        opt.get("--pressure-file")->getString(pressureFile);
+    if(opt.isSet("--release-target"))
+        opt.get("--release-target")->getInt(releaseTargetMs);
+    if(opt.isSet("--scavenge-chunk"))
+        opt.get("--scavenge-chunk")->getInt(scavengeChunkMB);
+    if(opt.isSet("--plan"))
+        opt.get("--plan")->getString(planFile);
+    if(opt.isSet("--tests"))
+        opt.get("--tests")->getString(testList);
+    if(opt.isSet("--skip"))
+        opt.get("--skip")->getString(skipList);
+    if(opt.isSet("--list-tests")) {
+        printf("%-14s %-40s %6s %7s\n","Key","Test","Steps","Passes");
+        for (int t = 0; t < memtestNTests; t++)
+            printf("%-14s %-40s %6u %7.0f\n",memtestTests[t].key,memtestTests[t].name,memtestTests[t].steps,memtestTests[t].passes);
+        return 0;
+    }
+    if(opt.isSet("--skip-self-test"))
+        runSelfTest = false;
+    if(opt.isSet("--fault-coverage"))
+        opt.get("--fault-coverage")->getInt(faultTrials);
+    if(opt.isSet("--fault-rate"))
+        opt.get("--fault-rate")->getDouble(coverageConfig.transientRate);
+    if(opt.isSet("--screen"))
+        opt.get("--screen")->getDouble(screenRate);
+    if(opt.isSet("--screen-ratio"))
+        opt.get("--screen-ratio")->getDouble(screenRatio);
+    if(opt.isSet("--screen-confidence"))
+        opt.get("--screen-confidence")->getDouble(screenConfidence);
+    if(opt.isSet("--region-size"))
+        opt.get("--region-size")->getInt(regionMB);
+    if(opt.isSet("--launch-limit"))
+        opt.get("--launch-limit")->getInt(launchLimitMs);
+    if(opt.isSet("--recover"))
+        recoverFaults = true;
+    if(opt.isSet("--hang-factor"))
+        opt.get("--hang-factor")->getDouble(hangFactor);
+    if(opt.isSet("--sim-hang")) {
+        int hangLaunch = 0;
+        opt.get("--sim-hang")->getInt(hangLaunch);
+        simParams.hangLaunch = (hangLaunch > 0) ? (uint)hangLaunch : 0;
+    }
     if(opt.lastArgs.size() == 0) {
         // do nothing, use default settings
+    } else if(opt.lastArgs.size() == 1 && (daemonMode || durationSeconds > 0 || screenRate > 0 || !planFile.empty())) {
+        // Runs that end on their own terms only need the amount of memory
+        sscanf(opt.lastArgs[0]->c_str(),"%u",&megsToTest);
     } else if(opt.lastArgs.size() == 2) {
         sscanf(opt.lastArgs[0]->c_str(),"%u",&megsToTest);
         sscanf(opt.lastArgs[1]->c_str(),"%u",&maxIters);
@@ -222,317 +967,675 @@ int main(int argc,const char** argv) {
         printf("Error: Bad argument for [MB GPU RAM to test] [# iters]");
     }
 
+    // The duration covers the whole run, including setup; an explicit
+    // iteration count still applies in duration mode
+    unsigned int runStart = getTimeMilliseconds();
+    if (durationSeconds > 0 && opt.lastArgs.size() != 2) maxIters = 0xFFFFFFFF;
+    // Screening runs until it reaches a decision
+    if (screenRate > 0 && opt.lastArgs.size() != 2) maxIters = 0xFFFFFFFF;
+    // A daemon runs until it is stopped
+    if (daemonMode && opt.lastArgs.size() != 2) maxIters = 0xFFFFFFFF;
+    if (!daemonMode && !controlAddress.empty()) {
+        printf("Error: --control requires --daemon\n");
+        exit(2);
+    }
+    if (!scavenge && (!pressureFile.empty() || opt.isSet("--release-target") || opt.isSet("--scavenge-chunk"))) {
+        printf("Error: --pressure-file, --release-target and --scavenge-chunk require --scavenge\n");
+        exit(2);
+    }
+    if (scavenge && (releaseTargetMs <= 0 || scavengeChunkMB < 2)) {
+        printf("Error: --release-target must be positive and --scavenge-chunk at least 2\n");
+        exit(2);
+    }
+    if (scavenge && resume) {
+        printf("Error: --scavenge runs cannot be resumed\n");
+        exit(2);
+    }
+    if (dutyCycle <= 0 || dutyCycle > 1) {
+        printf("Error: --duty-cycle must be greater than 0 and at most 1\n");
+        exit(2);
+    }
+    if ((opt.isSet("--screen-ratio") || opt.isSet("--screen-confidence")) && !opt.isSet("--screen")) {
+        printf("Error: --screen-ratio and --screen-confidence require --screen\n");
+        exit(2);
+    }
+    if (regionMB <= 0) {
+        printf("Error: --region-size must be positive\n");
+        exit(2);
+    }
+    if (launchLimitMs < 0) {
+        printf("Error: --launch-limit cannot be negative\n");
+        exit(2);
+    }
+    if (hangFactor <= 1) {
+        printf("Error: --hang-factor must be greater than 1\n");
+        exit(2);
+    }
+    if (eventLogRecords <= 0) {
+        printf("Error: --event-log-records must be positive\n");
+        exit(2);
+    }
+    if (opt.isSet("--screen") && (screenRate <= 0 || screenRatio <= 1 || screenConfidence <= 0.5 || screenConfidence >= 1)) {
+        printf("Error: --screen must be positive, --screen-ratio greater than 1 and --screen-confidence between 0.5 and 1\n");
+        exit(2);
+    }
+    if (screenRate > 0 && (daemonMode || !planFile.empty())) {
+        printf("Error: --screen cannot be combined with --daemon, --scavenge or --plan\n");
+        exit(2);
+    }
+    if (!planFile.empty()) {
+        // The plan replaces iterations, test selection and scheduling
+        if (resume || !checkpointFile.empty() || budgetSeconds > 0 || durationSeconds > 0 || daemonMode || opt.isSet("--tests") || opt.isSet("--skip")) {
+            printf("Error: --plan cannot be combined with --checkpoint, --resume, --budget, --duration, --daemon, --scavenge, --tests or --skip\n");
+            exit(2);
+        }
+        std::string error;
+        if (!plan.load(planFile.c_str(),error)) {
+            printf("Error: could not read test plan: %s\n",error.c_str());
+            exit(2);
+        }
+        selected.assign(memtestNTests,false);
+        for (size_t p = 0; p < plan.phases.size(); p++)
+            for (size_t e = 0; e < plan.phases[p].tests.size(); e++) selected[plan.phases[p].tests[e].test] = true;
+    }
+    if (opt.isSet("--tests") || opt.isSet("--skip")) {
+        if (resume) {
+            printf("Error: a resumed run keeps the tests it was started with\n");
+            exit(2);
+        }
+        std::string bad;
+        if (opt.isSet("--tests")) {
+            selected.assign(memtestNTests,false);
+            if (!parseTestList(testList,selected,bad)) {
+                printf("Error: unknown test %s in --tests; see --list-tests\n",bad.c_str());
+                exit(2);
+            }
+        }
+        vector<bool> skipped(memtestNTests,false);
+        if (opt.isSet("--skip") && !parseTestList(skipList,skipped,bad)) {
+            printf("Error: unknown test %s in --skip; see --list-tests\n",bad.c_str());
+            exit(2);
+        }
+        int n = 0;
+        for (int t = 0; t < memtestNTests; t++) {
+            if (skipped[t]) selected[t] = false;
+            if (selected[t]) n++;
+        }
+        if (n == 0) {
+            printf("Error: --tests and --skip leave no tests to run\n");
+            exit(2);
+        }
+    }
+
+    // A resumed run continues with the configuration it was started with
+    if (resume) {
+        if (checkpointFile.empty()) {
+            printf("Error: --resume requires --checkpoint FILE\n");
+            exit(2);
+        }
+        if (!run.load(checkpointFile.c_str())) {
+            printf("Error: could not read checkpoint from %s (missing, damaged, or from another version of MemtestCL)\n",checkpointFile.c_str());
+            exit(2);
+        }
+        simulate = run.simulate;
+        platID = run.platform;
+        gpuID = run.gpu;
+        megsToTest = run.megs;
+        maxIters = run.maxIters;
+        durationSeconds = run.durationSeconds;
+        budgetSeconds = run.budgetSeconds;
+        for (int t = 0; t < memtestNTests; t++) selected[t] = !run.tests[t].skipped;
+        runStart -= (unsigned int)run.elapsedMs;
+    }
+
     if (showLicense) print_licensing();
 
-    cl_context ctx;
+    memtestOutputFormat format = OUTPUT_JSONL;
+    if (outputFormat == "csv" || (outputFormat.empty() && outputFile.size() > 4 && outputFile.compare(outputFile.size()-4,4,".csv") == 0)) {
+        format = OUTPUT_CSV;
+    } else if (!outputFormat.empty() && outputFormat != "jsonl") {
+        printf("Error: unknown output format %s\n",outputFormat.c_str());
+        exit(2);
+    }
+
+    cl_context ctx = NULL;
     cl_device_id dev;
     cl_platform_id plat;
     char devname[256];
-    initialize_CL(plat,ctx,dev,gpuID,platID);
-    clGetDeviceInfo(dev,CL_DEVICE_NAME,256,devname,NULL);
+    memtestMultiTester* tester;
+    unsigned int start,end;
+    if (simulate) {
+        strcpy(devname,"Simulated device");
+        gpuID = 0;
+    } else {
+        initialize_CL(plat,ctx,dev,gpuID,platID);
+        clGetDeviceInfo(dev,CL_DEVICE_NAME,256,devname,NULL);
+    }
+
+    if (resume && run.device != devname) {
+        printf("Error: checkpoint %s was taken on device %s, not %s\n",checkpointFile.c_str(),run.device.c_str(),devname);
+        exit(2);
+    }
+
+    if (faultTrials > 0) {
+        memtestCoverageMatrix coverage;
+        coverageConfig.trials = faultTrials;
+        printf("Measuring fault coverage with %d faults of each type over %u MiB of memory on device %d: %s\n\n",faultTrials,coverageConfig.megs,gpuID,devname);
+        memtestBackend* backend;
+        if (simulate) backend = new memtestSimBackend(simParams);
+        else backend = new memtestCLBackend(ctx,dev);
+        bool ok = measureFaultCoverage(backend,coverageConfig,coverage);
+        if (ctx) clReleaseContext(ctx);
+        if (!ok) {
+            printf("Error: could not execute fault coverage tests\n");
+            return 1;
+        }
+        printCoverageMatrix(stdout,coverage);
+        return 0;
+    }
 
-    memtestMultiTester tester(ctx,dev);
-    //memtestMultiContextTester tester(plat,dev);
-    if (!tester.allocate(megsToTest)) {
+    if (simulate) {
+        tester = new memtestSimMultiTester(simParams);
+    } else {
+        tester = new memtestMultiTester(ctx,dev);
+        //tester = new memtestMultiContextTester(plat,dev);
+    }
+    tester->setRegionSize(regionMB);
+    // Compile only the kernels of the tests that will run
+    uint families = 0;
+    for (int t = 0; t < memtestNTests; t++) {
+        if (selected[t]) families |= memtestTests[t].families;
+    }
+    tester->setKernelFamilies(families);
+    // Daemon mode paces the test steps and frees memory when other work needs it
+    memtestDaemon* daemon = NULL;
+    memtestScavenger* scavenger = NULL;
+    if (daemonMode) {
+        daemon = new memtestDaemon(dutyCycle);
+        daemonState = daemon;
+        #ifdef SIGUSR1
+        signal(SIGUSR1,requestRelease);
+        signal(SIGUSR2,requestResume);
+        #endif
+    }
+    if (scavenge) {
+        // Take memory only once it is free, one chunk at a time
+        scavenger = new memtestScavenger(*daemon,scavengeChunkMB,opt.lastArgs.empty() ? 0 : megsToTest,releaseTargetMs);
+        if (!pressureFile.empty() && !scavenger->watchFile(pressureFile)) {
+            printf("Error: could not watch pressure file %s\n",pressureFile.c_str());
+            exit(2);
+        }
+        signal(SIGINT,requestStop);
+        signal(SIGTERM,requestStop);
+        if (!scavenger->grow(*tester)) printf("Waiting for free device memory...\n");
+        while (!tester->isAllocated() && !daemon->stopRequested()) {
+            if (!scavenger->growFirst(*tester)) daemon->waitWhileReleased();
+        }
+        if (!tester->isAllocated()) {
+            printf("Stopped before any device memory was free\n");
+            delete scavenger;
+            daemonState = NULL;
+            delete daemon;
+            delete tester;
+            if (ctx) clReleaseContext(ctx);
+            return 0;
+        }
+        tester->setInterrupt(scavenger);
+        tester->addListener(scavenger);
+        printf("Scavenging free memory on device %d: %s, from %u MiB in chunks of up to %d MiB\n\n",gpuID,devname,tester->size(),scavengeChunkMB);
+    } else if (!tester->allocate(megsToTest)) {
         printf("Error: unable to allocate %u MiB of memory to test, bailing!\n",megsToTest);
         exit(2);
+    } else if (resume) {
+        printf("Resuming run of %u iterations of tests over %u MB of memory on device %d: %s\n\n",maxIters,tester->size(),gpuID,devname);
     } else {
-        printf("Running %u iterations of tests over %u MB of memory on device %d: %s\n\n",maxIters,tester.size(),gpuID,devname);
+        if (!planFile.empty())
+            printf("Running plan %s (%u phases) over %u MB of memory on device %d: %s\n\n",planFile.c_str(),(uint)plan.phases.size(),tester->size(),gpuID,devname);
+        else if (durationSeconds > 0)
+            printf("Running tests for %d seconds over %u MB of memory on device %d: %s\n\n",durationSeconds,tester->size(),gpuID,devname);
+        else
+            printf("Running %u iterations of tests over %u MB of memory on device %d: %s\n\n",maxIters,tester->size(),gpuID,devname);
+    }
+
+    // Keep each launch under the display watchdog; also applies to chunks added later
+    if (launchLimitMs > 0 && !tester->setLaunchLimit(launchLimitMs)) {
+        printf("Warning: kernel launches cannot be split on this device; ignoring --launch-limit\n\n");
+    }
+    if (recoverFaults) tester->setHangFactor(hangFactor);
+
+    // Make sure the verify kernels actually detect errors on this device and driver
+    if (runSelfTest) {
+        std::string failure;
+        start=getTimeMilliseconds();
+        if (!tester->selfTest(failure)) {
+            printf("Error: detection self-test failed: %s\n",failure.c_str());
+            printf("Results of this device cannot be trusted, bailing!\n");
+            delete tester;
+            if (ctx) clReleaseContext(ctx);
+            exit(3);
+        }
+        end=getTimeMilliseconds();
+        printf("Detection self-test passed (%u ms)\n\n",end-start);
     }
 
     // Run bandwidth test
     const unsigned bw_iters = 20;
-    printf("Running memory bandwidth test over %u iterations of %u MB transfers...\n",bw_iters,tester.max_bandwidth_size());
+    printf("Running memory bandwidth test over %u iterations of %u MB transfers...\n",bw_iters,tester->max_bandwidth_size());
     double bandwidth;
-    if (!tester.gpuMemoryBandwidth(bandwidth,tester.max_bandwidth_size(),bw_iters)) {
+    if (!tester->gpuMemoryBandwidth(bandwidth,tester->max_bandwidth_size(),bw_iters)) {
         printf("\tTest failed!\n");
         bandwidth = 0;
     } else {
         printf("\tEstimated bandwidth %.02f MB/s\n\n",bandwidth);
     }
 
-    uint accumulatedErrors = 0,iterErrors;
-    uint errorCounts[15];
-    unsigned short iterErrorCounts[13];
-    memset(errorCounts,0,15*sizeof(uint));
-    memset(iterErrorCounts,0,13*sizeof(unsigned short));
+    // Run counters live in the checkpoint, so that they can be saved at any time
+    if (!resume) {
+        run.device = devname;
+        run.simulate = simulate;
+        run.platform = platID;
+        run.gpu = gpuID;
+        run.megs = tester->size();
+        run.maxIters = maxIters;
+        run.durationSeconds = durationSeconds;
+        run.budgetSeconds = budgetSeconds;
+        run.tests.resize(memtestNTests);
+        for (int t = 0; t < memtestNTests; t++) run.tests[t].skipped = !selected[t];
+    }
+    unsigned long long& accumulatedErrors = run.accumulatedErrors;
+    unsigned long long& itersfailed = run.itersFailed;
+    // Rates since this process started; the counters above include resumed runs
+    memtestStats stats(memtestNTests);
+    memtestScreen* screen = NULL;
+    memtestScreenDecision screenDecision = SCREEN_UNDECIDED;
+    if (screenRate > 0) {
+        screen = new memtestScreen(screenRate,screenRatio,screenConfidence);
+        printf("Screening: reject at %.3g failing test runs per GiB-hour, accept at %.3g, with %.0f%% confidence\n",
+               screen->getRejectRate(),screen->getAcceptRate(),screenConfidence*100);
+        printf("           (a clean board is accepted after %.3g GiB-hours of testing)\n\n",screen->cleanExposure());
+    }
+    double maxStepMs = 0;
+    bool deadlineReached = false;
+    bool interrupted = false;
    
-    unsigned int start,end;
     uint iter;
-    const char* test;
-	bool status;
-    bool thisIterFailed;
-    int itersfailed = 0;
-    const char *testnames[] = {"Moving inversions (ones and zeros)",
-                               "Memtest86 walking 8-bit",
-                               "True walking zeros (8-bit)",
-                               "True walking ones (8-bit)",
-                               "Moving inversions (random)",
-                               "True walking zeros (32-bit)",
-                               "True walking ones (32-bit)",
-                               "Random blocks",
-                               "Memtest86 Modulo-20",
-                               "Integer logic",
-                               "Integer logic (4 loops)",
-                               "Integer logic (local memory)",
-                               "Integer logic (4 loops, local memory)"};
-                            
-    for (iter = 0; iter < maxIters ; iter++) {  //{{{
-        thisIterFailed = false;
-        printf("Test iteration %u on %d MiB of memory on device %d (%s): %u errors so far\n",iter+1,tester.size(),gpuID,devname,accumulatedErrors);
-        uint errorCount;
-        
-        // Moving inversions, 1's and 0's {{{
-        errorCount = 0;
-        test = "Moving Inversions (ones and zeros)";
-        start=getTimeMilliseconds();
-        status = tester.gpuMovingInversionsOnesZeros(errorCount);
-        if (!status) {
-            printf("Could not execute test %s; quitting\n",test);
-            goto loopend;
+	bool status = true;
+    bool thisIterFailed = false;
+
+    // The scheduler decides the order of the tests and how much of each to run
+    memtestScheduler* scheduler = NULL;
+    std::string historyPath;
+    if (budgetSeconds > 0 || !historyFile.empty()) {
+        vector<const char*> testnames(memtestNTests);
+        vector<uint> teststeps(memtestNTests);
+        for (int t = 0; t < memtestNTests; t++) {
+            testnames[t] = memtestTests[t].name;
+            teststeps[t] = memtestTests[t].steps;
         }
-        accumulatedErrors += errorCount;
-        end=getTimeMilliseconds();
-        errorCounts[0] += errorCount;
-        iterErrorCounts[0] += (errorCount) ? 1 : 0;
-        thisIterFailed = thisIterFailed || errorCount;
-        printf("\t%s: %u errors (%u ms)\n",test,errorCount,end-start);
-        // }}}
-        // Moving inversions, random {{{
-        errorCount = 0;
-        test = "Moving Inversions (random)";
-        start=getTimeMilliseconds();
-        status = tester.gpuMovingInversionsRandom(errorCount);
-        if (!status) {
-            printf("Could not execute test %s; quitting\n",test);
-            goto loopend;
+        scheduler = new memtestScheduler(devname,memtestNTests,&testnames[0],&teststeps[0]);
+        scheduler->setMinCoverage(minCoverage);
+        for (int t = 0; t < memtestNTests; t++) {
+            scheduler->setCostEstimate(t,memtestTests[t].passes);
+            scheduler->setEnabled(t,selected[t]);
         }
-        accumulatedErrors += errorCount;
-        end=getTimeMilliseconds();
-        errorCounts[4] += errorCount;
-        iterErrorCounts[4] += (errorCount) ? 1 : 0;
-        thisIterFailed = thisIterFailed || errorCount;
-        printf("\t%s: %u errors (%u ms)\n",test,errorCount,end-start);
-        // }}}
-        // Memtest86 walking 8-bit {{{
-        errorCount = 0;
-        test = "Memtest86 Walking 8-bit";
-        start=getTimeMilliseconds();
-        for (uint shift=0;shift<8;shift++){
-            status = tester.gpuWalking8BitM86(iterErrors,shift);
-            if (!status) {
-                printf("Could not execute test %s; quitting\n",test);
-                goto loopend;
+        historyPath = historyFile.empty() ? defaultHistoryPath() : historyFile;
+        if (!scheduler->load(historyPath.c_str()))
+            printf("Warning: could not read test history from %s\n",historyPath.c_str());
+        if (resume) {
+            for (int t = 0; t < memtestNTests; t++) {
+                scheduler->setNextStep(t,run.tests[t].nextStep);
+                if (run.tests[t].history.steps > 0) scheduler->setHistory(t,run.tests[t].history);
             }
-            errorCount += iterErrors;
         }
-        end=getTimeMilliseconds();
-        accumulatedErrors+=errorCount;
-        errorCounts[1] += errorCount;
-        iterErrorCounts[1] += (errorCount) ? 1 : 0;
-        thisIterFailed = thisIterFailed || errorCount;
-        printf("\t%s: %u errors (%u ms)\n",test,errorCount,end-start);
-        // }}}
-        // True Walking zeros, 8-bit {{{
-        errorCount = 0;
-        test = "True Walking zeros (8-bit)";
-        start=getTimeMilliseconds();
-        for (uint shift=0;shift<8;shift++){
-            status = tester.gpuWalking8Bit(iterErrors,false,shift);
-            if (!status) {
-                printf("Could not execute test %s; quitting\n",test);
-                goto loopend;
-            }
-            errorCount += iterErrors;
+    }
+    vector<memtestScheduledTest> schedule;
+    unsigned int lastCheckpoint = getTimeMilliseconds();
+    bool resuming = resume;
+
+    // Structured records of every test on every chunk, written in the background
+    memtestBackgroundWriter* writer = NULL;
+    memtestResultSink* sink = NULL;
+    if (!outputFile.empty()) {
+        writer = new memtestBackgroundWriter(outputFile.c_str());
+        if (!writer->isOpen()) {
+            printf("Error: could not open output file %s\n",outputFile.c_str());
+            exit(2);
         }
-        end=getTimeMilliseconds();
-        accumulatedErrors+=errorCount;
-        errorCounts[2] += errorCount;
-        iterErrorCounts[2] += (errorCount) ? 1 : 0;
-        thisIterFailed = thisIterFailed || errorCount;
-        printf("\t%s: %u errors (%u ms)\n",test,errorCount,end-start);
-        // }}}
-        // True Walking ones, 8-bit {{{
-        errorCount = 0;
-        test = "True Walking ones (8-bit)";
-        start=getTimeMilliseconds();
-        for (uint shift=0;shift<8;shift++){
-            status = tester.gpuWalking8Bit(iterErrors,true,shift);
-            if (!status) {
-                printf("Could not execute test %s; quitting\n",test);
-                goto loopend;
-            }
-            errorCount += iterErrors;
+        sink = new memtestResultSink(*writer,format,devname);
+        sink->runStarted(tester->size(),tester->chunks());
+        tester->addListener(sink);
+    }
+
+    // Every kernel launch and completion, in a file that outlives a crash of the process
+    memtestEventLog* eventLog = NULL;
+    if (!eventLogFile.empty()) {
+        eventLog = new memtestEventLog();
+        if (!eventLog->open(eventLogFile.c_str(),eventLogRecords,devname)) {
+            printf("Error: could not create event log %s\n",eventLogFile.c_str());
+            exit(2);
         }
-        end=getTimeMilliseconds();
-        accumulatedErrors+=errorCount;
-        errorCounts[3] += errorCount;
-        iterErrorCounts[3] += (errorCount) ? 1 : 0;
-        thisIterFailed = thisIterFailed || errorCount;
-        printf("\t%s: %u errors (%u ms)\n",test,errorCount,end-start);
-        // }}}
-        // Walking zeros, 32-bit {{{
-        errorCount = 0;
-        test ="Memtest86 Walking zeros (32-bit)";
-        start=getTimeMilliseconds();
-        for (uint shift=0;shift<32;shift++){
-            status = tester.gpuWalking32Bit(iterErrors,false,shift);
-            if (!status) {
-                printf("Could not execute test %s; quitting\n",test);
-                goto loopend;
-            }
-            errorCount += iterErrors;
+        eventLog->runStarted(tester->size(),tester->chunks());
+        tester->setEventLog(eventLog);
+        tester->addListener(eventLog);
+    }
+
+    // Timeline of every queue operation, kept in memory and written at the end
+    memtestTrace* trace = NULL;
+    if (!traceFile.empty()) {
+        trace = new memtestTrace();
+        tester->setTrace(trace);
+        tester->addListener(trace);
+    }
+
+    // Live counters, scraped over HTTP while the run progresses
+    memtestMetrics* metrics = NULL;
+    memtestMetricsServer* metricsServer = NULL;
+    if (!metricsAddress.empty()) {
+        vector<const char*> testnames(memtestNTests);
+        for (int t = 0; t < memtestNTests; t++) testnames[t] = memtestTests[t].name;
+        metrics = new memtestMetrics(devname,memtestNTests,&testnames[0]);
+        metrics->setAllocated(tester->size());
+        metrics->setBandwidth(bandwidth*1e6);
+        metricsServer = new memtestMetricsServer(*metrics);
+        std::string error;
+        if (!metricsServer->start(metricsAddress,error)) {
+            printf("Error: could not serve metrics: %s\n",error.c_str());
+            exit(2);
         }
-        end=getTimeMilliseconds();
-        accumulatedErrors+=errorCount;
-        errorCounts[5] += errorCount;
-        iterErrorCounts[5] += (errorCount) ? 1 : 0;
-        thisIterFailed = thisIterFailed || errorCount;
-        printf("\t%s: %u errors (%u ms)\n",test,errorCount,end-start);
-        // }}}
-        // Walking ones, 32-bit {{{
-        errorCount = 0;
-        test ="Memtest86 Walking ones (32-bit)";
-        start=getTimeMilliseconds();
-        for (uint shift=0;shift<32;shift++){
-            status = tester.gpuWalking32Bit(iterErrors,true,shift);
-            if (!status) {
-                printf("Could not execute test %s; quitting\n",test);
-                goto loopend;
+        tester->addListener(metrics);
+    }
+    memtestDaemonControl* control = NULL;
+    if (daemonMode) {
+        if (!controlAddress.empty()) {
+            control = new memtestDaemonControl(*daemon);
+            std::string error;
+            if (!control->start(controlAddress,error)) {
+                printf("Error: could not open control socket: %s\n",error.c_str());
+                exit(2);
             }
-            errorCount += iterErrors;
         }
-        end=getTimeMilliseconds();
-        accumulatedErrors+=errorCount;
-        errorCounts[6] += errorCount;
-        iterErrorCounts[6] += (errorCount) ? 1 : 0;
-        thisIterFailed = thisIterFailed || errorCount;
-        printf("\t%s: %u errors (%u ms)\n",test,errorCount,end-start);
-        // }}}
-        // Random blocks {{{
-        errorCount = 0;
-        test="Random blocks";
-        start=getTimeMilliseconds();
-        status = tester.gpuRandomBlocks(errorCount,rand());
-        if (!status) {
-            printf("Could not execute test %s; quitting\n",test);
-            goto loopend;
-        }
-        accumulatedErrors += errorCount;
-        errorCounts[7] += errorCount;
-        iterErrorCounts[7] += (errorCount) ? 1 : 0;
-        end=getTimeMilliseconds();
-        thisIterFailed = thisIterFailed || errorCount;
-        printf("\t%s: %u errors (%u ms)\n",test,errorCount,end-start);
-        // }}}
-        // Modulo-20, 32-bit {{{
-        errorCount = 0;
-        test ="Memtest86 Modulo-20";
-        start=getTimeMilliseconds();
-        for (uint shift=0;shift<20;shift++){
-            status = tester.gpuModuloX(iterErrors,shift,rand(),20,2);
-            if (!status) {
-                printf("Could not execute test %s; quitting\n",test);
-                goto loopend;
+        printf("Running as a daemon at a duty cycle of %.1f%%\n\n",dutyCycle*100);
+        if (sink) sink->daemonState("running",tester->size());
+    }
+    unsigned int iterStart = getTimeMilliseconds();
+    unsigned long long iterStartErrors = accumulatedErrors;
+
+    signal(SIGINT,requestStop);
+    signal(SIGTERM,requestStop);
+
+    if (!plan.phases.empty()) {
+        status = runPlan(plan,tester,run,stats,sink,metrics,eventLog,trace,iter);
+        interrupted = (stopRequested != 0);
+        goto loopend;
+    }
+                            
+    for (iter = run.iter; iter < maxIters && !deadlineReached && !stopRequested && screenDecision == SCREEN_UNDECIDED; iter++) {  //{{{
+        size_t firstEntry = 0;
+        iterStart = getTimeMilliseconds();
+        iterStartErrors = accumulatedErrors;
+        if (eventLog) eventLog->setIteration(iter);
+        if (resuming) {
+            // Continue the interrupted iteration with its original plan
+            printf("Resuming test iteration %u on %d MiB of memory on device %d (%s): %llu errors so far\n",iter+1,tester->size(),gpuID,devname,accumulatedErrors);
+            schedule = run.schedule;
+            thisIterFailed = run.iterFailed;
+            firstEntry = run.position;
+        } else {
+            printf("Test iteration %u on %d MiB of memory on device %d (%s): %llu errors so far\n",iter+1,tester->size(),gpuID,devname,accumulatedErrors);
+            thisIterFailed = false;
+            if (scheduler) {
+                scheduler->plan(budgetSeconds*1000.0,tester->tested()/1024.0,schedule);
+            } else {
+                schedule.clear();
+                for (int t = 0; t < memtestNTests; t++) {
+                    if (!selected[t]) continue;
+                    memtestScheduledTest entry;
+                    entry.test = t;
+                    entry.firstStep = 0;
+                    entry.nSteps = memtestTests[t].steps;
+                    schedule.push_back(entry);
+                }
             }
-            errorCount += iterErrors;
-        }
-        end=getTimeMilliseconds();
-        accumulatedErrors+=errorCount;
-        errorCounts[8] += errorCount;
-        iterErrorCounts[8] += (errorCount) ? 1 : 0;
-        thisIterFailed = thisIterFailed || errorCount;
-        printf("\t%s: %u errors (%u ms)\n",test,errorCount,end-start);
-        // }}}
-        // Logic, 1 iteration {{{
-        errorCount = 0;
-        test = "Logic (one iteration)";
-        start=getTimeMilliseconds();
-        status = tester.gpuShortLCG0(errorCount,1);
-        if (!status) {
-            printf("Could not execute test %s; quitting\n",test);
-            goto loopend;
         }
-        end=getTimeMilliseconds();
-        accumulatedErrors += errorCount;
-        errorCounts[9] += errorCount;
-        iterErrorCounts[9] += (errorCount) ? 1 : 0;
-        thisIterFailed = thisIterFailed || errorCount;
-        printf("\t%s: %u errors (%u ms)\n",test,errorCount,end-start);
-        // }}}
-        // Logic, 4 iterations {{{
-        errorCount = 0;
-        test = "Logic (4 iterations)";
-        start=getTimeMilliseconds();
-        status = tester.gpuShortLCG0(errorCount,4);
-        if (!status) {
-            printf("Could not execute test %s; quitting\n",test);
-            goto loopend;
+
+        if (trace) {
+            // The steps of each test this iteration will run, as decided up front
+            for (size_t s = firstEntry; s < schedule.size(); s++) {
+                char args[64];
+                sprintf(args,"\"first_step\": %u, \"steps\": %u",schedule[s].firstStep,schedule[s].nSteps);
+                trace->hostInstant("schedule",memtestTests[schedule[s].test].name,args);
+            }
         }
-        end=getTimeMilliseconds();
-        accumulatedErrors += errorCount;
-        errorCounts[10] += errorCount;
-        iterErrorCounts[10] += (errorCount) ? 1 : 0;
-        thisIterFailed = thisIterFailed || errorCount;
-        printf("\t%s: %u errors (%u ms)\n",test,errorCount,end-start);
-        // }}}
-       // Logic, shared-memory, 1 iteration {{{
-        errorCount = 0;
-        test = "Logic (local memory, one iteration)";
-        start=getTimeMilliseconds();
-        status = tester.gpuShortLCG0Shmem(errorCount,1);
-        if (!status) {
-            printf("Could not execute test %s; quitting\n",test);
-            goto loopend;
+        for (size_t s = firstEntry; s < schedule.size(); s++) {
+            const int t = schedule[s].test;
+            const uint steps = memtestTests[t].steps;
+            uint errorCount = 0,stepErrors,i = 0;
+            start=getTimeMilliseconds();
+            if (resuming) {
+                // The steps run before the interruption count with the time they took
+                errorCount = run.partialErrors;
+                i = run.step;
+                start -= (unsigned int)run.partialMs;
+                resuming = false;
+            }
+            for (; i < schedule[s].nSteps && !stopRequested; i++) {
+                if (durationSeconds > 0) {
+                    // Estimate the step from this run, else from history, else from the slowest step so far
+                    double estimate = maxStepMs;
+                    if (run.tests[t].stepsRun > 0) {
+                        estimate = run.tests[t].ms/run.tests[t].stepsRun;
+                    } else if (scheduler && scheduler->getHistory(t).gbSteps > 0) {
+                        const memtestTestHistory& h = scheduler->getHistory(t);
+                        estimate = h.ms/h.gbSteps*(tester->tested()/1024.0);
+                    }
+                    const unsigned int elapsed = getTimeMilliseconds()-runStart;
+                    if (elapsed + estimate > durationSeconds*1000.0) {
+                        if (trace) trace->hostInstant("schedule","deadline",std::string("\"skipped\": ")+jsonQuote(memtestTests[t].name));
+                        deadlineReached = true;
+                        break;
+                    }
+                }
+                const uint step = (schedule[s].firstStep+i)%steps;
+                if (sink) sink->setContext(iter,t,memtestTests[t].name,step);
+                if (metrics) metrics->setTest(t);
+                const unsigned int stepStart = getTimeMilliseconds();
+                // Seeding every step from its position makes resumed runs repeat the same patterns
+                status = runStep(tester,t,step,stepSeed(iter,t,step),stepErrors);
+                if (!status) {
+                    printf("Could not execute test %s; quitting\n",memtestTests[t].name);
+                    goto loopend;
+                }
+                const unsigned int stepMs = getTimeMilliseconds()-stepStart;
+                run.tests[t].stepsRun++;
+                run.tests[t].ms += stepMs;
+                if (stepMs > maxStepMs) maxStepMs = stepMs;
+                errorCount += stepErrors;
+                if (daemon) {
+                    daemon->sliceDone(stepMs,stepErrors);
+                    if (daemon->releaseRequested()) {
+                        if (scavenger) releaseScavenged(tester,*scavenger,*daemon,sink,metrics);
+                        else releaseDevice(tester,megsToTest,*daemon,sink,metrics);
+                    } else if (scavenger && scavenger->grow(*tester)) {
+                        printf("\tScavenged a chunk; now testing %u MiB\n",tester->size());
+                        if (sink) sink->daemonState("running",tester->size());
+                        if (metrics) metrics->setAllocated(tester->size());
+                    }
+                    if (daemon->stopRequested()) stopRequested = 1;
+                }
+                if (!checkpointFile.empty() && getTimeMilliseconds()-lastCheckpoint >= checkpointInterval*1000u) {
+                    saveCheckpoint(checkpointFile,run,scheduler,schedule,iter,s,i+1,errorCount,getTimeMilliseconds()-start,thisIterFailed || errorCount,runStart);
+                    lastCheckpoint = getTimeMilliseconds();
+                }
+            }
+            end=getTimeMilliseconds();
+            if (stopRequested) {
+                // The checkpoint resumes this test at its next step; the summary below includes it
+                interrupted = true;
+                if (!checkpointFile.empty())
+                    saveCheckpoint(checkpointFile,run,scheduler,schedule,iter,s,i,errorCount,end-start,thisIterFailed || errorCount,runStart);
+            }
+            if (i == 0) {
+                if (interrupted) break;
+                printf("\t%s: skipped, would not finish before the deadline\n",memtestTests[t].name);
+                continue;
+            }
+            stats.record(t,errorCount,tester->tested()/1024.0,end-start,end);
+            accumulatedErrors += errorCount;
+            run.tests[t].errorCount += errorCount;
+            run.tests[t].failedIters += (errorCount) ? 1 : 0;
+            thisIterFailed = thisIterFailed || errorCount;
+            if (scheduler) scheduler->record(t,i,tester->tested()/1024.0,end-start,errorCount);
+            if (i < steps)
+                printf("\t%s: %u errors (%u ms, %u of %u steps)\n",memtestTests[t].name,errorCount,end-start,i,steps);
+            else
+                printf("\t%s: %u errors (%u ms)\n",memtestTests[t].name,errorCount,end-start);
+            if (interrupted) break;
+            if (screen && (screenDecision = screen->decide(stats.overall())) != SCREEN_UNDECIDED) break;
         }
-        end=getTimeMilliseconds();
-        accumulatedErrors += errorCount;
-        errorCounts[11] += errorCount;
-        iterErrorCounts[11] += (errorCount) ? 1 : 0;
-        thisIterFailed = thisIterFailed || errorCount;
-        printf("\t%s: %u errors (%u ms)\n",test,errorCount,end-start);
-        // }}}
-        // Logic, shared-memory, 4 iterations {{{
-        errorCount = 0;
-        test = "Logic (local memory, 4 iterations)";
-        start=getTimeMilliseconds();
-        status = tester.gpuShortLCG0Shmem(errorCount,4);
-        if (!status) {
-            printf("Could not execute test %s; quitting\n",test);
+        
+        if (interrupted) {
+            if (thisIterFailed) itersfailed++;
+            printf("\nInterrupted during iteration %u\n",iter+1);
             goto loopend;
         }
-        end=getTimeMilliseconds();
-        accumulatedErrors += errorCount;
-        errorCounts[12] += errorCount;
-        iterErrorCounts[12] += (errorCount) ? 1 : 0;
-        thisIterFailed = thisIterFailed || errorCount;
-        printf("\t%s: %u errors (%u ms)\n",test,errorCount,end-start);
-        // }}}
-        
         if (thisIterFailed) itersfailed++;
+        if (sink) sink->iterationDone(iter,accumulatedErrors-iterStartErrors,thisIterFailed,getTimeMilliseconds()-iterStart);
+        if (eventLog) eventLog->iterationDone(accumulatedErrors-iterStartErrors,getTimeMilliseconds()-iterStart);
+        if (metrics) metrics->iterationDone(thisIterFailed);
         printf("\n");
     } //}}}
     loopend:
-    clReleaseContext(ctx);
+    if (status && !interrupted && !checkpointFile.empty())
+        saveCheckpoint(checkpointFile,run,scheduler,schedule,iter,0,0,0,0,false,runStart);
+    if (scheduler) {
+        if (!scheduler->save(historyPath.c_str()))
+            printf("Warning: could not save test history to %s\n",historyPath.c_str());
+        delete scheduler;
+    }
+    if (sink) {
+        tester->removeListener(sink);
+        for (int t = 0; t < memtestNTests; t++)
+            if (selected[t]) sink->testSummary(t,memtestTests[t].name,run.tests[t].errorCount,run.tests[t].failedIters,run.tests[t].stepsRun);
+        for (int t = 0; t < memtestNTests; t++)
+            if (stats.test(t).runCount() > 0) sink->testStatistics(t,memtestTests[t].name,stats.test(t));
+        if (stats.overall().runCount() > 0) sink->testStatistics(-1,"All tests",stats.overall());
+        if (screen) sink->screenDecision(*screen,screenDecision,stats.overall());
+        vector<vector<unsigned long long> > heatmap;
+        tester->getRegionErrors(heatmap);
+        for (size_t c = 0; c < heatmap.size(); c++) {
+            for (size_t r = 0; r < heatmap[c].size(); r++)
+                if (heatmap[c][r]) sink->regionErrors((uint)c,(uint)r,tester->getRegionSize(),heatmap[c][r]);
+        }
+        sink->summary(iter,accumulatedErrors,itersfailed,status && !interrupted);
+        delete sink;
+        writer->close();
+        if (!writer->ok()) printf("Warning: could not write all records to %s\n",outputFile.c_str());
+        delete writer;
+    }
+    if (scavenger) {
+        printf("Scavenger: %s\n",scavenger->status().c_str());
+        tester->setInterrupt(NULL);
+        tester->removeListener(scavenger);
+        delete scavenger;
+    }
+    if (daemon) {
+        if (control) {
+            control->stop();
+            delete control;
+        }
+        daemonState = NULL;
+        delete daemon;
+    }
+    if (metrics) {
+        metricsServer->stop();
+        delete metricsServer;
+        tester->removeListener(metrics);
+        delete metrics;
+    }
+    if (eventLog) {
+        tester->setEventLog(NULL);
+        tester->removeListener(eventLog);
+        delete eventLog;
+    }
+    if (trace) {
+        tester->setTrace(NULL);
+        tester->removeListener(trace);
+        if (!trace->write(traceFile.c_str())) printf("Error: could not write trace %s\n",traceFile.c_str());
+        delete trace;
+    }
+    // What the summary reports of the tester, which goes first
+    const uint testedSize = tester->size();
+    const unsigned long long deviceFaults = tester->deviceFaults();
+    unsigned long long lanes[MT_BIT_LANES], laneTotal = 0;
+    if (itersfailed && tester->hasBitErrors() && tester->getBitErrors(lanes)) {
+        for (int b = 0; b < MT_BIT_LANES; b++) laneTotal += lanes[b];
+    }
+    vector<vector<unsigned long long> > heatmap;
+    if (itersfailed) tester->getRegionErrors(heatmap);
+    const uint heatmapRegionMB = tester->getRegionSize();
+    delete tester;
+    if (ctx) clReleaseContext(ctx);
     if (!status) { // One of the tests failed
+        delete screen;
         return 1;
     } else {
         printf("Test summary:\n");
         printf("-----------------------------------------\n");
-        printf("%u iterations over %u MiB of memory on device %s\n",iter,tester.size(),devname);
-        for (int i = 0; i < 13; i++) {
-            printf("%40s: %d failed iterations\n",testnames[i],iterErrorCounts[i]);
-	    printf("                                         (%d total incorrect bits)\n",errorCounts[i]);
+        if (durationSeconds > 0) {
+            // Iterations may have been cut short, so report how much of each test actually ran
+            printf("%u seconds over %u MiB of memory on device %s\n",(getTimeMilliseconds()-runStart)/1000,testedSize,devname);
+            for (int i = 0; i < memtestNTests; i++) {
+                if (!selected[i]) continue;
+                printf("%40s: %.2f GB-passes, %llu failed iterations\n",memtestTests[i].name,testedSize/1024.0*run.tests[i].stepsRun/memtestTests[i].steps,run.tests[i].failedIters);
+	        printf("                                         (%llu total incorrect bits)\n",run.tests[i].errorCount);
+            }
+        } else {
+            if (!plan.phases.empty())
+                printf("%u passes of plan %s over up to %u MiB of memory on device %s\n",iter,planFile.c_str(),testedSize,devname);
+            else
+                printf("%u iterations over %u MiB of memory on device %s\n",iter,testedSize,devname);
+            for (int i = 0; i < memtestNTests; i++) {
+                if (!selected[i]) continue;
+                printf("%40s: %llu failed iterations\n",memtestTests[i].name,run.tests[i].failedIters);
+	        printf("                                         (%llu total incorrect bits)\n",run.tests[i].errorCount);
+            }
         }
         if (itersfailed)
-            printf("Final error count: %d test iterations with at least one error; %u errors total\n",itersfailed,accumulatedErrors);
+            printf("Final error count: %llu test iterations with at least one error; %llu errors total\n",itersfailed,accumulatedErrors);
         else
             printf("Final error count: 0 errors\n");
-        if (isatty(fileno(stdout))) {
+        if (deviceFaults > 0)
+            printf("Device faults recovered: %llu\n",deviceFaults);
+        if (laneTotal > 0) {
+            // Errors concentrated in one lane point at a stuck data line or a bad DQ pin
+            printf("Incorrect bits by bit lane%s:\n",resume ? " since resuming" : "");
+            char lane[16];
+            for (int b = 0; b < MT_BIT_LANES; b++) {
+                if (lanes[b] == 0) continue;
+                sprintf(lane,"bit %d",b);
+                printf("%40s: %llu (%.1f%%)\n",lane,lanes[b],100.0*lanes[b]/laneTotal);
+            }
+        }
+        if (itersfailed) printRegionErrors(stdout,heatmap,heatmapRegionMB);
+        vector<const char*> testnames(memtestNTests);
+        for (int t = 0; t < memtestNTests; t++) testnames[t] = memtestTests[t].name;
+        printf("\n");
+        stats.print(stdout,&testnames[0]);
+        if (screen) {
+            const memtestErrorStats& evidence = stats.overall();
+            printf("\nScreening decision: %s\n",memtestScreen::decisionName(screenDecision));
+            printf("    %llu failing test runs in %.3g GiB-hours; log likelihood ratio %.3g (accept at or below %.3g, reject at or above %.3g)\n",
+                   evidence.failedRunCount(),evidence.exposure(),screen->logLikelihoodRatio(evidence.failedRunCount(),evidence.exposure()),
+                   screen->getAcceptBound(),screen->getRejectBound());
+        }
+        delete screen;
+        if (isatty(fileno(stdout)) && !daemonMode) {
             int i = 0;
             printf("\nPress <enter> to quit.\n");
             i = getchar();
         }
+        // A screening decision overrides the raw error count
+        if (screenDecision != SCREEN_UNDECIDED) return (screenDecision == SCREEN_REJECT);
         return (accumulatedErrors != 0);
     }
 }
@@ -12,11 +12,28 @@
  */
 
 #include "memtestCL_core.h"
+#include "memtestCL_thread.h"
+#include "memtestCL_eventlog.h"
+#include "memtestCL_trace.h"
 
 #include <iostream>
+#include <string.h>
 using namespace std;
 
+static memtestCounter softwaitTotalUs = 0;
+unsigned long long softwaitMicroseconds() {
+    return memtestAtomicLoad(softwaitTotalUs);
+}
+
+static cl_int softwaitUntimed(cl_uint num_events,const cl_event* event_list,cl_command_queue const* pcq,unsigned sleeplength,unsigned limit);
 cl_int softwaitForEvents(cl_uint num_events,const cl_event* event_list,cl_command_queue const* pcq,unsigned sleeplength,unsigned limit)
+{
+    const unsigned long long start = getTimeMicroseconds();
+    cl_int status = softwaitUntimed(num_events,event_list,pcq,sleeplength,limit);
+    memtestAtomicAdd(softwaitTotalUs,getTimeMicroseconds()-start);
+    return status;
+}
+static cl_int softwaitUntimed(cl_uint num_events,const cl_event* event_list,cl_command_queue const* pcq,unsigned sleeplength,unsigned limit)
 {
     #ifdef SOFTWAIT_IS_HARDWAIT
     cl_int status = clWaitForEvents(num_events,event_list);
@@ -29,7 +46,7 @@ cl_int softwaitForEvents(cl_uint num_events,const cl_event* event_list,cl_comman
     #if defined(CL_VERSION_1_1) && defined(USE_CL_11)
     if (num_events > 1) {
         cl_context ctx0,ctxn;
-        clGetEventInfo(event_list[0],CL_EVENT_CONTEXT,sizeof(cl_context),&ctx0,NULL);
+        cl_int err = clGetEventInfo(event_list[0],CL_EVENT_CONTEXT,sizeof(cl_context),&ctx0,NULL);
         if (err != CL_SUCCESS) return err;
         for (uint i = 0; i < num_events; i++) {
             cl_int err = clGetEventInfo(event_list[i],CL_EVENT_CONTEXT,sizeof(cl_context),&ctxn,NULL);
@@ -56,7 +73,11 @@ cl_int softwaitForEvents(cl_uint num_events,const cl_event* event_list,cl_comman
         if (err != CL_SUCCESS) return err;
         while (status != CL_COMPLETE && status >= 0) {
             unsigned int current = getTimeMilliseconds();
-            if ((current-start) > limit) return CL_INVALID_VALUE; // TODO: is this the best error?
+            if ((current-start) > limit) {
+                // Most likely a hung kernel; the caller no longer holds the events
+                for (uint j = i; j < num_events; j++) clReleaseEvent(event_list[j]);
+                return MT_TIMEOUT;
+            }
             //cout << status << endl;
             SLEEPMS(sleeplength);
             err = clGetEventInfo(event_list[i],CL_EVENT_COMMAND_EXECUTION_STATUS,sizeof(cl_int),&status,NULL);
@@ -83,43 +104,364 @@ inline static void checkCLErr(cl_int err, const char * name) {
     }
 }
 
-memtestState::memtestState(cl_context context, cl_device_id device) : 
-    ctx(context), dev(device), cq(clCreateCommandQueue(ctx,dev,0,NULL)),
-    memtest(ctx,dev,cq),
-    nBlocks(1024), nThreads(512), loopFactor(1), lcgPeriod(1024),
-    allocated(false), hostTempMem(NULL), initTime(0)
-{ 
+memtestCLBackend::memtestCLBackend(cl_context context,cl_device_id device) :
+    ctx(context), dev(device), cq(clCreateCommandQueue(ctx,dev,0,NULL)), cq_owned(true),
+    memtest(new memtestFunctions(ctx,dev,cq)), preparedFamilies(0), allocatedMegs(0), waitLimit(MT_WAIT_LIMIT_MS),
+    nBlocks(0), nThreads(0), allocated(false), trace(NULL), traceTrack(0), profiling(false)
+{
+    clRetainContext(ctx);
+}
+memtestCLBackend::memtestCLBackend(cl_context context,cl_device_id device,cl_command_queue queue) :
+    ctx(context), dev(device), cq(queue), cq_owned(false),
+    memtest(new memtestFunctions(ctx,dev,cq)), preparedFamilies(0), allocatedMegs(0), waitLimit(MT_WAIT_LIMIT_MS),
+    nBlocks(0), nThreads(0), allocated(false), trace(NULL), traceTrack(0), profiling(false)
+{
     clRetainContext(ctx);
+    clRetainCommandQueue(cq);
+}
+memtestCLBackend::~memtestCLBackend() {
+    deallocate();
+    delete memtest;
+    // A caller's queue was retained above, so it is released either way
+    if (cq) clReleaseCommandQueue(cq);
+    clReleaseContext(ctx);
+}
+void memtestCLBackend::geometry(uint& blocks,uint& threads) const {
     cl_device_type devtype;
     clGetDeviceInfo(dev,CL_DEVICE_TYPE,sizeof(cl_device_type),&devtype,NULL);
-    cl_uint maxdims;
-    clGetDeviceInfo(dev,CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS,sizeof(cl_uint),&maxdims,NULL);
-    size_t* maxextents = new size_t[maxdims];
-    clGetDeviceInfo(dev,CL_DEVICE_MAX_WORK_ITEM_SIZES,maxdims*sizeof(size_t),maxextents,NULL);
+    blocks = 1024; threads = 512;
     switch (devtype) {
         case CL_DEVICE_TYPE_GPU:
-            nThreads = memtest.max_workgroup_size(); break;
+            if (memtest) threads = memtest->max_workgroup_size();
             break;
         case CL_DEVICE_TYPE_CPU:
-            nBlocks = 32; nThreads = 1;
+            blocks = 32; threads = 1;
             break;
         default:
             break;
     }
+}
+uint memtestCLBackend::max_allocation() const {
+    cl_ulong maxalloc;
+    clGetDeviceInfo(dev,CL_DEVICE_MAX_MEM_ALLOC_SIZE,sizeof(cl_ulong),&maxalloc,NULL);
+    // in MiB
+    return (uint)(maxalloc/1048576);
+}
+void memtestCLBackend::prepare(uint families) {
+    preparedFamilies |= families;
+    if (memtest) memtest->prepare(families);
+}
+void memtestCLBackend::deallocate() {
+    if (!allocated) return;
+    wait();
+    clReleaseMemObject(devBitMem);
+    clReleaseMemObject(devTempMem);
+    clReleaseMemObject(devTestMem);
+    allocated = false;
+}
+cl_int memtestCLBackend::allocate(uint megs,uint blocks,uint threads) {
+    deallocate();
+    if (memtest == NULL) return CL_INVALID_COMMAND_QUEUE;
+    allocatedMegs = megs;
+    nBlocks = blocks;
+    nThreads = threads;
+    const uint N = (uint)((megs*262144ULL)/(nBlocks*nThreads));
+    cl_int err;
+    try {
+        // AMD's OpenCL will throw an error on allocation, NVIDIA on use. So both alloc and try to init.
+        devTestMem = clCreateBuffer(ctx,CL_MEM_READ_WRITE,megs*1048576ULL,NULL,&err);
+        if (err != CL_SUCCESS) {
+            cerr << "Unable to allocate OpenCL memory: "<<descriptionOfError(err)<<endl;
+            throw 1;
+        }
+        cl_event event = memtest->writeConstant(nBlocks,nThreads,devTestMem,N,0,err);
+        if (err != CL_SUCCESS) {
+            cerr << "Unable to allocate OpenCL memory: "<<descriptionOfError(err)<<endl;
+            throw 2;
+        }
+        enqueued(event,"clear region");
+
+        devTempMem = clCreateBuffer(ctx,CL_MEM_READ_WRITE,sizeof(uint)*nBlocks,NULL,&err);
+        if (err != CL_SUCCESS) {
+            cerr << "Unable to allocate OpenCL memory: "<<descriptionOfError(err)<<endl;
+            throw 2;
+        }
+        event = memtest->writeConstant(1,1,devTempMem,1,0,err);
+        if (err != CL_SUCCESS) {
+            cerr << "Unable to allocate OpenCL memory: "<<descriptionOfError(err)<<endl;
+            throw 3;
+        }
+        enqueued(event,"clear counts");
+
+        devBitMem = clCreateBuffer(ctx,CL_MEM_READ_WRITE,sizeof(uint)*MT_BIT_LANES,NULL,&err);
+        if (err != CL_SUCCESS) {
+            cerr << "Unable to allocate OpenCL memory: "<<descriptionOfError(err)<<endl;
+            throw 3;
+        }
+        // One work-item writing MT_BIT_LANES consecutive words clears the histogram
+        event = memtest->writeConstant(1,1,devBitMem,MT_BIT_LANES,0,err);
+        if (err != CL_SUCCESS) {
+            cerr << "Unable to allocate OpenCL memory: "<<descriptionOfError(err)<<endl;
+            throw 4;
+        }
+        enqueued(event,"clear bit lanes");
+    } catch (int allocFailed) {
+        wait();
+        switch (allocFailed) {
+            case 4:
+                clReleaseMemObject(devBitMem);
+            case 3:
+                clReleaseMemObject(devTempMem);
+            case 2:
+                clReleaseMemObject(devTestMem);
+            case 1:
+                break;
+            default:
+                cerr<<"Invalid allocation failure type in memtestCLBackend::allocate\n";
+                exit(1);
+        }
+        return err;
+    }
+    allocated = true;
+    return CL_SUCCESS;
+}
+cl_int memtestCLBackend::launch(memtestKernel k,uint N,const uint* params) {
+    if (!allocated) return CL_INVALID_MEM_OBJECT;
+    cl_int status;
+    cl_event event = memtest->launch(k,nBlocks,nThreads,devTestMem,N,params,devTempMem,devBitMem,status);
+    if (status == CL_SUCCESS) enqueued(event,kernelName(k));
+    return status;
+}
+cl_int memtestCLBackend::launchRange(memtestKernel k,uint N,const uint* params,uint firstBlock,uint blocks) {
+    if (!allocated) return CL_INVALID_MEM_OBJECT;
+    if (blocks == 0 || firstBlock+blocks > nBlocks) return CL_INVALID_VALUE;
+    if (firstBlock == 0 && blocks == nBlocks) return launch(k,N,params);
+    // The kernels address memory from their group index, which a global work offset does
+    // not change (and OpenCL 1.0 lacks); instead they take the work-group they start at
+    cl_int status;
+    cl_event event = memtest->launch(k,blocks,nThreads,devTestMem,N,params,devTempMem,devBitMem,status,firstBlock);
+    if (status == CL_SUCCESS) enqueued(event,kernelName(k));
+    return status;
+}
+cl_int memtestCLBackend::recover() {
+    // Moving the caller's work off their queue would break their ordering; recreating
+    // the device state is up to them
+    if (!cq_owned) return CL_INVALID_COMMAND_QUEUE;
+    // Whatever was in flight is lost with the queue, so nothing is waited for; the trace
+    // shows it running until now
+    traceCompleted();
+    for (list<cl_event>::iterator i = pending.begin(); i != pending.end(); i++) clReleaseEvent(*i);
+    pending.clear();
+    const bool reallocate = allocated;
+    if (allocated) {
+        clReleaseMemObject(devBitMem);
+        clReleaseMemObject(devTempMem);
+        clReleaseMemObject(devTestMem);
+        allocated = false;
+    }
+    if (memtest) preparedFamilies |= memtest->prepared_families();
+    delete memtest;
+    memtest = NULL;
+    if (cq) clReleaseCommandQueue(cq);
+    cq = NULL;
+
+    // A context that has seen a device fault may be unusable, so start over on a new one.
+    // Should that fail, the old context is the best there is.
+    cl_platform_id platform;
+    cl_int err = clGetDeviceInfo(dev,CL_DEVICE_PLATFORM,sizeof(cl_platform_id),&platform,NULL);
+    if (err == CL_SUCCESS) {
+        cl_context_properties props[3] = {CL_CONTEXT_PLATFORM,(cl_context_properties)platform,0};
+        cl_context fresh = clCreateContext(props,1,&dev,NULL,NULL,&err);
+        if (err == CL_SUCCESS) {
+            clReleaseContext(ctx);
+            ctx = fresh;
+        } else {
+            cerr << "Status of clCreateContext was "<<descriptionOfError(err)<<endl;
+        }
+    }
+    cl_command_queue queue = clCreateCommandQueue(ctx,dev,profiling ? CL_QUEUE_PROFILING_ENABLE : 0,&err);
+    if (err != CL_SUCCESS) {
+        // Without a queue every later launch, read and allocation fails until recover()
+        // is called again
+        cerr << "Status of clCreateCommandQueue was "<<descriptionOfError(err)<<endl;
+        return err;
+    }
+    cq = queue;
+    memtest = new memtestFunctions(ctx,dev,cq);
+    memtest->prepare(preparedFamilies);
+    return reallocate ? allocate(allocatedMegs,nBlocks,nThreads) : CL_SUCCESS;
+}
+void memtestCLBackend::setTrace(memtestTrace* t,uint track) {
+    // Commands in flight go to the trace they were enqueued under
+    wait();
+    trace = t;
+    traceTrack = track;
+    if (trace == NULL || profiling || !cq_owned || memtest == NULL) return;
+    cl_int err;
+    cl_command_queue profiled = clCreateCommandQueue(ctx,dev,CL_QUEUE_PROFILING_ENABLE,&err);
+    if (err != CL_SUCCESS) return;
+    // The new functions share the programs of the old, which stay built
+    memtestFunctions* functions = new memtestFunctions(ctx,dev,profiled);
+    functions->prepare(memtest->prepared_families());
+    delete memtest;
+    memtest = functions;
+    clReleaseCommandQueue(cq);
+    cq = profiled;
+    profiling = true;
+}
+void memtestCLBackend::enqueued(cl_event event,const char* name) {
+    pending.push_back(event);
+    if (trace == NULL) return;
+    // Waiting releases the event; this reference keeps it until its times are read
+    clRetainEvent(event);
+    tracedCommand c = {event,name,getTimeMicroseconds()};
+    traced.push_back(c);
+}
+void memtestCLBackend::traceCompleted() {
+    const unsigned long long now = getTimeMicroseconds();
+    for (list<tracedCommand>::iterator i = traced.begin(); i != traced.end(); i++) {
+        cl_ulong queued = 0, start = 0, end = 0;
+        cl_int err = profiling ? CL_SUCCESS : CL_PROFILING_INFO_NOT_AVAILABLE;
+        if (err == CL_SUCCESS) err = clGetEventProfilingInfo(i->event,CL_PROFILING_COMMAND_QUEUED,sizeof(cl_ulong),&queued,NULL);
+        if (err == CL_SUCCESS) err = clGetEventProfilingInfo(i->event,CL_PROFILING_COMMAND_START,sizeof(cl_ulong),&start,NULL);
+        if (err == CL_SUCCESS) err = clGetEventProfilingInfo(i->event,CL_PROFILING_COMMAND_END,sizeof(cl_ulong),&end,NULL);
+        if (err == CL_SUCCESS && queued <= start && start <= end) {
+            // The device clock is not the host's, so place the command by its delays
+            // after being queued, which was when the host enqueued it
+            trace->span(memtestTrace::DEVICE,traceTrack,"device",i->name,i->enqueuedUs+(start-queued)/1000,i->enqueuedUs+(end-queued)/1000);
+        } else {
+            // All that is known is that it ran some time between being enqueued and now
+            trace->span(memtestTrace::DEVICE,traceTrack,"device",i->name,i->enqueuedUs,now,"\"profiled\": false");
+        }
+        clReleaseEvent(i->event);
+    }
+    traced.clear();
+}
+cl_int memtestCLBackend::launchCopy(size_t bytes) {
+    if (!allocated) return CL_INVALID_MEM_OBJECT;
+    cl_event event;
+    cl_int err = clEnqueueCopyBuffer(cq,devTestMem,devTestMem,0,bytes,bytes,0,NULL,&event);
+    if (err != CL_SUCCESS) {
+        cerr << "Status of clEnqueueCopyBuffer was "<<descriptionOfError(err)<<endl;
+        return err;
+    }
+    enqueued(event,"copy");
+    return CL_SUCCESS;
+}
+cl_int memtestCLBackend::wait() {
+    if (pending.empty()) return CL_SUCCESS;
+    // softwaitForEvents releases the events it waits on
+    vector<cl_event> events(pending.begin(),pending.end());
+    pending.clear();
+    cl_int status = softwaitForEvents((cl_uint)events.size(),&events[0],&cq,1,waitLimit);
+    traceCompleted();
+    return status;
+}
+cl_int memtestCLBackend::poll(bool& done) {
+    done = true;
+    if (pending.empty()) return CL_SUCCESS;
+    // Make sure the launches are submitted, or they may never complete
+    cl_int status = clFlush(cq);
+    for (list<cl_event>::iterator i = pending.begin(); i != pending.end() && status == CL_SUCCESS; i++) {
+        cl_int execution;
+        status = clGetEventInfo(*i,CL_EVENT_COMMAND_EXECUTION_STATUS,sizeof(execution),&execution,NULL);
+        if (status == CL_SUCCESS && execution < 0) status = execution;
+        if (status == CL_SUCCESS && execution != CL_COMPLETE) {
+            done = false;
+            return CL_SUCCESS;
+        }
+    }
+    for (list<cl_event>::iterator i = pending.begin(); i != pending.end(); i++) clReleaseEvent(*i);
+    pending.clear();
+    traceCompleted();
+    return status;
+}
+cl_int memtestCLBackend::launchReadCounts(uint* counts) {
+    if (!allocated) return CL_INVALID_MEM_OBJECT;
+    cl_event event;
+    cl_int status = clEnqueueReadBuffer(cq,devTempMem,CL_FALSE,0,nBlocks*sizeof(uint),counts,0,NULL,&event);
+    if (status != CL_SUCCESS) {
+        cerr << "Status of clEnqueueReadBuffer was "<<descriptionOfError(status)<<endl;
+        return status;
+    }
+    enqueued(event,"read counts");
+    return CL_SUCCESS;
+}
+cl_int memtestCLBackend::readCounts(uint* counts) {
+    // Waiting on the readback rather than blocking in it lets a hung kernel time out
+    cl_int status = launchReadCounts(counts);
+    if (status != CL_SUCCESS) return status;
+    return wait();
+}
+cl_int memtestCLBackend::readWords(size_t offset,size_t count,uint* dst) {
+    if (!allocated) return CL_INVALID_MEM_OBJECT;
+    cl_int status = wait();
+    if (status != CL_SUCCESS) return status;
+    status = clEnqueueReadBuffer(cq,devTestMem,CL_TRUE,offset*sizeof(uint),count*sizeof(uint),dst,0,NULL,NULL);
+    if (status != CL_SUCCESS) cerr << "Status of clEnqueueReadBuffer was "<<descriptionOfError(status)<<endl;
+    return status;
+}
+cl_int memtestCLBackend::writeWords(size_t offset,size_t count,const uint* src) {
+    if (!allocated) return CL_INVALID_MEM_OBJECT;
+    cl_int status = wait();
+    if (status != CL_SUCCESS) return status;
+    status = clEnqueueWriteBuffer(cq,devTestMem,CL_TRUE,offset*sizeof(uint),count*sizeof(uint),src,0,NULL,NULL);
+    if (status != CL_SUCCESS) cerr << "Status of clEnqueueWriteBuffer was "<<descriptionOfError(status)<<endl;
+    return status;
+}
+cl_int memtestCLBackend::readBitErrors(uint* lanes) {
+    if (!allocated) return CL_INVALID_MEM_OBJECT;
+    if (!memtest->bit_lanes_supported()) return CL_INVALID_OPERATION;
+    cl_int status = wait();
+    if (status != CL_SUCCESS) return status;
+    status = clEnqueueReadBuffer(cq,devBitMem,CL_TRUE,0,MT_BIT_LANES*sizeof(uint),lanes,0,NULL,NULL);
+    if (status != CL_SUCCESS) {
+        cerr << "Status of clEnqueueReadBuffer was "<<descriptionOfError(status)<<endl;
+        return status;
+    }
+    static const uint zeros[MT_BIT_LANES] = {0};
+    status = clEnqueueWriteBuffer(cq,devBitMem,CL_TRUE,0,sizeof(zeros),zeros,0,NULL,NULL);
+    if (status != CL_SUCCESS) cerr << "Status of clEnqueueWriteBuffer was "<<descriptionOfError(status)<<endl;
+    return status;
+}
+
+memtestState::memtestState(cl_context context, cl_device_id device, uint families) :
+    backend(new memtestCLBackend(context,device)),
+    nBlocks(1024), nThreads(512), loopFactor(1), lcgPeriod(1024),
+    allocated(false), hostTempMem(NULL), bytesTouched(0), bitLanes(true), regionMB(64), recording(NULL), eventLog(NULL), logTest(0xFFFF), logChunk(0), kernelFamilies(families), launchLimitUs(0), hangFactor(0), faults(0), trace(NULL), traceTrack(0), initTime(0)
+{
+    init();
+}
+memtestState::memtestState(cl_context context, cl_device_id device, cl_command_queue queue, uint families) :
+    backend(new memtestCLBackend(context,device,queue)),
+    nBlocks(1024), nThreads(512), loopFactor(1), lcgPeriod(1024),
+    allocated(false), hostTempMem(NULL), bytesTouched(0), bitLanes(true), regionMB(64), recording(NULL), eventLog(NULL), logTest(0xFFFF), logChunk(0), kernelFamilies(families), launchLimitUs(0), hangFactor(0), faults(0), trace(NULL), traceTrack(0), initTime(0)
+{
+    init();
+}
+memtestState::memtestState(memtestBackend* be, uint families) :
+    backend(be),
+    nBlocks(1024), nThreads(512), loopFactor(1), lcgPeriod(1024),
+    allocated(false), hostTempMem(NULL), bytesTouched(0), bitLanes(true), regionMB(64), recording(NULL), eventLog(NULL), logTest(0xFFFF), logChunk(0), kernelFamilies(families), launchLimitUs(0), hangFactor(0), faults(0), trace(NULL), traceTrack(0), initTime(0)
+{
+    init();
+}
+void memtestState::init() {
+    // The geometry has to suit every kernel the tests will launch
+    backend->prepare(kernelFamilies);
+    backend->geometry(nBlocks,nThreads);
     loopFactor = 524288/(nBlocks*nThreads);
+    for (int b = 0; b < MT_BIT_LANES; b++) bitErrors[b] = 0;
+    for (int k = 0; k < MT_N_KERNELS; k++) usPerBlockWord[k] = 0;
     //cout << nBlocks << " work-groups of "<<nThreads<<" work-items each with a loop-factor of "<<loopFactor<<endl;
-    delete[] maxextents;
-
 }
 memtestState::~memtestState() {
     deallocate();
-    clReleaseCommandQueue(cq);
-    clReleaseContext(ctx);
+    delete backend;
 }
 void memtestState::deallocate() {
     if (!allocated) return;
-    clReleaseMemObject(devTempMem);
-    clReleaseMemObject(devTestMem);
+    backend->deallocate();
     free(hostTempMem);
     allocated = false;
 }
@@ -136,107 +478,268 @@ uint memtestState::allocate(uint mbToTest) {
         loopIters *= loopFactor;
 
 		if (megsToTest == 0) return 0;
-		cl_int err;
-		try {
-            // AMD's OpenCL will throw an error on allocation, NVIDIA on use. So both alloc and try to init.
-            devTestMem = clCreateBuffer(ctx,CL_MEM_READ_WRITE,megsToTest*1048576ULL,NULL,&err);
-            if (err != CL_SUCCESS) {
-                cerr << "Unable to allocate OpenCL memory: "<<descriptionOfError(err)<<endl;
-                throw 1;
-            }
-            memtest.writeConstant(nBlocks,nThreads,devTestMem,loopIters,0,err);
-            if (err != CL_SUCCESS) {
-                cerr << "Unable to allocate OpenCL memory: "<<descriptionOfError(err)<<endl;
-                throw 1;
-            }
-
-            devTempMem = clCreateBuffer(ctx,CL_MEM_READ_WRITE,sizeof(uint)*nBlocks,NULL,&err);
-            if (err != CL_SUCCESS) {
-                cerr << "Unable to allocate OpenCL memory: "<<descriptionOfError(err)<<endl;
-                throw 2;
-            }
-            memtest.writeConstant(1,1,devTempMem,1,0,err);
-            if (err != CL_SUCCESS) {
-                cerr << "Unable to allocate OpenCL memory: "<<descriptionOfError(err)<<endl;
-                throw 2;
-            }
+        if (backend->allocate(megsToTest,nBlocks,nThreads) != CL_SUCCESS) return 0;
 
-			hostTempMem = (uint*)malloc(sizeof(uint)*nBlocks);
-            if (hostTempMem == NULL) {
-                cerr << "Unable to allocate host memory: general failure"<<endl;
-                throw 3;
-            }
-		} catch (int allocFailed) {
-            // Clear CUDA error flag for outside world
-            switch (allocFailed) {
-                case 3:
-                    clReleaseMemObject(devTempMem);
-                case 2:
-                    clReleaseMemObject(devTestMem);
-                case 1:
-                    break;
-                default:
-                    cerr<<"Invalid allocation failure type in memtestState::allocate\n";
-                    exit(1);
-            }
-			return 0;
-		}
+        hostTempMem = (uint*)malloc(sizeof(uint)*nBlocks);
+        if (hostTempMem == NULL) {
+            cerr << "Unable to allocate host memory: general failure"<<endl;
+            backend->deallocate();
+            return 0;
+        }
 		allocated = true;
+        regionErrors.assign((megsToTest+regionMB-1)/regionMB,0);
+        // Also finds out whether the device counts errors per bit lane
+        resetBitErrors();
 		return megsToTest;
 }
+void memtestState::setTestedSize(uint megs) {
+    if (!allocated) return;
+    if (megs > megsToTest) megs = megsToTest;
+    loopIters = megs/2*loopFactor;
+}
 bool memtestState::gpuMemoryBandwidth(double& bandwidth,uint mbToTest,uint iters) {
     if (!allocated || mbToTest > max_bandwidth_size()) return false;
 
-    cl_int err;
-    cl_event *events = new cl_event[iters];
+    cl_int err = CL_SUCCESS;
     
     uint start = getTimeMilliseconds();
-    for (uint i = 0; i < iters; i++) {
-        err = clEnqueueCopyBuffer(cq,devTestMem,devTestMem,0,mbToTest*1048576ULL,mbToTest*1048576ULL,0,NULL,events+i);
-        if (err != CL_SUCCESS) {
-            cerr << "Status of clEnqueueCopyBuffer was "<<descriptionOfError(err)<<endl;
-            return false;
-        }
+    for (uint i = 0; i < iters && err == CL_SUCCESS; i++) {
+        err = backend->launchCopy(mbToTest*1048576ULL);
     }
-    err = softwaitForEvents(iters,events,&cq);
+    // The copies are not timed against any one kernel's
+    backend->setWaitLimit(MT_WAIT_LIMIT_MS);
+    cl_int waiterr = backend->wait();
+    if (err == CL_SUCCESS) err = waiterr;
 
     uint end = getTimeMilliseconds();
 	
     // Calculate bandwidth in MiB/s
 	// Multiply by 2 since we are reading and writing to the same memory
     bandwidth = 2.0*((double)mbToTest*iters)/((end-start)/1000.0);
-    delete[] events;
     return err == CL_SUCCESS;
 }
+unsigned long long memtestState::opBytes(const memtestKernel k,const uint* params,unsigned long long words) {
+    unsigned long long bytes = 4ULL*words;
+    // The modulo kernel overwrites the region params[4] times before writing the pattern,
+    // and only reads every params[2]-th word back
+    if (k == MT_WRITE_MOD) bytes *= 1+params[4];
+    if (k == MT_VERIFY_MOD) bytes /= params[2];
+    return bytes;
+}
+// Records op for the caller instead of running it; see memtestState::recording
+static void recordOp(vector<memtestOp>& ops,const memtestKernel k,const uint* params) {
+    memtestOp op;
+    op.kernel = k;
+    // Each kernel reads only the parameters it takes
+    for (int i = 0; i < 5; i++) op.params[i] = (i < kernelParamCount(k)) ? params[i] : 0;
+    ops.push_back(op);
+}
+unsigned long long memtestState::logLaunch(const memtestKernel k,const uint* params,uint blocks) const {
+    if (eventLog == NULL) return 0;
+    return eventLog->record(LOG_LAUNCH,logTest,(unsigned short)k,logChunk,loopIters,blocks,params,kernelParamCount(k),0,0);
+}
+void memtestState::logKernel(const memtestKernel k,const uint* params,uint blocks,unsigned long long startUs,uint errorCount) const {
+    if (eventLog == NULL) return;
+    eventLog->record(LOG_KERNEL,logTest,(unsigned short)k,logChunk,loopIters,blocks,params,kernelParamCount(k),errorCount,getTimeMicroseconds()-startUs);
+}
+void memtestState::sliceParams(const memtestKernel k,uint* params,uint firstBlock) const {
+    if (k == MT_WRITE_MOD || k == MT_VERIFY_MOD) {
+        const uint modulus = (k == MT_WRITE_MOD) ? params[3] : params[2];
+        const uint skew = (uint)(((unsigned long long)firstBlock*loopIters*nThreads) % modulus);
+        if (params[0] < modulus) params[0] = (params[0] + modulus - skew) % modulus;
+    }
+    if (seedsPerBlock(k,params)) {
+        // Slices of one work-group: pass the seed the kernel would pick for it
+        params[0] = 123459876+firstBlock;
+    }
+}
+bool memtestState::setLaunchLimit(uint ms) {
+    const bool ok = (ms == 0 || backend->canLaunchRange());
+    launchLimitUs = ok ? ms*1000ULL : 0;
+    return ok;
+}
+unsigned memtestState::hangLimitMs(const memtestKernel k,uint blocks) const {
+    if (hangFactor <= 0 || usPerBlockWord[k] == 0) return MT_WAIT_LIMIT_MS;
+    const double ms = hangFactor*usPerBlockWord[k]*blocks*loopIters/1000.0;
+    if (ms < 1000) return 1000;
+    return (ms < 4e9) ? (unsigned)ms : 4000000000u;
+}
+cl_int memtestState::runKernel(const memtestKernel k,const uint* params,uint firstBlock,uint blocks) const {
+    backend->setWaitLimit(hangLimitMs(k,blocks));
+    const unsigned long long startUs = getTimeMicroseconds();
+    cl_int status = (firstBlock == 0 && blocks == nBlocks) ? backend->launch(k,loopIters,params)
+                                                           : backend->launchRange(k,loopIters,params,firstBlock,blocks);
+    const unsigned long long enqueuedUs = getTimeMicroseconds();
+    if (status == CL_SUCCESS) status = isVerifyKernel(k) ? backend->readCounts(hostTempMem) : backend->wait();
+    const unsigned long long endUs = getTimeMicroseconds();
+    const unsigned long long us = endUs-startUs;
+    backend->setWaitLimit(MT_WAIT_LIMIT_MS);
+    if (trace) {
+        char args[64];
+        sprintf(args,"\"chunk\": %u, \"blocks\": %u",traceTrack,blocks);
+        trace->hostSpan("launch",kernelName(k),startUs,enqueuedUs,args);
+        trace->hostSpan("wait",isVerifyKernel(k) ? "wait for counts" : "wait",enqueuedUs,endUs,args);
+    }
+    if (status != CL_SUCCESS) {
+        deviceFault(k,params,blocks,status,us);
+        return status;
+    }
+    // Small slices leave most of the device idle, so their time per work-group
+    // overestimates that of larger ones: split launches only grow towards the limit
+    usPerBlockWord[k] = (us ? us : 1)/((double)blocks*loopIters);
+    return CL_SUCCESS;
+}
+void memtestState::deviceFault(const memtestKernel k,const uint* params,uint blocks,cl_int status,unsigned long long waitedUs) const {
+    if (eventLog) eventLog->record(LOG_FAULT,logTest,(unsigned short)k,logChunk,loopIters,blocks,params,kernelParamCount(k),(uint)status,waitedUs);
+    if (trace) {
+        char args[96];
+        sprintf(args,"\"kernel\": \"%s\", \"status\": %d",kernelName(k),status);
+        trace->instant(memtestTrace::DEVICE,traceTrack,"fault",descriptionOfError(status),getTimeMicroseconds(),args);
+    }
+    if (hangFactor <= 0) return;
+    cerr << "Device fault in "<<kernelName(k)<<" after "<<waitedUs/1000<<" ms: "<<descriptionOfError(status)<<"; recreating the device state"<<endl;
+    cl_int recovered = backend->recover();
+    if (recovered != CL_SUCCESS) {
+        cerr << "Unable to recover from the device fault: "<<descriptionOfError(recovered)<<endl;
+        return;
+    }
+    faults++;
+}
+void memtestState::setTrace(memtestTrace* t,uint track) {
+    trace = t;
+    traceTrack = track;
+    if (trace) {
+        char name[64];
+        sprintf(name,"Chunk %u (%s)",track,backend->name());
+        trace->nameTrack(memtestTrace::DEVICE,track,name);
+    }
+    backend->setTrace(t,track);
+}
+bool memtestState::launchSplit(const memtestKernel k,const uint* params,uint* errorCount) const {
+    if (errorCount) *errorCount = 0;
+    for (uint firstBlock = 0; firstBlock < nBlocks; ) {
+        uint blocks = nBlocks-firstBlock;
+        if (seedsPerBlock(k,params) || usPerBlockWord[k] == 0) {
+            // Time each kernel on one work-group before trusting it with more
+            blocks = 1;
+        } else {
+            const double fit = launchLimitUs/2.0/(usPerBlockWord[k]*loopIters);
+            if (fit < blocks) blocks = (fit >= 1) ? (uint)fit : 1;
+        }
+        if (trace) {
+            char args[96];
+            sprintf(args,"\"kernel\": \"%s\", \"first_block\": %u, \"blocks\": %u",kernelName(k),firstBlock,blocks);
+            trace->hostInstant("schedule","split",args);
+        }
+        uint p[5];
+        for (int i = 0; i < kernelParamCount(k); i++) p[i] = params[i];
+        if (blocks < nBlocks) sliceParams(k,p,firstBlock);
+
+        const unsigned long long logStartUs = logLaunch(k,p,blocks);
+        if (runKernel(k,p,firstBlock,blocks) != CL_SUCCESS) return false;
+        uint sliceErrors = 0;
+        if (errorCount) {
+            for (uint b = 0; b < blocks; b++) sliceErrors += hostTempMem[b];
+            if (sliceErrors > 0) addRegionErrors(hostTempMem,firstBlock,blocks);
+            *errorCount += sliceErrors;
+        }
+        logKernel(k,p,blocks,logStartUs,sliceErrors);
+        firstBlock += blocks;
+    }
+    return true;
+}
+bool memtestState::write(const memtestKernel k,const uint* params) const {
+    if (recording) {
+        recordOp(*recording,k,params);
+        return true;
+    }
+    bytesTouched += opBytes(k,params);
+    if (launchLimitUs) return launchSplit(k,params,NULL);
+    const unsigned long long startUs = logLaunch(k,params,nBlocks);
+    if (runKernel(k,params,0,nBlocks) != CL_SUCCESS) return false;
+    logKernel(k,params,nBlocks,startUs,0);
+    return true;
+}
+bool memtestState::verify(uint& errorCount,const memtestKernel k,const uint* params) const {
+    if (recording) {
+        recordOp(*recording,k,params);
+        errorCount = 0;
+        return true;
+    }
+    bytesTouched += opBytes(k,params);
+    if (launchLimitUs) {
+        if (!launchSplit(k,params,&errorCount)) return false;
+        return (errorCount > 0) ? collectBitErrors() : true;
+    }
+    const unsigned long long startUs = logLaunch(k,params,nBlocks);
+    if (runKernel(k,params,0,nBlocks) != CL_SUCCESS) return false;
+    errorCount = 0;
+    for (uint i = 0; i < nBlocks; i++) {
+        errorCount += hostTempMem[i];
+    }
+    logKernel(k,params,nBlocks,startUs,errorCount);
+    // The device's 32-bit lane counts cannot overflow within one verify; fold them into
+    // 64-bit totals after each one that failed, and leave clean runs without a readback
+    if (errorCount > 0) {
+        addRegionErrors(hostTempMem,0,nBlocks);
+        return collectBitErrors();
+    }
+    return true;
+}
+void memtestState::addRegionErrors(const uint* counts,uint firstBlock,uint blocks) const {
+    // Work-group b covers the N*nThreads words from b*N*nThreads; see THREAD_ADDRESS
+    const unsigned long long blockBytes = 4ULL*loopIters*nThreads;
+    const unsigned long long regionBytes = regionMB*1048576ULL;
+    for (uint b = 0; b < blocks; b++) {
+        if (counts[b] == 0) continue;
+        const size_t r = (size_t)((firstBlock+b)*blockBytes/regionBytes);
+        if (r < regionErrors.size()) regionErrors[r] += counts[b];
+    }
+}
+void memtestState::setRegionSize(uint mb) {
+    regionMB = mb ? mb : 1;
+    regionErrors.assign(allocated ? (megsToTest+regionMB-1)/regionMB : 0,0);
+}
+bool memtestState::collectBitErrors() const {
+    if (!allocated || !bitLanes) return true;
+    uint lanes[MT_BIT_LANES];
+    cl_int status = backend->readBitErrors(lanes);
+    if (status == CL_INVALID_OPERATION) {
+        bitLanes = false;
+        return true;
+    }
+    if (status != CL_SUCCESS) return false;
+    for (int b = 0; b < MT_BIT_LANES; b++) bitErrors[b] += lanes[b];
+    return true;
+}
+bool memtestState::getBitErrors(unsigned long long* lanes) const {
+    bool ok = collectBitErrors();
+    for (int b = 0; b < MT_BIT_LANES; b++) lanes[b] = bitErrors[b];
+    return ok;
+}
+void memtestState::resetBitErrors() {
+    collectBitErrors();
+    for (int b = 0; b < MT_BIT_LANES; b++) bitErrors[b] = 0;
+}
 bool memtestState::writeConstant(const uint constant) const {
 	if (!allocated) return false;
-    cl_int status;
-	cl_event event = memtest.writeConstant(nBlocks,nThreads,devTestMem,loopIters,constant,status);
-    return status == CL_SUCCESS && softwaitForEvents(1,&event,&cq) == CL_SUCCESS;
+    return write(MT_WRITE_CONSTANT,&constant);
 }
 bool memtestState::verifyConstant(uint& errorCount,const uint constant) const {
 	if (!allocated) return false;
-	cl_int status;
-    errorCount = memtest.verifyConstant(nBlocks,nThreads,devTestMem,loopIters,constant,devTempMem,hostTempMem,status);
-    return status == CL_SUCCESS;
+    return verify(errorCount,MT_VERIFY_CONSTANT,&constant);
 }
 bool memtestState::gpuShortLCG0(uint& errorCount,const uint repeats) const {
 	if (!allocated) return false;
-    cl_int status;
-	cl_event event = memtest.shortLCG0(nBlocks,nThreads,devTestMem,loopIters,repeats,lcgPeriod,status);
-    if (status != CL_SUCCESS || softwaitForEvents(1,&event,&cq) != CL_SUCCESS) return false;
-    
-    errorCount = memtest.verifyConstant(nBlocks,nThreads,devTestMem,loopIters,0,devTempMem,hostTempMem,status);
-    return status == CL_SUCCESS;
+    const uint params[] = {repeats,(uint)lcgPeriod};
+    if (!write(MT_LOGIC,params)) return false;
+    return verifyConstant(errorCount,0);
 }
 bool memtestState::gpuShortLCG0Shmem(uint& errorCount,const uint repeats) const {
 	if (!allocated) return false;
-	cl_int status;
-	cl_event event = memtest.shortLCG0Shmem(nBlocks,nThreads,devTestMem,loopIters,repeats,lcgPeriod,status);
-    if (status != CL_SUCCESS || softwaitForEvents(1,&event,&cq) != CL_SUCCESS) return false;
-    
-    errorCount = memtest.verifyConstant(nBlocks,nThreads,devTestMem,loopIters,0,devTempMem,hostTempMem,status);
-    return status == CL_SUCCESS;
+    const uint params[] = {repeats,(uint)lcgPeriod};
+    if (!write(MT_LOGIC_SHARED,params)) return false;
+    return verifyConstant(errorCount,0);
 }
 bool memtestState::gpuMovingInversionsPattern(uint& errorCount,const uint pattern) const {
 	if (!allocated) return false;
@@ -270,8 +773,6 @@ bool memtestState::gpuMovingInversionsRandom(uint& errorCount) const {
 }
 bool memtestState::gpuWalking8Bit(uint& errorCount,const bool ones,const uint shift) const {
 	if (!allocated) return false;
-    cl_event event;
-    cl_int status;
     // Implements one iteration of true walking 8-bit ones/zeros test
     uint patterns[2]={0x0,0x0};
     
@@ -291,133 +792,354 @@ bool memtestState::gpuWalking8Bit(uint& errorCount,const bool ones,const uint sh
         patterns[1] = ~patterns[1];
     }
 
-	event = memtest.writePairedConstants(nBlocks,nThreads,devTestMem,loopIters,patterns[0],patterns[1],status);
-    if (status != CL_SUCCESS || softwaitForEvents(1,&event,&cq) != CL_SUCCESS) return false;
-
-    errorCount = memtest.verifyPairedConstants(nBlocks,nThreads,devTestMem,loopIters,patterns[0],patterns[1],devTempMem,hostTempMem,status);
-    return status == CL_SUCCESS;
-
+    if (!write(MT_WRITE_PAIRED_CONSTANTS,patterns)) return false;
+    return verify(errorCount,MT_VERIFY_PAIRED_CONSTANTS,patterns);
 }
 bool memtestState::gpuWalking32Bit(uint& errorCount,const bool ones,const uint shift) const {
 	if (!allocated) return false;
-    cl_event event;
-    cl_int status;
-
-	event = memtest.writeWalking32Bit(nBlocks,nThreads,devTestMem,loopIters,ones,shift,status);
-    if (status != CL_SUCCESS || softwaitForEvents(1,&event,&cq) != CL_SUCCESS) return false;
+    const uint params[] = {(uint)ones,shift};
 
-    errorCount = memtest.verifyWalking32Bit(nBlocks,nThreads,devTestMem,loopIters,ones,shift,devTempMem,hostTempMem,status);
-    return status == CL_SUCCESS;
+    if (!write(MT_WRITE_W32,params)) return false;
+    return verify(errorCount,MT_VERIFY_W32,params);
 }
 bool memtestState::gpuRandomBlocks(uint& errorCount,const uint seed) const {
 	if (!allocated) return false;
-    cl_event event;
-    cl_int status;
-
-	event = memtest.writeRandomBlocks(nBlocks,nThreads,devTestMem,loopIters,seed,status);
-    if (status != CL_SUCCESS || softwaitForEvents(1,&event,&cq) != CL_SUCCESS) return false;
 
-    errorCount = memtest.verifyRandomBlocks(nBlocks,nThreads,devTestMem,loopIters,seed,devTempMem,hostTempMem,status);
-    return status == CL_SUCCESS;
+    if (!write(MT_WRITE_RANDOM,&seed)) return false;
+    return verify(errorCount,MT_VERIFY_RANDOM,&seed);
 }
 bool memtestState::gpuModuloX(uint& errorCount,const uint shift,const uint pattern,const uint modulus,const uint overwriteIters) const {
 	if (!allocated) return false;
-    cl_event event;
-    cl_int status;
     uint realShift = shift % modulus;
+    uint partialErrorCount;
     errorCount = 0;
     uint currentPattern = pattern;
 
     for (int i = 0; i < 2; i++, currentPattern = ~currentPattern) {
-	    event = memtest.writePairedModulo(nBlocks,nThreads,devTestMem,loopIters,realShift,currentPattern,~currentPattern,modulus,overwriteIters,status);
-        if (status != CL_SUCCESS || softwaitForEvents(1,&event,&cq) != CL_SUCCESS) return false;
-
-        errorCount += memtest.verifyPairedModulo(nBlocks,nThreads,devTestMem,loopIters,realShift,currentPattern,modulus,devTempMem,hostTempMem,status);
-        if (status != CL_SUCCESS) return false;
-    
+        const uint writeParams[] = {realShift,currentPattern,~currentPattern,modulus,overwriteIters};
+        const uint verifyParams[] = {realShift,currentPattern,modulus};
+        if (!write(MT_WRITE_MOD,writeParams)) return false;
+        if (!verify(partialErrorCount,MT_VERIFY_MOD,verifyParams)) return false;
+        errorCount += partialErrorCount;
     }
     return true;
 }
 
-memtestFunctions::memtestFunctions(cl_context context,cl_device_id device,cl_command_queue q): ctx(context),dev(device),cq(q),
-    k_write_constant(kernels[0]),k_verify_constant(kernels[1]),k_logic(kernels[2]),k_logic_shared(kernels[3]),
-    k_write_paired_constants(kernels[4]),k_verify_paired_constants(kernels[5]),k_write_w32(kernels[6]),k_verify_w32(kernels[7]),
-    k_write_random(kernels[8]),k_verify_random(kernels[9]),k_write_mod(kernels[10]),k_verify_mod(kernels[11])
-{
+// Startup self-test {{{
+// Write/verify kernel pairs exercised by the self-test, with the expected pattern written
+// by each so that the test can pick corruptible words the verify kernel will inspect
+static const struct {
+    const char* name;
+    memtestKernel write;
+    memtestKernel verify;
+    uint writeParams[5];
+    uint verifyParams[3];
+} selfTestPairs[] = {
+    {"constant",          MT_WRITE_CONSTANT,         MT_VERIFY_CONSTANT,         {0x5A5A5A5A},                  {0x5A5A5A5A}},
+    {"integer logic",     MT_LOGIC,                  MT_VERIFY_CONSTANT,         {1,1024},                      {0}},
+    {"paired constants",  MT_WRITE_PAIRED_CONSTANTS, MT_VERIFY_PAIRED_CONSTANTS, {0x01020408,0xFEFDFBF7},       {0x01020408,0xFEFDFBF7}},
+    {"walking 32-bit",    MT_WRITE_W32,              MT_VERIFY_W32,              {1,7},                         {1,7}},
+    {"random blocks",     MT_WRITE_RANDOM,           MT_VERIFY_RANDOM,           {0x2545F491},                  {0x2545F491}},
+    {"modulo",            MT_WRITE_MOD,              MT_VERIFY_MOD,              {3,0xC3C3C3C3,0x3C3C3C3C,20,2},{3,0xC3C3C3C3,20}}
+};
+static const int n_self_test_pairs = sizeof(selfTestPairs)/sizeof(selfTestPairs[0]);
+
+bool memtestState::selfTest(string& failure) {
+    if (!allocated) {
+        failure = "no memory allocated";
+        return false;
+    }
+    // Only the first 2 MiB of the region are needed
+    const uint savedIters = loopIters;
+    loopIters = (loopFactor < loopIters) ? loopFactor : loopIters;
+    const size_t words = (size_t)nBlocks*nThreads*loopIters;
+
+    // Two neighbors in the first work-group, one word mid-region and the last word;
+    // flipping 1, 1, 16 and 32 bits respectively
+    const size_t offsets[] = {0, 1, words/2 + 37, words-1};
+    const uint masks[] = {0x00000001, 0x80000000, 0xF0F0F0F0, 0xFFFFFFFF};
+    const int n_corrupt = sizeof(offsets)/sizeof(offsets[0]);
+    char msg[256];
+    bool passed = true;
+    // The bit-lane and region counts found here are not the caller's
+    unsigned long long savedBitErrors[MT_BIT_LANES];
+    getBitErrors(savedBitErrors);
+    const vector<unsigned long long> savedRegionErrors = regionErrors;
+
+    for (int p = 0; p < n_self_test_pairs && passed; p++) {
+        const memtestKernel kw = selfTestPairs[p].write, kv = selfTestPairs[p].verify;
+        const uint* wp = selfTestPairs[p].writeParams;
+        const uint* vp = selfTestPairs[p].verifyParams;
+        if (!(kernelFamilies & (1u << kernelFamily(kw))) || !(kernelFamilies & (1u << kernelFamily(kv)))) continue;
+        uint errorCount, expected = 0, word;
+        uint expectedLanes[MT_BIT_LANES] = {0};
+        resetBitErrors();
+
+        // An untouched region must verify clean...
+        if (!write(kw,wp) || !verify(errorCount,kv,vp)) {
+            sprintf(msg,"could not execute %s kernels",selfTestPairs[p].name);
+            passed = false;
+            break;
+        }
+        if (errorCount != 0) {
+            sprintf(msg,"%s verify reported %u errors in an uncorrupted region",selfTestPairs[p].name,errorCount);
+            passed = false;
+            break;
+        }
+        // ...and every corrupted bit must be counted exactly once
+        if (!write(kw,wp)) {
+            sprintf(msg,"could not execute %s kernels",selfTestPairs[p].name);
+            passed = false;
+            break;
+        }
+        for (int i = 0; i < n_corrupt; i++) {
+            size_t offset = offsets[i];
+            if (kv == MT_VERIFY_MOD) {
+                // The modulo verify only inspects offsets that are shift mod modulus
+                const uint shift = vp[0], modulus = vp[2];
+                offset -= offset % modulus;
+                offset = (offset + shift < words) ? offset + shift : offset + shift - modulus;
+                if (i == 1) offset += modulus;
+            }
+            if (backend->readWords(offset,1,&word) != CL_SUCCESS) {passed = false; break;}
+            word ^= masks[i];
+            if (backend->writeWords(offset,1,&word) != CL_SUCCESS) {passed = false; break;}
+            for (uint diff = masks[i]; diff; diff &= diff-1) expected++;
+            for (int b = 0; b < MT_BIT_LANES; b++) expectedLanes[b] += (masks[i] >> b) & 1;
+        }
+        if (!passed || !verify(errorCount,kv,vp)) {
+            sprintf(msg,"could not corrupt or verify memory for %s kernels",selfTestPairs[p].name);
+            passed = false;
+            break;
+        }
+        if (errorCount != expected) {
+            sprintf(msg,"%s verify reported %u errors for %u injected bit flips",selfTestPairs[p].name,errorCount,expected);
+            passed = false;
+            break;
+        }
+        unsigned long long lanes[MT_BIT_LANES];
+        if (!getBitErrors(lanes)) {
+            sprintf(msg,"could not read bit lane errors for %s kernels",selfTestPairs[p].name);
+            passed = false;
+            break;
+        }
+        for (int b = 0; b < MT_BIT_LANES && bitLanes; b++) {
+            if (lanes[b] == expectedLanes[b]) continue;
+            sprintf(msg,"%s verify reported %llu errors in bit lane %d for %u injected bit flips",selfTestPairs[p].name,lanes[b],b,expectedLanes[b]);
+            passed = false;
+            break;
+        }
+    }
+
+    resetBitErrors();
+    for (int b = 0; b < MT_BIT_LANES; b++) bitErrors[b] = savedBitErrors[b];
+    regionErrors = savedRegionErrors;
+    loopIters = savedIters;
+    if (!passed) failure = msg;
+    return passed;
+}
+//}}}
+
+// Kernel argument layout: (base, firstBlock, N, params..., [blockErrorCount, bitErrorCount], [local uint arrays...], [local bitLanes])
+static const struct {
+    const char* name;
+    int nParams;
+    bool verify;
+    int nLocals;
+} kernelInfo[MT_N_KERNELS] = {
+    {"deviceWriteConstant",         1, false, 0},
+    {"deviceVerifyConstant",        1, true,  1},
+    {"deviceShortLCG0",             2, false, 0},
+    {"deviceShortLCG0Shmem",        2, false, 1},
+    {"deviceWritePairedConstants",  2, false, 0},
+    {"deviceVerifyPairedConstants", 2, true,  1},
+    {"deviceWriteWalking32Bit",     2, false, 0},
+    {"deviceVerifyWalking32Bit",    2, true,  1},
+    {"deviceWriteRandomBlocks",     1, false, 1},
+    {"deviceVerifyRandomBlocks",    1, true,  3},
+    {"deviceWritePairedModulo",     5, false, 0},
+    {"deviceVerifyPairedModulo",    3, true,  1}
+};
+const char* kernelName(memtestKernel k) {
+    return kernelInfo[k].name;
+}
+bool isVerifyKernel(memtestKernel k) {
+    return kernelInfo[k].verify;
+}
+int kernelParamCount(memtestKernel k) {
+    return kernelInfo[k].nParams;
+}
+
+static const char* const methodNames[MT_N_METHODS] = {
+    "gpuShortLCG0", "gpuShortLCG0Shmem", "gpuMovingInversionsOnesZeros", "gpuWalking8BitM86", "gpuWalking8Bit",
+    "gpuMovingInversionsRandom", "gpuWalking32Bit", "gpuRandomBlocks", "gpuModuloX"
+};
+const char* methodName(memtestMethod m) {
+    return (m < MT_N_METHODS) ? methodNames[m] : "";
+}
+
+// The programs of the kernel families, each built from the kernel source with
+// -DMT_FAMILY=f. One set is shared by every memtestFunctions on a context and device, so
+// that chunks do not build their own, and each family is built on a thread of its own
+// when first asked for, so that families build concurrently and only when needed.
+class memtestPrograms { //{{{
+    enum buildState {NOT_STARTED, BUILDING, BUILT};
+    struct family {
+        memtestPrograms* owner;
+        int index;
+        buildState state;
+        cl_program program;
+        cl_int status;
+        string log;
+        memtestThread builder;
+    };
+    cl_context ctx;
+    cl_device_id dev;
+    int users;
+    family families[MT_N_FAMILIES];
+    memtestMutex mutex;
+    memtestCondition built;
+    static memtestMutex registryMutex;
+    static list<memtestPrograms*> registry;
+    static void build(void* fam);
+    memtestPrograms(cl_context context,cl_device_id device);
+    ~memtestPrograms();
+public:
+    // The set for context and device, created on first use; release() each one acquired
+    static memtestPrograms* acquire(cl_context context,cl_device_id device);
+    static void release(memtestPrograms* p);
+    // Starts building family f unless it has been already
+    void prepare(int f);
+    // Family f's program, waiting for it to be built; exits with the build log if it failed
+    cl_program get(int f);
+}; //}}}
+memtestMutex memtestPrograms::registryMutex;
+list<memtestPrograms*> memtestPrograms::registry;
+
+memtestPrograms::memtestPrograms(cl_context context,cl_device_id device) : ctx(context), dev(device), users(1) {
+    clRetainContext(ctx);
+    for (int f = 0; f < MT_N_FAMILIES; f++) {
+        families[f].owner = this;
+        families[f].index = f;
+        families[f].state = NOT_STARTED;
+        families[f].program = NULL;
+        families[f].status = CL_SUCCESS;
+    }
+}
+memtestPrograms::~memtestPrograms() {
+    for (int f = 0; f < MT_N_FAMILIES; f++) {
+        families[f].builder.join();
+        if (families[f].program) clReleaseProgram(families[f].program);
+    }
+    clReleaseContext(ctx);
+}
+memtestPrograms* memtestPrograms::acquire(cl_context context,cl_device_id device) {
+    memtestLock lock(registryMutex);
+    for (list<memtestPrograms*>::iterator i = registry.begin(); i != registry.end(); i++) {
+        if ((*i)->ctx == context && (*i)->dev == device) {
+            (*i)->users++;
+            return *i;
+        }
+    }
+    registry.push_back(new memtestPrograms(context,device));
+    return registry.back();
+}
+void memtestPrograms::release(memtestPrograms* p) {
+    {
+        memtestLock lock(registryMutex);
+        if (--p->users > 0) return;
+        registry.remove(p);
+    }
+    delete p;
+}
+void memtestPrograms::build(void* fam) {
+    family& f = *(family*)fam;
+    memtestPrograms& self = *f.owner;
     #include "memtestCL_kernels.clh"
     size_t kernel_length = memtestCL_kernels_len;
-    cl_int err;
     const char* kernelcode = (char*) &memtestCL_kernels[0];
+    char options[32];
+    sprintf(options,"-DMT_FAMILY=%d",f.index);
+    cl_int err;
+    string log;
+    cl_program code = clCreateProgramWithSource(self.ctx,1,&kernelcode,&kernel_length,&err);
+    if (err == CL_SUCCESS) {
+        err = clBuildProgram(code,1,&self.dev,options,NULL,NULL);
+        if (err != CL_SUCCESS) {
+            char buildlog[16384] = "";
+            clGetProgramBuildInfo(code,self.dev,CL_PROGRAM_BUILD_LOG,sizeof(buildlog),buildlog,NULL);
+            log = buildlog;
+        }
+    }
+    memtestLock lock(self.mutex);
+    f.program = code;
+    f.status = err;
+    f.log = log;
+    f.state = BUILT;
+    self.built.broadcast();
+}
+void memtestPrograms::prepare(int f) {
+    {
+        memtestLock lock(mutex);
+        if (families[f].state != NOT_STARTED) return;
+        families[f].state = BUILDING;
+    }
+    // Without a thread to spare, the caller builds it
+    if (!families[f].builder.start(build,&families[f])) build(&families[f]);
+}
+cl_program memtestPrograms::get(int f) {
+    prepare(f);
+    cl_int status;
+    string log;
+    {
+        memtestLock lock(mutex);
+        while (families[f].state != BUILT) built.wait(mutex);
+        if (families[f].status == CL_SUCCESS) return families[f].program;
+        status = families[f].status;
+        log = families[f].log;
+    }
+    std::cout<<"Error building CL kernels:\n"<<log<<std::endl;
+    checkCLErr(status,"clBuildProgram");
+    return NULL;
+}
+
+memtestFunctions::memtestFunctions(cl_context context,cl_device_id device,cl_command_queue q): ctx(context),dev(device),cq(q),
+    programs(memtestPrograms::acquire(context,device)),prepared(0)
+{
     clRetainContext(ctx);
     clRetainCommandQueue(cq);
-    code = clCreateProgramWithSource(ctx,1,&kernelcode,&kernel_length,&err);
-    checkCLErr(err,"clCreateProgramWithSource");
-    err = clBuildProgram(code,1,&dev,"",NULL,NULL);
-    if (err != CL_SUCCESS /* || true */) { //== CL_BUILD_PROGRAM_FAILURE) {
-        char buildlog[16384];
-        clGetProgramBuildInfo(code,device,CL_PROGRAM_BUILD_LOG,16384,buildlog,NULL);
-        std::cout<<"Error building CL kernels:\n"<<buildlog<<std::endl;
-        std::cout<<"\n\n\n";
-        unsigned char* binary = new unsigned char[131072];
-        size_t binlen;
-        clGetProgramInfo(code,CL_PROGRAM_BINARIES,131071,&binary,&binlen);
-        binary[binlen] = '\0';
-        std::cout << "Binary rep ("<<binlen<<"bytes):\n";
-        std::cout << binary;
-        delete[] binary;
-        if (err != CL_SUCCESS) exit(2);
-    }
-    checkCLErr(err,"clBuildProgram");
-    k_write_constant = clCreateKernel(code,"deviceWriteConstant",&err);
-    checkCLErr(err,"k_write_constant");
-    k_verify_constant = clCreateKernel(code,"deviceVerifyConstant",&err);
-    checkCLErr(err,"k_verify_constant");
-    k_logic = clCreateKernel(code,"deviceShortLCG0",&err);
-    checkCLErr(err,"k_logic");
-    k_logic_shared = clCreateKernel(code,"deviceShortLCG0Shmem",&err);
-    checkCLErr(err,"k_logic_shared");
-    k_write_paired_constants = clCreateKernel(code,"deviceWritePairedConstants",&err);
-    checkCLErr(err,"k_write_paired_constants");
-    k_verify_paired_constants = clCreateKernel(code,"deviceVerifyPairedConstants",&err);
-    checkCLErr(err,"k_verify_paired_constants");
-    k_write_w32 = clCreateKernel(code,"deviceWriteWalking32Bit",&err);
-    checkCLErr(err,"k_write_w32");
-    k_verify_w32 = clCreateKernel(code,"deviceVerifyWalking32Bit",&err);
-    checkCLErr(err,"k_verify_w32");
-    k_write_random = clCreateKernel(code,"deviceWriteRandomBlocks",&err);
-    checkCLErr(err,"k_write_random");
-    k_verify_random = clCreateKernel(code,"deviceVerifyRandomBlocks",&err);
-    checkCLErr(err,"k_verify_random");
-    k_write_mod = clCreateKernel(code,"deviceWritePairedModulo",&err);
-    checkCLErr(err,"k_write_mod");
-    k_verify_mod = clCreateKernel(code,"deviceVerifyPairedModulo",&err);
-    checkCLErr(err,"k_verify_mod");
+    for (int i = 0; i < n_kernels; i++) kernels[i] = NULL;
 }
 memtestFunctions::~memtestFunctions() {
-    clReleaseKernel(k_write_constant);
-    clReleaseKernel(k_verify_constant);
-    clReleaseKernel(k_logic);
-    clReleaseKernel(k_logic_shared);
-    clReleaseKernel(k_write_paired_constants);
-    clReleaseKernel(k_verify_paired_constants);
-    clReleaseKernel(k_write_w32);
-    clReleaseKernel(k_verify_w32);
-    clReleaseKernel(k_write_random);
-    clReleaseKernel(k_verify_random);
-    clReleaseKernel(k_write_mod);
-    clReleaseKernel(k_verify_mod);
-    clReleaseProgram(code);
+    for (int i = 0; i < n_kernels; i++) {
+        if (kernels[i]) clReleaseKernel(kernels[i]);
+    }
+    memtestPrograms::release(programs);
     clReleaseCommandQueue(cq);
     clReleaseContext(ctx);
 }
-cl_int memtestFunctions::setKernelArgs(cl_kernel& kernel,const int n_args,const size_t* sizes,const void** args) const {
-    char kername[256];
-    clGetKernelInfo(kernel,CL_KERNEL_FUNCTION_NAME,256,kername,NULL);
+void memtestFunctions::prepare(uint families) {
+    prepared |= families;
+    for (int f = 0; f < MT_N_FAMILIES; f++) {
+        if (families & (1u << f)) programs->prepare(f);
+    }
+}
+cl_kernel memtestFunctions::kernel(const memtestKernel k) const {
+    if (kernels[k] == NULL) {
+        cl_int err;
+        kernels[k] = clCreateKernel(programs->get(kernelFamily(k)),kernelInfo[k].name,&err);
+        checkCLErr(err,kernelInfo[k].name);
+    }
+    return kernels[k];
+}
+cl_int memtestFunctions::setKernelArgs(const cl_kernel& kernel,const int n_args,const size_t* sizes,const void** args) const {
     for (int i = 0; i < n_args; i++) {
         cl_int status = clSetKernelArg(kernel,i,sizes[i],args[i]);
         if (status != CL_SUCCESS) {
+            char kername[256];
+            clGetKernelInfo(kernel,CL_KERNEL_FUNCTION_NAME,256,kername,NULL);
             cout << "Error "<<descriptionOfError(status) <<" setting argument "<<i<<" of kernel "<<kername<<endl;
-            break;
+            return status;
         }
     }
     return CL_SUCCESS;
@@ -425,8 +1147,14 @@ cl_int memtestFunctions::setKernelArgs(cl_kernel& kernel,const int n_args,const
 uint memtestFunctions::max_workgroup_size() const {
         uint maxsize = 0xFFFFFFFF;
         size_t kernelsize;
+        const uint families = prepared ? prepared : MT_ALL_FAMILIES;
+        // Let every family build at once before waiting on any
+        for (int f = 0; f < MT_N_FAMILIES; f++) {
+            if (families & (1u << f)) programs->prepare(f);
+        }
         for (int i = 0; i < n_kernels; i++) {
-            clGetKernelWorkGroupInfo(kernels[i],dev,CL_KERNEL_WORK_GROUP_SIZE,sizeof(size_t),&kernelsize,NULL);
+            if (!(families & (1u << kernelFamily((memtestKernel)i)))) continue;
+            clGetKernelWorkGroupInfo(kernel((memtestKernel)i),dev,CL_KERNEL_WORK_GROUP_SIZE,sizeof(size_t),&kernelsize,NULL);
             maxsize = (kernelsize < maxsize) ? kernelsize : maxsize;
 
             char kername[256];
@@ -436,205 +1164,122 @@ uint memtestFunctions::max_workgroup_size() const {
         //cout << "Max size possible is "<<maxsize;
         return maxsize;
 }
-cl_event memtestFunctions::writeConstant(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint constant,cl_int& status) const {
-    cl_event event;
-    const int n_args = 3;
-    size_t sizes[] = {sizeof(cl_mem),sizeof(uint),sizeof(uint)};
-    const void*  args[]  = {&base,&N,&constant};
-    status = setKernelArgs(k_write_constant,n_args,sizes,args);
-    if (status != CL_SUCCESS) return event;
-    size_t total_threads = nBlocks*nThreads;
-    size_t local_threads = nThreads;
-    //cout << "Enqueueing writeConstant kernel with "<<total_threads<<" total threads over "<<nBlocks<<" work-groups for "<<nThreads<<" items per group"<<endl;
-    status = clEnqueueNDRangeKernel(cq,k_write_constant,1,NULL,&total_threads,&local_threads,0,NULL,&event);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing writeConstant kernel"<<endl; return event;}
-    return event;
+bool memtestFunctions::bit_lanes_supported() const {
+    // 32-bit atomics are core from OpenCL 1.1 and extensions before; see memtestCL_kernels.cl
+    char version[256];
+    if (clGetDeviceInfo(dev,CL_DEVICE_VERSION,sizeof(version),version,NULL) != CL_SUCCESS) return false;
+    if (strncmp(version,"OpenCL 1.0",10) != 0) return true;
+    size_t length = 0;
+    if (clGetDeviceInfo(dev,CL_DEVICE_EXTENSIONS,0,NULL,&length) != CL_SUCCESS || length == 0) return false;
+    vector<char> extensions(length+1,0);
+    if (clGetDeviceInfo(dev,CL_DEVICE_EXTENSIONS,length,&extensions[0],NULL) != CL_SUCCESS) return false;
+    return strstr(&extensions[0],"cl_khr_global_int32_base_atomics") && strstr(&extensions[0],"cl_khr_local_int32_base_atomics");
 }
-cl_event memtestFunctions::writePairedConstants(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint constant1,const uint constant2,cl_int& status) const {
-    cl_event event;
-    const int n_args = 4;
-    size_t sizes[] = {sizeof(cl_mem),sizeof(uint),sizeof(uint),sizeof(uint)};
-    const void*  args[]  = {&base, &N, &constant1, &constant2};
-    status = setKernelArgs(k_write_paired_constants,n_args,sizes,args);
+cl_int memtestFunctions::setLaunchArgs(const memtestKernel k,const uint nThreads,cl_mem base,uint N,const uint* params,cl_mem blockErrorCount,cl_mem bitErrorCount,uint firstBlock) const {
+    // At most base, firstBlock, N, 5 parameters, the two count buffers and 4 local arrays
+    size_t sizes[14];
+    const void* args[14];
+    int n_args = 0;
+    sizes[n_args] = sizeof(cl_mem); args[n_args++] = &base;
+    sizes[n_args] = sizeof(uint);   args[n_args++] = &firstBlock;
+    sizes[n_args] = sizeof(uint);   args[n_args++] = &N;
+    for (int i = 0; i < kernelInfo[k].nParams; i++) {
+        sizes[n_args] = sizeof(uint); args[n_args++] = params+i;
+    }
+    if (kernelInfo[k].verify) {
+        sizes[n_args] = sizeof(cl_mem); args[n_args++] = &blockErrorCount;
+        sizes[n_args] = sizeof(cl_mem); args[n_args++] = &bitErrorCount;
+    }
+    for (int i = 0; i < kernelInfo[k].nLocals; i++) {
+        sizes[n_args] = sizeof(uint)*nThreads; args[n_args++] = NULL;
+    }
+    if (kernelInfo[k].verify) {
+        // The work-group's bit-lane histogram
+        sizes[n_args] = sizeof(uint)*MT_BIT_LANES; args[n_args++] = NULL;
+    }
+    return setKernelArgs(kernel(k),n_args,sizes,args);
+}
+cl_event memtestFunctions::launch(const memtestKernel k,const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint* params,cl_mem blockErrorCount,cl_mem bitErrorCount,cl_int& status,uint firstBlock) const {
+    cl_event event = NULL;
+    status = setLaunchArgs(k,nThreads,base,N,params,blockErrorCount,bitErrorCount,firstBlock);
     if (status != CL_SUCCESS) return event;
 
     size_t total_threads = nBlocks*nThreads;
     size_t local_threads = nThreads;
-    status = clEnqueueNDRangeKernel(cq,k_write_paired_constants,1,NULL,&total_threads,&local_threads,0,NULL,&event);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing writePairedConstants kernel"<<endl; return event;}
+    //cout << "Enqueueing "<<kernelInfo[k].name<<" kernel with "<<total_threads<<" total threads over "<<nBlocks<<" work-groups for "<<nThreads<<" items per group"<<endl;
+    status = clEnqueueNDRangeKernel(cq,kernel(k),1,NULL,&total_threads,&local_threads,0,NULL,&event);
+    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing "<<kernelInfo[k].name<<" kernel"<<endl; return event;}
     return event;
 }
+uint memtestFunctions::readErrorCounts(const uint nBlocks,cl_mem blockErrorCount,uint* error_counts,cl_int& status) const {
+    status = clEnqueueReadBuffer(cq,blockErrorCount,CL_TRUE,0,nBlocks*sizeof(uint),error_counts,0,NULL,NULL);
+    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing error count readback"<<endl; return (uint)-1;}
+
+    uint totalErrors = 0;
+    for (uint i = 0; i < nBlocks; i++) {
+         totalErrors += error_counts[i];
+    }
+    return totalErrors;
+}
+cl_event memtestFunctions::writeConstant(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint constant,cl_int& status) const {
+    return launch(MT_WRITE_CONSTANT,nBlocks,nThreads,base,N,&constant,NULL,NULL,status);
+}
+cl_event memtestFunctions::writePairedConstants(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint constant1,const uint constant2,cl_int& status) const {
+    const uint params[] = {constant1,constant2};
+    return launch(MT_WRITE_PAIRED_CONSTANTS,nBlocks,nThreads,base,N,params,NULL,NULL,status);
+}
 cl_event memtestFunctions::writeWalking32Bit(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const bool ones,const uint shift,cl_int& status) const {
-    cl_event event;
-    cl_int iones = (int)ones;
-    const int n_args = 4;
-    size_t sizes[] = {sizeof(cl_mem),sizeof(uint),sizeof(cl_int),sizeof(uint)};
-    const void*  args[]  = {&base, &N, &iones, &shift};
-    status = setKernelArgs(k_write_w32,n_args,sizes,args);
-    if (status != CL_SUCCESS) return event;
-    size_t total_threads = nBlocks*nThreads;
-    size_t local_threads = nThreads;
-    status = clEnqueueNDRangeKernel(cq,k_write_w32,1,NULL,&total_threads,&local_threads,0,NULL,&event);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing writeWalking32Bit kernel"<<endl; return event;}
-    return event;
+    const uint params[] = {(uint)ones,shift};
+    return launch(MT_WRITE_W32,nBlocks,nThreads,base,N,params,NULL,NULL,status);
 }
 cl_event memtestFunctions::writeRandomBlocks(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint seed,cl_int& status) const {
-    cl_event event;
-    const int n_args = 4;
-    size_t sizes[] = {sizeof(cl_mem),sizeof(uint),sizeof(uint),4*nThreads};
-    const void*  args[]  = {&base, &N, &seed, NULL};
-    status = setKernelArgs(k_write_random,n_args,sizes,args);
-    if (status != CL_SUCCESS) return event;
-    size_t total_threads = nBlocks*nThreads;
-    size_t local_threads = nThreads;
-    status = clEnqueueNDRangeKernel(cq,k_write_random,1,NULL,&total_threads,&local_threads,0,NULL,&event);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing writeRandomBlocks kernel"<<endl; return event;}
-    return event;
+    return launch(MT_WRITE_RANDOM,nBlocks,nThreads,base,N,&seed,NULL,NULL,status);
 }
 cl_event memtestFunctions::writePairedModulo(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint shift,const uint pattern1, const uint pattern2, const uint modulus,const uint iters,cl_int& status) const {
-    cl_event event;
-    const int n_args = 7;
-    size_t sizes[] = {sizeof(cl_mem),sizeof(uint),sizeof(uint),sizeof(uint),sizeof(uint),sizeof(uint),sizeof(uint)};
-    const void*  args[]  = {&base, &N, &shift,&pattern1,&pattern2,&modulus,&iters};
-    status = setKernelArgs(k_write_mod,n_args,sizes,args);
-    if (status != CL_SUCCESS) return event;
-
-    size_t total_threads = nBlocks*nThreads;
-    size_t local_threads = nThreads;
-    status = clEnqueueNDRangeKernel(cq,k_write_mod,1,NULL,&total_threads,&local_threads,0,NULL,&event);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing writePairedModulo kernel"<<endl; return event;}
-    return event;
+    const uint params[] = {shift,pattern1,pattern2,modulus,iters};
+    return launch(MT_WRITE_MOD,nBlocks,nThreads,base,N,params,NULL,NULL,status);
 }
 cl_event memtestFunctions::shortLCG0(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint repeats,const uint period,cl_int& status) const {
-    cl_event event;
-    const int n_args = 4;
-    size_t sizes[] = {sizeof(cl_mem),sizeof(uint),sizeof(uint),sizeof(uint)};
-    const void*  args[]  = {&base, &N, &repeats, &period};
-    status = setKernelArgs(k_logic,n_args,sizes,args);
-    if (status != CL_SUCCESS) return event;
-
-    size_t total_threads = nBlocks*nThreads;
-    size_t local_threads = nThreads;
-    status = clEnqueueNDRangeKernel(cq,k_logic,1,NULL,&total_threads,&local_threads,0,NULL,&event);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing LCG0 kernel"<<endl; return event;}
-    return event;
+    const uint params[] = {repeats,period};
+    return launch(MT_LOGIC,nBlocks,nThreads,base,N,params,NULL,NULL,status);
 }
 cl_event memtestFunctions::shortLCG0Shmem(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint repeats,const uint period,cl_int& status) const {
-    cl_event event;
-    const int n_args = 5;
-    size_t sizes[] = {sizeof(cl_mem),sizeof(uint),sizeof(uint),sizeof(uint),sizeof(uint)*nThreads};
-    const void*  args[]  = {&base, &N, &repeats, &period,NULL};
-    status = setKernelArgs(k_logic_shared,n_args,sizes,args);
-    if (status != CL_SUCCESS) return event;
-
-    size_t total_threads = nBlocks*nThreads;
-    size_t local_threads = nThreads;
-    status = clEnqueueNDRangeKernel(cq,k_logic_shared,1,NULL,&total_threads,&local_threads,0,NULL,&event);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing LCG0Shmem kernel"<<endl; return event;}
-    return event;
+    const uint params[] = {repeats,period};
+    return launch(MT_LOGIC_SHARED,nBlocks,nThreads,base,N,params,NULL,NULL,status);
 }
 
-uint memtestFunctions::verifyConstant(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint constant,cl_mem blockErrorCount,uint* error_counts,cl_int& status) const {
-    const int n_args = 5;
-    size_t sizes[] = {sizeof(cl_mem),sizeof(uint),sizeof(uint),sizeof(cl_mem),sizeof(uint)*nThreads};
-    const void*  args[]  = {&base, &N, &constant, &blockErrorCount,NULL};
-    status = setKernelArgs(k_verify_constant,n_args,sizes,args);
-    if (status != CL_SUCCESS) return -1;
-
-    size_t total_threads = nBlocks*nThreads;
-    size_t local_threads = nThreads;
-    //cout << "Enqueueing verifyConstant kernel with "<<total_threads<<" total threads over "<<nBlocks<<" work-groups for "<<local_threads<<" items per group"<<endl;
-    status = clEnqueueNDRangeKernel(cq,k_verify_constant,1,NULL,&total_threads,&local_threads,0,NULL,NULL);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing verifyConstant kernel"<<endl; return (uint)-1;}
-    status = clEnqueueReadBuffer(cq,blockErrorCount,CL_TRUE,0,nBlocks*sizeof(uint),error_counts,0,NULL,NULL);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing verifyConstant readback"<<endl; return (uint)-1;}
-
-    uint totalErrors = 0;
-    for (uint i = 0; i < nBlocks; i++) {
-         totalErrors += error_counts[i];
-    }
-    return totalErrors;
+uint memtestFunctions::verifyConstant(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint constant,cl_mem blockErrorCount,cl_mem bitErrorCount,uint* error_counts,cl_int& status) const {
+    cl_event event = launch(MT_VERIFY_CONSTANT,nBlocks,nThreads,base,N,&constant,blockErrorCount,bitErrorCount,status);
+    if (status != CL_SUCCESS) return (uint)-1;
+    clReleaseEvent(event);
+    return readErrorCounts(nBlocks,blockErrorCount,error_counts,status);
 }
-uint memtestFunctions::verifyPairedConstants(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint constant1,const uint constant2,cl_mem blockErrorCount,uint* error_counts,cl_int& status) const {
-    const int n_args = 6;
-    size_t sizes[] = {sizeof(cl_mem),sizeof(uint),sizeof(uint),sizeof(uint),sizeof(cl_mem),sizeof(uint)*nThreads};
-    const void*  args[]  = {&base, &N, &constant1, &constant2, &blockErrorCount,NULL};
-    status = setKernelArgs(k_verify_paired_constants,n_args,sizes,args);
-    if (status != CL_SUCCESS) return -1;
-
-    size_t total_threads = nBlocks*nThreads;
-    size_t local_threads = nThreads;
-    status = clEnqueueNDRangeKernel(cq,k_verify_paired_constants,1,NULL,&total_threads,&local_threads,0,NULL,NULL);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing verifyPairedConstants kernel"<<endl; return (uint)-1;}
-    status = clEnqueueReadBuffer(cq,blockErrorCount,CL_TRUE,0,nBlocks*sizeof(uint),error_counts,0,NULL,NULL);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing verifyPairedConstants readback"<<endl; return (uint)-1;}
-
-    uint totalErrors = 0;
-    for (uint i = 0; i < nBlocks; i++) {
-         totalErrors += error_counts[i];
-    }
-    return totalErrors;
+uint memtestFunctions::verifyPairedConstants(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint constant1,const uint constant2,cl_mem blockErrorCount,cl_mem bitErrorCount,uint* error_counts,cl_int& status) const {
+    const uint params[] = {constant1,constant2};
+    cl_event event = launch(MT_VERIFY_PAIRED_CONSTANTS,nBlocks,nThreads,base,N,params,blockErrorCount,bitErrorCount,status);
+    if (status != CL_SUCCESS) return (uint)-1;
+    clReleaseEvent(event);
+    return readErrorCounts(nBlocks,blockErrorCount,error_counts,status);
 }
-uint memtestFunctions::verifyWalking32Bit(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const bool ones,const uint shift,cl_mem blockErrorCount,uint* error_counts,cl_int& status) const {
-    cl_int iones = (int)ones;
-    const int n_args = 6;
-    size_t sizes[] = {sizeof(cl_mem),sizeof(uint),sizeof(cl_int),sizeof(uint),sizeof(cl_mem),sizeof(uint)*nThreads};
-    const void*  args[]  = {&base, &N, &iones, &shift, &blockErrorCount,NULL};
-    status = setKernelArgs(k_verify_w32,n_args,sizes,args);
-    if (status != CL_SUCCESS) return -1;
-
-    size_t total_threads = nBlocks*nThreads;
-    size_t local_threads = nThreads;
-    clEnqueueNDRangeKernel(cq,k_verify_w32,1,NULL,&total_threads,&local_threads,0,NULL,NULL);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing verifyWalking32Bit kernel"<<endl; return (uint)-1;}
-    status = clEnqueueReadBuffer(cq,blockErrorCount,CL_TRUE,0,nBlocks*sizeof(uint),error_counts,0,NULL,NULL);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing verifyWalking32Bit readback"<<endl; return (uint)-1;}
-
-    uint totalErrors = 0;
-    for (uint i = 0; i < nBlocks; i++) {
-         totalErrors += error_counts[i];
-    }
-    return totalErrors;
+uint memtestFunctions::verifyWalking32Bit(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const bool ones,const uint shift,cl_mem blockErrorCount,cl_mem bitErrorCount,uint* error_counts,cl_int& status) const {
+    const uint params[] = {(uint)ones,shift};
+    cl_event event = launch(MT_VERIFY_W32,nBlocks,nThreads,base,N,params,blockErrorCount,bitErrorCount,status);
+    if (status != CL_SUCCESS) return (uint)-1;
+    clReleaseEvent(event);
+    return readErrorCounts(nBlocks,blockErrorCount,error_counts,status);
 }
-uint memtestFunctions::verifyRandomBlocks(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint seed,cl_mem blockErrorCount,uint* error_counts,cl_int& status) const {
-    const int n_args = 7;
-    size_t sizes[] = {sizeof(cl_mem),sizeof(uint),sizeof(uint),sizeof(cl_mem),sizeof(uint)*nThreads,sizeof(uint)*nThreads,sizeof(uint)*nThreads};
-    const void*  args[]  = {&base, &N, &seed, &blockErrorCount,NULL,NULL,NULL};
-    status = setKernelArgs(k_verify_random,n_args,sizes,args);
-    if (status != CL_SUCCESS) return -1;
-
-    size_t total_threads = nBlocks*nThreads;
-    size_t local_threads = nThreads;
-    clEnqueueNDRangeKernel(cq,k_verify_random,1,NULL,&total_threads,&local_threads,0,NULL,NULL);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing verifyRandomBlocks kernel"<<endl; return (uint)-1;}
-    status = clEnqueueReadBuffer(cq,blockErrorCount,CL_TRUE,0,nBlocks*sizeof(uint),error_counts,0,NULL,NULL);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing verifyRandomBlocks readback"<<endl; return (uint)-1;}
-
-    uint totalErrors = 0;
-    for (uint i = 0; i < nBlocks; i++) {
-         totalErrors += error_counts[i];
-    }
-    return totalErrors;
+uint memtestFunctions::verifyRandomBlocks(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint seed,cl_mem blockErrorCount,cl_mem bitErrorCount,uint* error_counts,cl_int& status) const {
+    cl_event event = launch(MT_VERIFY_RANDOM,nBlocks,nThreads,base,N,&seed,blockErrorCount,bitErrorCount,status);
+    if (status != CL_SUCCESS) return (uint)-1;
+    clReleaseEvent(event);
+    return readErrorCounts(nBlocks,blockErrorCount,error_counts,status);
 }
-uint memtestFunctions::verifyPairedModulo(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint shift,const uint pattern1,const uint modulus,cl_mem blockErrorCount,uint* error_counts,cl_int& status) const {
-    const int n_args = 7;
-    size_t sizes[] = {sizeof(cl_mem),sizeof(uint),sizeof(uint),sizeof(uint),sizeof(uint),sizeof(cl_mem),sizeof(uint)*nThreads};
-    const void* args[]  = {&base, &N, &shift, &pattern1, &modulus, &blockErrorCount,NULL};
-    status = setKernelArgs(k_verify_mod,n_args,sizes,args);
-    if (status != CL_SUCCESS) return -1;
-
-    size_t total_threads = nBlocks*nThreads;
-    size_t local_threads = nThreads;
-    clEnqueueNDRangeKernel(cq,k_verify_mod,1,NULL,&total_threads,&local_threads,0,NULL,NULL);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing verifyModuloX kernel"<<endl; return (uint)-1;}
-    status = clEnqueueReadBuffer(cq,blockErrorCount,CL_TRUE,0,nBlocks*sizeof(uint),error_counts,0,NULL,NULL);
-    if (status != CL_SUCCESS) {cout << "Error "<< descriptionOfError(status) <<" queueing verifyModuloX readback"<<endl; return (uint)-1;}
-
-    uint totalErrors = 0;
-    for (uint i = 0; i < nBlocks; i++) {
-         totalErrors += error_counts[i];
-    }
-    return totalErrors;
+uint memtestFunctions::verifyPairedModulo(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint shift,const uint pattern1,const uint modulus,cl_mem blockErrorCount,cl_mem bitErrorCount,uint* error_counts,cl_int& status) const {
+    const uint params[] = {shift,pattern1,modulus};
+    cl_event event = launch(MT_VERIFY_MOD,nBlocks,nThreads,base,N,params,blockErrorCount,bitErrorCount,status);
+    if (status != CL_SUCCESS) return (uint)-1;
+    clReleaseEvent(event);
+    return readErrorCounts(nBlocks,blockErrorCount,error_counts,status);
 }
 
 uint memtestMultiTester::allocate(uint mbToTest) {
@@ -644,8 +1289,16 @@ uint memtestMultiTester::allocate(uint mbToTest) {
         while (mbToTest > 0) {
             uint amount = allocation_unit < mbToTest ? allocation_unit : mbToTest;
             //cout << "Allocating new tester of "<<amount<<" MiB \n";
-            memtestState* tester = new memtestState(ctx,dev);
-            if (!tester->allocate(amount)) throw 1;
+            memtestState* tester = newTester();
+            tester->setRegionSize(region_mb);
+            tester->setEventLog(event_log);
+            tester->setLaunchLimit(launch_limit_ms);
+            tester->setHangFactor(hang_factor);
+            tester->setTrace(trace,(uint)testers.size());
+            if (!tester->allocate(amount)) {
+                delete tester;
+                throw 1;
+            }
             testers.push_back(tester);
             mbToTest -= amount;
         }
@@ -659,6 +1312,35 @@ uint memtestMultiTester::allocate(uint mbToTest) {
     //cout << "Allocated "<<totalmb<<" over "<<testers.size()<<" testers\n";
     return totalmb;
 }
+uint memtestMultiTester::setTestedSize(uint mb) {
+    if (mb == 0) mb = size();
+    mb &= ~1u;
+    for (list<memtestState*>::iterator i = testers.begin(); i != testers.end(); i++) {
+        const uint amount = mb < (*i)->size() ? mb : (*i)->size();
+        (*i)->setTestedSize(amount);
+        mb -= amount;
+    }
+    return tested();
+}
+uint memtestMultiTester::addChunk(uint mbToTest) {
+    uint amount = allocation_unit < mbToTest ? allocation_unit : mbToTest;
+    // Chunks are whole 2 MiB units; do not round up past the request
+    amount &= ~1u;
+    if (amount == 0) return 0;
+    memtestState* tester = newTester();
+    tester->setLCGPeriod(lcg_period);
+    tester->setRegionSize(region_mb);
+    tester->setEventLog(event_log);
+    tester->setLaunchLimit(launch_limit_ms);
+    tester->setHangFactor(hang_factor);
+    tester->setTrace(trace,(uint)testers.size());
+    if (!tester->allocate(amount)) {
+        delete tester;
+        return 0;
+    }
+    testers.push_back(tester);
+    return amount;
+}
 void memtestMultiTester::deallocate() {
     if (!isAllocated()) return;
     for (list<memtestState*>::iterator i = testers.begin(); i != testers.end(); i++) {
@@ -666,6 +1348,82 @@ void memtestMultiTester::deallocate() {
     }
     testers.clear();
 }
+bool memtestMultiTester::getBitErrors(unsigned long long* lanes) const {
+    bool ok = true;
+    for (int b = 0; b < MT_BIT_LANES; b++) lanes[b] = 0;
+    for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) {
+        unsigned long long chunkLanes[MT_BIT_LANES];
+        if (!(*i)->getBitErrors(chunkLanes)) ok = false;
+        for (int b = 0; b < MT_BIT_LANES; b++) lanes[b] += chunkLanes[b];
+    }
+    return ok;
+}
+bool memtestMultiTester::setLaunchLimit(uint ms) {
+    launch_limit_ms = ms;
+    bool ok = true;
+    for (list<memtestState*>::iterator i = testers.begin(); i != testers.end(); i++) {
+        if (!(*i)->setLaunchLimit(ms)) ok = false;
+    }
+    return ok;
+}
+void memtestMultiTester::setRegionSize(uint mb) {
+    region_mb = mb ? mb : 1;
+    for (list<memtestState*>::iterator i = testers.begin(); i != testers.end(); i++) (*i)->setRegionSize(region_mb);
+}
+void memtestMultiTester::getRegionErrors(vector<vector<unsigned long long> >& heatmap) const {
+    heatmap.clear();
+    for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) heatmap.push_back((*i)->getRegionErrors());
+}
+void memtestMultiTester::resetRegionErrors() {
+    for (list<memtestState*>::iterator i = testers.begin(); i != testers.end(); i++) (*i)->resetRegionErrors();
+}
+void memtestMultiTester::resetBitErrors() {
+    for (list<memtestState*>::iterator i = testers.begin(); i != testers.end(); i++) (*i)->resetBitErrors();
+}
+bool memtestMultiTester::selfTest(string& failure) {
+    if (!isAllocated()) {
+        failure = "no memory allocated";
+        return false;
+    }
+    for (list<memtestState*>::iterator i = testers.begin(); i != testers.end(); i++) {
+        if (!(*i)->selfTest(failure)) return false;
+    }
+    return true;
+}
+void memtestMultiTester::setRecording(vector<memtestChunkPlan>* plans) const {
+    recording = plans;
+    // A test that failed part way through a chunk leaves that chunk recording
+    if (plans == NULL) {
+        for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) (*i)->recording = NULL;
+    }
+}
+void memtestMultiTester::beginChunk(memtestChunkResult& r,uint chunk,const memtestState* tester,unsigned long long& startUs) const {
+    if (recording) {
+        recording->push_back(memtestChunkPlan(tester));
+        tester->recording = &recording->back().ops;
+    }
+    current_chunk = chunk;
+    tester->logTest = (unsigned short)r.method;
+    tester->logChunk = chunk;
+    r.chunk = chunk;
+    r.chunkMB = tester->tested();
+    r.bytes = tester->bytes_touched();
+    startUs = listeners.empty() ? 0 : getTimeMicroseconds();
+}
+void memtestMultiTester::endChunk(memtestChunkResult& r,const memtestState* tester,unsigned long long startUs,uint errorCount) const {
+    if (recording) {
+        tester->recording = NULL;
+        recording->back().result = r;
+        return;
+    }
+    if (listeners.empty()) return;
+    r.ms = (getTimeMicroseconds()-startUs)/1000.0;
+    r.bytes = tester->bytes_touched()-r.bytes;
+    r.errorCount = errorCount;
+    for (list<memtestListener*>::const_iterator l = listeners.begin(); l != listeners.end(); l++) {
+        (*l)->chunkDone(r);
+    }
+}
 bool memtestMultiTester::gpuMemoryBandwidth(double& bandwidth,uint mbToTest,uint iters) {
     if (!isAllocated()) return false;
     if (mbToTest > max_bandwidth_size()) return false;
@@ -675,10 +1433,16 @@ bool memtestMultiTester::gpuShortLCG0(uint& errorCount,const uint repeats) const
     uint partialErrorCount;
     bool status;
     errorCount = 0;
-    for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) {
+    memtestChunkResult r(MT_SHORT_LCG0);
+    r.addParam("repeats",repeats);
+    unsigned long long startUs;
+    uint chunk = first_chunk;
+    for (list<memtestState*>::const_iterator i = firstChunk(); moreChunks(i); i++, chunk++) {
+        beginChunk(r,chunk,*i,startUs);
         status = (*i)->gpuShortLCG0(partialErrorCount,repeats);
-        errorCount += partialErrorCount;
         if (!status) return false;
+        errorCount += partialErrorCount;
+        endChunk(r,*i,startUs,partialErrorCount);
     }
     return true;
 }
@@ -686,10 +1450,16 @@ bool memtestMultiTester::gpuShortLCG0Shmem(uint& errorCount,const uint repeats)
     uint partialErrorCount;
     bool status;
     errorCount = 0;
-    for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) {
+    memtestChunkResult r(MT_SHORT_LCG0_SHMEM);
+    r.addParam("repeats",repeats);
+    unsigned long long startUs;
+    uint chunk = first_chunk;
+    for (list<memtestState*>::const_iterator i = firstChunk(); moreChunks(i); i++, chunk++) {
+        beginChunk(r,chunk,*i,startUs);
         status = (*i)->gpuShortLCG0Shmem(partialErrorCount,repeats);
-        errorCount += partialErrorCount;
         if (!status) return false;
+        errorCount += partialErrorCount;
+        endChunk(r,*i,startUs,partialErrorCount);
     }
     return true;
 }
@@ -697,10 +1467,15 @@ bool memtestMultiTester::gpuMovingInversionsOnesZeros(uint& errorCount) const {
     uint partialErrorCount;
     bool status;
     errorCount = 0;
-    for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) {
+    memtestChunkResult r(MT_MOVING_INVERSIONS_ONES_ZEROS);
+    unsigned long long startUs;
+    uint chunk = first_chunk;
+    for (list<memtestState*>::const_iterator i = firstChunk(); moreChunks(i); i++, chunk++) {
+        beginChunk(r,chunk,*i,startUs);
         status = (*i)->gpuMovingInversionsOnesZeros(partialErrorCount);
-        errorCount += partialErrorCount;
         if (!status) return false;
+        errorCount += partialErrorCount;
+        endChunk(r,*i,startUs,partialErrorCount);
     }
     return true;
 }
@@ -708,10 +1483,16 @@ bool memtestMultiTester::gpuWalking8BitM86(uint& errorCount,const uint shift) co
     uint partialErrorCount;
     bool status;
     errorCount = 0;
-    for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) {
+    memtestChunkResult r(MT_WALKING_8BIT_M86);
+    r.addParam("shift",shift);
+    unsigned long long startUs;
+    uint chunk = first_chunk;
+    for (list<memtestState*>::const_iterator i = firstChunk(); moreChunks(i); i++, chunk++) {
+        beginChunk(r,chunk,*i,startUs);
         status = (*i)->gpuWalking8BitM86(partialErrorCount,shift);
-        errorCount += partialErrorCount;
         if (!status) return false;
+        errorCount += partialErrorCount;
+        endChunk(r,*i,startUs,partialErrorCount);
     }
     return true;
 }
@@ -719,10 +1500,17 @@ bool memtestMultiTester::gpuWalking8Bit(uint& errorCount,const bool ones,const u
     uint partialErrorCount;
     bool status;
     errorCount = 0;
-    for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) {
+    memtestChunkResult r(MT_WALKING_8BIT);
+    r.addParam("ones",ones);
+    r.addParam("shift",shift);
+    unsigned long long startUs;
+    uint chunk = first_chunk;
+    for (list<memtestState*>::const_iterator i = firstChunk(); moreChunks(i); i++, chunk++) {
+        beginChunk(r,chunk,*i,startUs);
         status = (*i)->gpuWalking8Bit(partialErrorCount,ones,shift);
-        errorCount += partialErrorCount;
         if (!status) return false;
+        errorCount += partialErrorCount;
+        endChunk(r,*i,startUs,partialErrorCount);
     }
     return true;
 }
@@ -731,11 +1519,17 @@ bool memtestMultiTester::gpuMovingInversionsRandom(uint& errorCount) const {
     bool status;
     errorCount = 0;
     uint pattern = (uint)rand();
+    memtestChunkResult r(MT_MOVING_INVERSIONS_RANDOM);
+    r.addParam("pattern",pattern);
+    unsigned long long startUs;
+    uint chunk = first_chunk;
     // This one is different from the rest to preserve semantics of test
-    for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) {
+    for (list<memtestState*>::const_iterator i = firstChunk(); moreChunks(i); i++, chunk++) {
+        beginChunk(r,chunk,*i,startUs);
         status = (*i)->gpuMovingInversionsPattern(partialErrorCount,pattern);
-        errorCount += partialErrorCount;
         if (!status) return false;
+        errorCount += partialErrorCount;
+        endChunk(r,*i,startUs,partialErrorCount);
     }
     return true;
 }
@@ -743,10 +1537,17 @@ bool memtestMultiTester::gpuWalking32Bit(uint& errorCount,const bool ones,const
     uint partialErrorCount;
     bool status;
     errorCount = 0;
-    for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) {
+    memtestChunkResult r(MT_WALKING_32BIT);
+    r.addParam("ones",ones);
+    r.addParam("shift",shift);
+    unsigned long long startUs;
+    uint chunk = first_chunk;
+    for (list<memtestState*>::const_iterator i = firstChunk(); moreChunks(i); i++, chunk++) {
+        beginChunk(r,chunk,*i,startUs);
         status = (*i)->gpuWalking32Bit(partialErrorCount,ones,shift);
-        errorCount += partialErrorCount;
         if (!status) return false;
+        errorCount += partialErrorCount;
+        endChunk(r,*i,startUs,partialErrorCount);
     }
     return true;
 }
@@ -754,10 +1555,16 @@ bool memtestMultiTester::gpuRandomBlocks(uint& errorCount,const uint seed) const
     uint partialErrorCount;
     bool status;
     errorCount = 0;
-    for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) {
+    memtestChunkResult r(MT_RANDOM_BLOCKS);
+    r.addParam("seed",seed);
+    unsigned long long startUs;
+    uint chunk = first_chunk;
+    for (list<memtestState*>::const_iterator i = firstChunk(); moreChunks(i); i++, chunk++) {
+        beginChunk(r,chunk,*i,startUs);
         status = (*i)->gpuRandomBlocks(partialErrorCount,seed);
-        errorCount += partialErrorCount;
         if (!status) return false;
+        errorCount += partialErrorCount;
+        endChunk(r,*i,startUs,partialErrorCount);
     }
     return true;
 }
@@ -765,14 +1572,65 @@ bool memtestMultiTester::gpuModuloX(uint& errorCount,const uint shift,const uint
     uint partialErrorCount;
     bool status;
     errorCount = 0;
-    for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) {
+    memtestChunkResult r(MT_MODULO_X);
+    r.addParam("shift",shift);
+    r.addParam("pattern",pattern);
+    r.addParam("modulus",modulus);
+    r.addParam("overwrite_iters",overwriteIters);
+    unsigned long long startUs;
+    uint chunk = first_chunk;
+    for (list<memtestState*>::const_iterator i = firstChunk(); moreChunks(i); i++, chunk++) {
+        beginChunk(r,chunk,*i,startUs);
         status = (*i)->gpuModuloX(partialErrorCount,shift,pattern,modulus,overwriteIters);
-        errorCount += partialErrorCount;
         if (!status) return false;
+        errorCount += partialErrorCount;
+        endChunk(r,*i,startUs,partialErrorCount);
     }
     return true;
 }
 
+// Test registry {{{
+static bool runMovingInversionsOnesZeros(memtestMultiTester* t,uint,uint& e) {return t->gpuMovingInversionsOnesZeros(e);}
+static bool runMovingInversionsRandom(memtestMultiTester* t,uint,uint& e) {return t->gpuMovingInversionsRandom(e);}
+static bool runWalking8BitM86(memtestMultiTester* t,uint shift,uint& e) {return t->gpuWalking8BitM86(e,shift);}
+static bool runWalkingZeros8Bit(memtestMultiTester* t,uint shift,uint& e) {return t->gpuWalking8Bit(e,false,shift);}
+static bool runWalkingOnes8Bit(memtestMultiTester* t,uint shift,uint& e) {return t->gpuWalking8Bit(e,true,shift);}
+static bool runWalkingZeros32Bit(memtestMultiTester* t,uint shift,uint& e) {return t->gpuWalking32Bit(e,false,shift);}
+static bool runWalkingOnes32Bit(memtestMultiTester* t,uint shift,uint& e) {return t->gpuWalking32Bit(e,true,shift);}
+static bool runRandomBlocks(memtestMultiTester* t,uint,uint& e) {return t->gpuRandomBlocks(e,rand());}
+static bool runModulo20(memtestMultiTester* t,uint shift,uint& e) {return t->gpuModuloX(e,shift,rand(),20,2);}
+static bool runLogic1(memtestMultiTester* t,uint,uint& e) {return t->gpuShortLCG0(e,1);}
+static bool runLogic4(memtestMultiTester* t,uint,uint& e) {return t->gpuShortLCG0(e,4);}
+static bool runLogicShmem1(memtestMultiTester* t,uint,uint& e) {return t->gpuShortLCG0Shmem(e,1);}
+static bool runLogicShmem4(memtestMultiTester* t,uint,uint& e) {return t->gpuShortLCG0Shmem(e,4);}
+
+// Passes count one per write or verify kernel, except that the modulo write kernel
+// overwrites the region twice per pattern and the logic kernels count each repeat.
+// The logic tests check their results with the constant family's verify kernel.
+const memtestTestInfo memtestTests[] = {
+    {"Moving inversions (ones and zeros)",    "movinv",        1, 4, 0x01, runMovingInversionsOnesZeros},
+    {"Moving inversions (random)",            "movinv-random", 1, 4, 0x01, runMovingInversionsRandom},
+    {"Memtest86 walking 8-bit",               "walk8-m86",     8, 4, 0x01, runWalking8BitM86},
+    {"True walking zeros (8-bit)",            "walk0-8",       8, 2, 0x04, runWalkingZeros8Bit},
+    {"True walking ones (8-bit)",             "walk1-8",       8, 2, 0x04, runWalkingOnes8Bit},
+    {"True walking zeros (32-bit)",           "walk0-32",     32, 2, 0x08, runWalkingZeros32Bit},
+    {"True walking ones (32-bit)",            "walk1-32",     32, 2, 0x08, runWalkingOnes32Bit},
+    {"Random blocks",                         "random",        1, 2, 0x10, runRandomBlocks},
+    {"Memtest86 Modulo-20",                   "mod20",        20, 6, 0x20, runModulo20},
+    {"Integer logic",                         "logic",         1, 2, 0x03, runLogic1},
+    {"Integer logic (4 loops)",               "logic4",        1, 5, 0x03, runLogic4},
+    {"Integer logic (local memory)",          "logic-local",   1, 2, 0x03, runLogicShmem1},
+    {"Integer logic (4 loops, local memory)", "logic4-local",  1, 5, 0x03, runLogicShmem4}
+};
+const int memtestNTests = sizeof(memtestTests)/sizeof(memtestTests[0]);
+
+int memtestFindTest(const string& keyOrName) {
+    for (int t = 0; t < memtestNTests; t++)
+        if (keyOrName == memtestTests[t].key || keyOrName == memtestTests[t].name) return t;
+    return -1;
+}
+//}}}
+
 uint memtestMultiContextTester::allocate(uint mbToTest) {	
     uint totalmb = mbToTest;
     if (totalmb & 1) totalmb++;
@@ -820,6 +1678,7 @@ const char* descriptionOfError (cl_int err) { //{{{
         case CL_BUILD_PROGRAM_FAILURE:              return "Program build failure";
         case CL_MAP_FAILURE:                        return "Map failure";
         case CL_INVALID_VALUE:                      return "Invalid value";
+        case MT_TIMEOUT:                            return "Timed out waiting for the device";
         case CL_INVALID_DEVICE_TYPE:                return "Invalid device type";
         case CL_INVALID_PLATFORM:                   return "Invalid platform";
         case CL_INVALID_DEVICE:                     return "Invalid device";
@@ -17,6 +17,7 @@
 #include <stdio.h>
 #include <iostream>
 #include <list>
+#include <vector>
 using namespace std;
 
 #if defined (WINDOWS) || defined (WINNV)
@@ -24,8 +25,22 @@ using namespace std;
     inline unsigned int getTimeMilliseconds(void) {
         return GetTickCount();
     }
+    inline unsigned long long getTimeMicroseconds(void) {
+        LARGE_INTEGER freq,count;
+        QueryPerformanceFrequency(&freq);
+        QueryPerformanceCounter(&count);
+        return (unsigned long long)(count.QuadPart*1000000.0/freq.QuadPart);
+    }
+    // Microseconds since the Unix epoch
+    inline unsigned long long getWallClockMicroseconds(void) {
+        FILETIME ft;
+        GetSystemTimeAsFileTime(&ft);
+        const unsigned long long ticks = ((unsigned long long)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+        return (ticks - 116444736000000000ULL)/10;
+    }
     #include <windows.h>
 	#define SLEEPMS(x) Sleep(x)
+	#define SLEEPUS(x) Sleep((x)/1000)
 #elif defined (LINUX) || defined (OSX)
     #include <sys/time.h>
     inline unsigned int getTimeMilliseconds(void) {
@@ -33,8 +48,16 @@ using namespace std;
         gettimeofday(&tv,NULL);
         return tv.tv_sec*1000 + tv.tv_usec/1000;
     }
+    inline unsigned long long getTimeMicroseconds(void) {
+        struct timeval tv;
+        gettimeofday(&tv,NULL);
+        return tv.tv_sec*1000000ULL + tv.tv_usec;
+    }
+    // Microseconds since the Unix epoch
+    inline unsigned long long getWallClockMicroseconds(void) {return getTimeMicroseconds();}
     #include <unistd.h>
     #define SLEEPMS(x) usleep(x*1000)
+    #define SLEEPUS(x) usleep(x)
 #else
     #error Must #define LINUX, WINDOWS, WINNV, or OSX
 #endif
@@ -45,32 +68,80 @@ using namespace std;
    #include <CL/opencl.h>
 #endif
 
-cl_int softwaitForEvents(cl_uint num_events,const cl_event* event_list,cl_command_queue const* pcq=NULL,unsigned sleeplength=1,unsigned limit=15000);
+// Waits for the events (and releases them), polling every sleeplength ms; returns MT_TIMEOUT
+// if they have not all completed after limit ms
+const unsigned MT_WAIT_LIMIT_MS = 15000;
+const cl_int MT_TIMEOUT = -9001;
+cl_int softwaitForEvents(cl_uint num_events,const cl_event* event_list,cl_command_queue const* pcq=NULL,unsigned sleeplength=1,unsigned limit=MT_WAIT_LIMIT_MS);
+// Total time spent in softwaitForEvents by all threads
+unsigned long long softwaitMicroseconds();
 
 
 const char* descriptionOfError (cl_int err);
 typedef unsigned int uint;
 
+// Device kernels used by the memory tests, in the order of memtestFunctions::kernels.
+// Scalar kernel parameters are passed as an array of uints in kernel argument order.
+enum memtestKernel {
+    MT_WRITE_CONSTANT, MT_VERIFY_CONSTANT,
+    MT_LOGIC, MT_LOGIC_SHARED,
+    MT_WRITE_PAIRED_CONSTANTS, MT_VERIFY_PAIRED_CONSTANTS,
+    MT_WRITE_W32, MT_VERIFY_W32,
+    MT_WRITE_RANDOM, MT_VERIFY_RANDOM,
+    MT_WRITE_MOD, MT_VERIFY_MOD,
+    MT_N_KERNELS
+};
+const char* kernelName(memtestKernel k);
+bool isVerifyKernel(memtestKernel k);
+// Number of scalar parameters the kernel takes (at most 5)
+int kernelParamCount(memtestKernel k);
+// Kernels come in families of one test's write and verify kernels, each compiled as a
+// program of its own; bit f of a family mask stands for family f
+const int MT_N_FAMILIES = MT_N_KERNELS/2;
+const uint MT_ALL_FAMILIES = (1u << MT_N_FAMILIES)-1;
+inline int kernelFamily(memtestKernel k) {return (int)k/2;}
+// Bit positions of a tested word: the bins of the per-bit-lane error histogram
+const int MT_BIT_LANES = 32;
+
+class memtestPrograms;
+
 // Low-level OO interface to MemtestCL functions
 class memtestFunctions { //{{{
 protected:
     cl_context ctx;
     cl_device_id dev;
     cl_command_queue cq;
-    cl_program code;
-    static const int n_kernels = 12;
-    cl_kernel kernels[n_kernels];
-    cl_kernel &k_write_constant, &k_verify_constant;
-    cl_kernel &k_logic,&k_logic_shared;
-    cl_kernel &k_write_paired_constants,&k_verify_paired_constants;
-    cl_kernel &k_write_w32,&k_verify_w32;
-    cl_kernel &k_write_random,&k_verify_random;
-    cl_kernel &k_write_mod,&k_verify_mod;
-    cl_int setKernelArgs(cl_kernel& kernel,const int n_args,const size_t* sizes,const void** args) const;
+    // Shared with every memtestFunctions on the same context and device
+    memtestPrograms* programs;
+    uint prepared;
+    static const int n_kernels = MT_N_KERNELS;
+    // Created on first use, once the kernel's family has been built
+    mutable cl_kernel kernels[n_kernels];
+    cl_kernel kernel(const memtestKernel k) const;
+    cl_int setKernelArgs(const cl_kernel& kernel,const int n_args,const size_t* sizes,const void** args) const;
 public:
     memtestFunctions(cl_context context,cl_device_id device,cl_command_queue q);
     ~memtestFunctions();
+    // Starts building the programs of the given families, each on a thread of its own, and
+    // returns at once. A kernel's first launch waits for its own family only, building it
+    // then if it was not prepared.
+    void prepare(uint families);
+    uint prepared_families() const {return prepared;}
+    // Largest work-group size all kernels of the prepared families (or of all families,
+    // if none were) can run with; waits for those families to be built
     uint max_workgroup_size() const;
+    // Whether the verify kernels count errors per bit lane on this device (they need 32-bit
+    // atomics); if not, bitErrorCount is left untouched
+    bool bit_lanes_supported() const;
+    // Generic entry points used by the execution backends: enqueue any test kernel, and
+    // sum-reduce the per-block error counts left behind by a verify kernel. Verify kernels
+    // also add the errors in each bit lane into the MT_BIT_LANES words of bitErrorCount.
+    // A launch of nBlocks work-groups from firstBlock on addresses and numbers the memory
+    // as if base began at work-group firstBlock.
+    cl_event launch(const memtestKernel k,const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint* params,cl_mem blockErrorCount,cl_mem bitErrorCount,cl_int& status,uint firstBlock=0) const;
+    // The argument setting half of launch(), on its own so that its cost can be measured
+    cl_int setLaunchArgs(const memtestKernel k,const uint nThreads,cl_mem base,uint N,const uint* params,cl_mem blockErrorCount,cl_mem bitErrorCount,uint firstBlock=0) const;
+    uint readErrorCounts(const uint nBlocks,cl_mem blockErrorCount,uint* error_counts,cl_int& status) const;
     cl_event writeConstant(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint constant,cl_int& status) const;
     cl_event writePairedConstants(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint constant1,const uint constant2,cl_int& status) const;
     cl_event writeWalking32Bit(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const bool ones,const uint shift,cl_int& status) const;
@@ -78,49 +149,272 @@ public:
     cl_event writePairedModulo(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint shift,const uint pattern1, const uint pattern2, const uint modulus,const uint iters,cl_int& status) const;
     cl_event shortLCG0(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint repeats,const uint period,cl_int& status) const;
     cl_event shortLCG0Shmem(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint repeats,const uint period,cl_int& status) const;
-    uint verifyConstant(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint constant,cl_mem blockErrorCount,uint* error_counts,cl_int& status) const;
-    uint verifyPairedConstants(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint constant1,const uint constant2,cl_mem blockErrorCount,uint* error_counts,cl_int& status) const;
-    uint verifyWalking32Bit(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const bool ones,const uint shift,cl_mem blockErrorCount,uint* error_counts,cl_int& status) const;
-    uint verifyRandomBlocks(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint seed,cl_mem blockErrorCount,uint* error_counts,cl_int& status) const;
-    uint verifyPairedModulo(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint shift,const uint pattern1,const uint modulus,cl_mem blockErrorCount,uint* error_counts,cl_int& status) const;
+    uint verifyConstant(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint constant,cl_mem blockErrorCount,cl_mem bitErrorCount,uint* error_counts,cl_int& status) const;
+    uint verifyPairedConstants(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint constant1,const uint constant2,cl_mem blockErrorCount,cl_mem bitErrorCount,uint* error_counts,cl_int& status) const;
+    uint verifyWalking32Bit(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const bool ones,const uint shift,cl_mem blockErrorCount,cl_mem bitErrorCount,uint* error_counts,cl_int& status) const;
+    uint verifyRandomBlocks(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint seed,cl_mem blockErrorCount,cl_mem bitErrorCount,uint* error_counts,cl_int& status) const;
+    uint verifyPairedModulo(const uint nBlocks,const uint nThreads,cl_mem base,uint N,const uint shift,const uint pattern1,const uint modulus,cl_mem blockErrorCount,cl_mem bitErrorCount,uint* error_counts,cl_int& status) const;
 
 }; //}}}
 
-// OO interface to MemtestCL functions
-class memtestState { //{{{
-    friend class memtestMultiTester;
+class memtestTrace;
+
+// Execution backend underneath memtestState. A backend owns the test region and the
+// per-block error count buffer for one chunk of memory, and runs test kernels over them.
+// Launches may be asynchronous; wait() and readCounts() synchronize with the device.
+class memtestBackend { //{{{
+public:
+    virtual ~memtestBackend() {}
+    virtual const char* name() const = 0;
+    // Preferred launch geometry (work-groups, work-items per group) for this device
+    virtual void geometry(uint& nBlocks,uint& nThreads) const = 0;
+    // Largest single allocation supported by the device, in MiB
+    virtual uint max_allocation() const = 0;
+    // Starts compiling the kernels of the given families ahead of their first launch;
+    // geometry() then fits the kernels prepared so far
+    virtual void prepare(uint families) {}
+    virtual cl_int allocate(uint megs,uint nBlocks,uint nThreads) = 0;
+    virtual void deallocate() = 0;
+    // Enqueue a test kernel over the whole region with N words per work-item
+    virtual cl_int launch(memtestKernel k,uint N,const uint* params) = 0;
+    // Enqueue a test kernel over work-groups [firstBlock,firstBlock+blocks) only, addressing
+    // memory as if the region began at firstBlock; a verify kernel leaves its counts in the
+    // first blocks entries of the count buffer
+    virtual cl_int launchRange(memtestKernel k,uint N,const uint* params,uint firstBlock,uint blocks) = 0;
+    // Whether launchRange() can run part of the region
+    virtual bool canLaunchRange() const {return true;}
+    // Longest time in ms that wait() and the reads wait for launched work before giving up
+    // with MT_TIMEOUT, as they do on a hung kernel
+    virtual void setWaitLimit(unsigned ms) {}
+    // Throws away everything on the device after a hang or device fault and creates it
+    // again, allocated as before; the region's contents and error counts are lost
+    virtual cl_int recover() {return CL_INVALID_OPERATION;}
+    // Records each command on the device, once complete, as a span on the given DEVICE
+    // track of the trace (not owned); NULL to stop
+    virtual void setTrace(memtestTrace* trace,uint track) {}
+    // Enqueue a copy of the first bytes of the region onto the following bytes
+    virtual cl_int launchCopy(size_t bytes) = 0;
+    // Block until all launched work has completed
+    virtual cl_int wait() = 0;
+    // Without blocking, set done once all launched work has completed
+    virtual cl_int poll(bool& done) = 0;
+    // Read back the per-block error counts left by the last verify kernel
+    virtual cl_int readCounts(uint* counts) = 0;
+    // Enqueue that readback without blocking, once the verify kernel has completed;
+    // counts must stay valid until poll() reports completion
+    virtual cl_int launchReadCounts(uint* counts) = 0;
+    // Blocking host access to words of the test region, in words from its start
+    virtual cl_int readWords(size_t offset,size_t count,uint* dst) = 0;
+    virtual cl_int writeWords(size_t offset,size_t count,const uint* src) = 0;
+    // Blocking read of the MT_BIT_LANES per-bit-lane error counts that verify kernels have
+    // accumulated since allocation or the last read, which clears them. Returns
+    // CL_INVALID_OPERATION if the device cannot count errors per bit lane.
+    virtual cl_int readBitErrors(uint* lanes) = 0;
+}; //}}}
+
+// OpenCL implementation of memtestBackend, built on memtestFunctions
+class memtestCLBackend : public memtestBackend { //{{{
 protected:
     cl_context ctx;
     cl_device_id dev;
     cl_command_queue cq;
-    memtestFunctions memtest;
+    bool cq_owned;
+    memtestFunctions* memtest;  // NULL, as is cq, after a recover() that failed to make a queue
+    uint preparedFamilies;      // kernel families to build again after recover()
+    uint allocatedMegs;
+    unsigned waitLimit;
+    uint nBlocks;
+    uint nThreads;
+    cl_mem devTestMem;
+    cl_mem devTempMem;
+    cl_mem devBitMem;
+    bool allocated;
+    list<cl_event> pending;
+    // Commands to be traced once complete, from their OpenCL profiling times where the
+    // queue has profiling enabled
+    struct tracedCommand {
+        cl_event event;
+        const char* name;
+        unsigned long long enqueuedUs;
+    };
+    memtestTrace* trace;
+    uint traceTrack;
+    bool profiling;
+    list<tracedCommand> traced;
+    void enqueued(cl_event event,const char* name);
+    void traceCompleted();
+public:
+    memtestCLBackend(cl_context context,cl_device_id device);
+    // Runs on the caller's queue, which must be in order
+    memtestCLBackend(cl_context context,cl_device_id device,cl_command_queue queue);
+    virtual ~memtestCLBackend();
+    virtual const char* name() const {return "OpenCL";}
+    virtual void geometry(uint& nBlocks,uint& nThreads) const;
+    virtual uint max_allocation() const;
+    virtual void prepare(uint families);
+    virtual cl_int allocate(uint megs,uint nBlocks,uint nThreads);
+    virtual void deallocate();
+    virtual cl_int launch(memtestKernel k,uint N,const uint* params);
+    virtual cl_int launchRange(memtestKernel k,uint N,const uint* params,uint firstBlock,uint blocks);
+    virtual void setWaitLimit(unsigned ms) {waitLimit = ms;}
+    // Moves to a queue of its own with profiling enabled, unless running on the caller's
+    virtual void setTrace(memtestTrace* trace,uint track);
+    // Runs on a new context and queue of its own afterwards. On the caller's queue it
+    // fails with CL_INVALID_COMMAND_QUEUE instead, leaving the queue and context alone.
+    virtual cl_int recover();
+    virtual cl_int launchCopy(size_t bytes);
+    virtual cl_int wait();
+    virtual cl_int poll(bool& done);
+    virtual cl_int readCounts(uint* counts);
+    virtual cl_int launchReadCounts(uint* counts);
+    virtual cl_int readWords(size_t offset,size_t count,uint* dst);
+    virtual cl_int writeWords(size_t offset,size_t count,const uint* src);
+    virtual cl_int readBitErrors(uint* lanes);
+}; //}}}
+
+class memtestEventLog;
+
+// One kernel launch of a test; verify kernels add to the test's error count
+struct memtestOp {
+    memtestKernel kernel;
+    uint params[5];
+};
+
+// OO interface to MemtestCL functions
+class memtestState { //{{{
+    friend class memtestMultiTester;
+    friend class memtestAsyncTest;
+    friend class memtestSliceTest;
+protected:
+    memtestBackend* backend;
 	uint nBlocks;
 	uint nThreads;
     uint loopFactor;
     uint loopIters;
 	uint megsToTest;
     int lcgPeriod;
-	cl_mem devTestMem;
-	cl_mem devTempMem;
 	bool allocated;
 	uint* hostTempMem;
+    mutable unsigned long long bytesTouched;
+    // Incorrect bits found in each bit lane; the device accumulates counts in between
+    mutable unsigned long long bitErrors[MT_BIT_LANES];
+    mutable bool bitLanes;
+    // Moves the device's bit-lane counts into bitErrors; called after verifies that found errors
+    bool collectBitErrors() const;
+    // Errors found in each regionMB MiB of the region, from the per-work-group counts
+    uint regionMB;
+    mutable vector<unsigned long long> regionErrors;
+    // Adds the counts of work-groups [firstBlock,firstBlock+blocks) of the last verify
+    void addRegionErrors(const uint* counts,uint firstBlock,uint blocks) const;
+    // While set, write() and verify() append their launches here instead of running them
+    mutable vector<memtestOp>* recording;
+    // Records every launch and completion when set; logTest and logChunk identify the
+    // test and chunk running (see memtestMultiTester::beginChunk)
+    memtestEventLog* eventLog;
+    mutable unsigned short logTest;
+    mutable uint logChunk;
+    // Kernel families of the tests to be run: prepared at construction, and self-tested
+    uint kernelFamilies;
+    // When set, write() and verify() split each kernel into launches over slices of the
+    // work-groups, sized from its measured time per work-group and word to take about
+    // half of this
+    unsigned long long launchLimitUs;
+    mutable double usPerBlockWord[MT_N_KERNELS];
+    bool launchSplit(const memtestKernel k,const uint* params,uint* errorCount) const;
+    // Hang detection: a kernel still running hangFactor times longer than it took before
+    // (but at least a second) is taken for hung, and after a hang or any other failure the
+    // device state is recreated; 0 leaves waits at their 15 s limit and failures final
+    double hangFactor;
+    mutable unsigned long long faults;
+    // Host side of each launch (enqueue and wait) and the split and fault decisions go
+    // to the calling thread's track; the backend traces the device side on traceTrack
+    memtestTrace* trace;
+    uint traceTrack;
+    unsigned hangLimitMs(const memtestKernel k,uint blocks) const;
+    // Runs k over work-groups [firstBlock,firstBlock+blocks) and waits for it, reading a
+    // verify's counts into hostTempMem; times it, and handles its failure as a device fault
+    cl_int runKernel(const memtestKernel k,const uint* params,uint firstBlock,uint blocks) const;
+    void deviceFault(const memtestKernel k,const uint* params,uint blocks,cl_int status,unsigned long long waitedUs) const;
+    // A zero random seed makes each work-group seed itself from its index, so that such
+    // launches can only be split into single work-groups
+    static bool seedsPerBlock(const memtestKernel k,const uint* params) {
+        return (k == MT_WRITE_RANDOM || k == MT_VERIFY_RANDOM) && params[0] == 0;
+    }
+    // Adjusts the parameters of a launch over the work-groups from firstBlock on, which the
+    // kernels address and number as if the region began there, to give the whole-region result
+    void sliceParams(const memtestKernel k,uint* params,uint firstBlock) const;
+    // Event log records around a launch of k over blocks work-groups; logLaunch returns
+    // the start time that logKernel takes. Both do nothing without a log.
+    unsigned long long logLaunch(const memtestKernel k,const uint* params,uint blocks) const;
+    void logKernel(const memtestKernel k,const uint* params,uint blocks,unsigned long long startUs,uint errorCount) const;
+    void init();
+    unsigned long long opBytes(const memtestKernel k,const uint* params) const {return opBytes(k,params,(unsigned long long)nBlocks*nThreads*loopIters);}
+    bool write(const memtestKernel k,const uint* params) const;
+    bool verify(uint& errorCount,const memtestKernel k,const uint* params) const;
 	bool writeConstant(const uint constant) const;
 	bool verifyConstant(uint& errorCount,const uint constant) const;
 	bool gpuMovingInversionsPattern(uint& errorCount,const uint pattern) const;
 public:
     uint initTime;
-	memtestState(cl_context context, cl_device_id device);
+	memtestState(cl_context context, cl_device_id device, uint families=MT_ALL_FAMILIES);
+	memtestState(cl_context context, cl_device_id device, cl_command_queue queue, uint families=MT_ALL_FAMILIES);
+    // Takes ownership of the backend
+    memtestState(memtestBackend* be, uint families=MT_ALL_FAMILIES);
     ~memtestState();
 
+    // Device memory read and written by a launch of k over a region of words words
+    static unsigned long long opBytes(const memtestKernel k,const uint* params,unsigned long long words);
+
 	uint allocate(uint mbToTest);
 	void deallocate();
 	bool isAllocated() const {return allocated;}
 	uint size() const {return megsToTest;}
+    // Restricts the tests to the first megs MiB of the region (in 2 MiB units) without
+    // reallocating; tested() is the MiB the tests cover, which allocate() resets to size()
+    void setTestedSize(uint megs);
+    uint tested() const {return loopIters/loopFactor*2;}
     void setLCGPeriod(int period) {lcgPeriod = period;}
     int getLCGPeriod() const {return lcgPeriod;}
+    // Splits every kernel into launches that should each take at most ms milliseconds, so
+    // that the watchdog of a GPU driving a display does not abort them; 0 launches each
+    // kernel over the whole region. False (and no splitting) if the backend cannot.
+    bool setLaunchLimit(uint ms);
+    uint getLaunchLimit() const {return (uint)(launchLimitUs/1000);}
+    // See hangFactor above. A test that hit a device fault still fails, but can be run again.
+    void setHangFactor(double factor) {hangFactor = factor;}
+    // Device faults recovered from so far
+    unsigned long long deviceFaults() const {return faults;}
+    // Not owned by the tester; NULL to stop logging
+    void setEventLog(memtestEventLog* log) {eventLog = log;}
+    // Not owned by the tester; NULL to stop tracing
+    void setTrace(memtestTrace* t,uint track);
     uint max_bandwidth_size() const {return megsToTest/2;}
     uint workgroup_size() const {return nThreads;}
+    memtestBackend* getBackend() const {return backend;}
+    // Device memory read and written by the tests so far
+    unsigned long long bytes_touched() const {return bytesTouched;}
+    // Incorrect bits found in each of the MT_BIT_LANES bit positions of the tested words
+    // since allocation or the last reset. Errors concentrated in one lane point at a stuck
+    // data line or a bad DQ pin. False if the counts could not be read.
+    bool getBitErrors(unsigned long long* lanes) const;
+    void resetBitErrors();
+    // Whether the device counts errors per bit lane; if not, getBitErrors() returns zeros
+    bool hasBitErrors() const {return bitLanes;}
+    // Error heatmap: incorrect bits found in each mb MiB region of the test region since
+    // allocation or the last reset, in address order. It is built from the per-work-group
+    // counts every verify already reads back, so it costs no extra kernels; a work-group
+    // covers tested()/nBlocks of memory, which bounds the resolution. Setting the region
+    // size resets the counts.
+    void setRegionSize(uint mb);
+    uint getRegionSize() const {return regionMB;}
+    const vector<unsigned long long>& getRegionErrors() const {return regionErrors;}
+    void resetRegionErrors() {regionErrors.assign(regionErrors.size(),0);}
 
+    // Checks that every verify kernel of the tester's kernel families counts exactly the bits
+    // flipped by host writes between a write kernel and its verify kernel, using the first
+    // 2 MiB of the test region. Returns false and describes the problem in failure if any
+    // count is wrong.
+    bool selfTest(string& failure);
     bool gpuMemoryBandwidth(double& bandwidth,uint mbToTest,uint iters=5);
 	bool gpuShortLCG0(uint& errorCount,const uint repeats) const;
 	bool gpuShortLCG0Shmem(uint& errorCount,const uint repeats) const;
@@ -133,27 +427,118 @@ public:
 	bool gpuModuloX(uint& errorCount,const uint shift,const uint pattern,const uint modulus,const uint overwriteIters) const;
 }; //}}}
 
+// memtestMultiTester test methods, numbered as in the test field of event log records
+enum memtestMethod {
+    MT_SHORT_LCG0, MT_SHORT_LCG0_SHMEM, MT_MOVING_INVERSIONS_ONES_ZEROS, MT_WALKING_8BIT_M86, MT_WALKING_8BIT,
+    MT_MOVING_INVERSIONS_RANDOM, MT_WALKING_32BIT, MT_RANDOM_BLOCKS, MT_MODULO_X,
+    MT_N_METHODS
+};
+// Name of the method, e.g. "gpuWalking32Bit"; empty for MT_N_METHODS
+const char* methodName(memtestMethod m);
+
+// Result of one test on one chunk of a memtestMultiTester
+struct memtestChunkResult {
+    memtestMethod method;
+    const char* test;           // methodName(method)
+    uint chunk;
+    uint chunkMB;
+    int nParams;
+    const char* paramNames[4];
+    uint params[4];
+    uint errorCount;
+    double ms;
+    unsigned long long bytes;   // device memory read and written
+    memtestChunkResult(memtestMethod m) : method(m), test(methodName(m)), chunk(0), chunkMB(0), nParams(0), errorCount(0), ms(0), bytes(0) {}
+    void addParam(const char* name,uint value) {paramNames[nParams] = name; params[nParams++] = value;}
+};
+
+// Kernel launches of a test on one chunk, recorded instead of run (see memtestAsyncTest)
+struct memtestChunkPlan {
+    const memtestState* tester;
+    memtestChunkResult result;  // test name and parameters
+    vector<memtestOp> ops;
+    memtestChunkPlan(const memtestState* t) : tester(t), result(MT_N_METHODS) {}
+};
+
+// Observer of memtestMultiTester tests; called after each chunk finishes a test
+class memtestListener {
+public:
+    virtual ~memtestListener() {}
+    virtual void chunkDone(const memtestChunkResult& result) = 0;
+};
+
+// Polled by memtestMultiTester tests between chunks; once it returns true, the test
+// skips its remaining chunks and returns the errors found so far
+class memtestInterrupt {
+public:
+    virtual ~memtestInterrupt() {}
+    virtual bool interrupted() = 0;
+};
+
 // Simple wrapper class around memtestState to allow multiple test regions
 class memtestMultiTester {
+    friend class memtestAsyncTest;
+    friend class memtestAsyncTester;
+    friend class memtestSliceTest;
+    friend class memtestSliceTester;
     protected:
     list<memtestState*> testers;
+    list<memtestListener*> listeners;
+    memtestInterrupt* interrupt;
+    bool stopBetweenChunks() const {return interrupt && !recording && interrupt->interrupted();}
+    // Whether a test loop should go on to chunk i
+    bool moreChunks(list<memtestState*>::const_iterator i) const {return i != testers.end() && (*i)->tested() > 0 && !stopBetweenChunks();}
+    // While set, the gpu* methods record each chunk's launches here instead of running them
+    mutable vector<memtestChunkPlan>* recording;
+    uint first_chunk;
+    mutable uint current_chunk;
+    // Chunk first_chunk, where the tests start
+    list<memtestState*>::const_iterator firstChunk() const {
+        list<memtestState*>::const_iterator i = testers.begin();
+        for (uint c = 0; c < first_chunk && i != testers.end(); c++) i++;
+        return i;
+    }
+    void setRecording(vector<memtestChunkPlan>* plans) const;
+    void beginChunk(memtestChunkResult& r,uint chunk,const memtestState* tester,unsigned long long& startUs) const;
+    void endChunk(memtestChunkResult& r,const memtestState* tester,unsigned long long startUs,uint errorCount) const;
     cl_context ctx;
     cl_device_id dev;
+    cl_command_queue cq;
     uint lcg_period;
+    uint region_mb;
+    memtestEventLog* event_log;
+    uint kernel_families;
+    uint launch_limit_ms;
+    double hang_factor;
+    memtestTrace* trace;
     bool ctx_retained;
     uint allocation_unit;
-    memtestMultiTester(cl_device_id device) : dev(device), lcg_period(1024), ctx_retained(false), initTime(0)
+    memtestMultiTester(cl_device_id device) : interrupt(NULL), recording(NULL), first_chunk(0), current_chunk(0), dev(device), cq(NULL), lcg_period(1024), region_mb(64), event_log(NULL), kernel_families(MT_ALL_FAMILIES), launch_limit_ms(0), hang_factor(0), trace(NULL), ctx_retained(false), initTime(0)
     {
         cl_ulong maxalloc;
         clGetDeviceInfo(dev,CL_DEVICE_MAX_MEM_ALLOC_SIZE,sizeof(cl_ulong),&maxalloc,NULL);
         // in MiB
         allocation_unit = (uint)(maxalloc/1048576);
     }
+    // For testers whose chunks do not run on an OpenCL device
+    memtestMultiTester(uint allocationUnit) : interrupt(NULL), recording(NULL), first_chunk(0), current_chunk(0), ctx(NULL), dev(NULL), cq(NULL), lcg_period(1024), region_mb(64), event_log(NULL), kernel_families(MT_ALL_FAMILIES), launch_limit_ms(0), hang_factor(0), trace(NULL), ctx_retained(false), allocation_unit(allocationUnit), initTime(0) {}
+    // Creates the (unallocated) tester for one chunk of memory
+    virtual memtestState* newTester() {return cq ? new memtestState(ctx,dev,cq,kernel_families) : new memtestState(ctx,dev,kernel_families);}
     public:
     uint initTime;
-	memtestMultiTester(cl_context context, cl_device_id device) : ctx(context), dev(device), lcg_period(1024), ctx_retained(true), initTime(0)
+	memtestMultiTester(cl_context context, cl_device_id device) : interrupt(NULL), recording(NULL), first_chunk(0), current_chunk(0), ctx(context), dev(device), cq(NULL), lcg_period(1024), region_mb(64), event_log(NULL), kernel_families(MT_ALL_FAMILIES), launch_limit_ms(0), hang_factor(0), trace(NULL), ctx_retained(true), initTime(0)
+    { //{{{
+        clRetainContext(ctx);
+        cl_ulong maxalloc;
+        clGetDeviceInfo(dev,CL_DEVICE_MAX_MEM_ALLOC_SIZE,sizeof(cl_ulong),&maxalloc,NULL);
+        // in MiB
+        allocation_unit = (uint)(maxalloc/1048576);
+    }; //}}}
+    // Runs every chunk on the caller's in-order queue instead of queues of its own
+	memtestMultiTester(cl_context context, cl_device_id device, cl_command_queue queue) : interrupt(NULL), recording(NULL), first_chunk(0), current_chunk(0), ctx(context), dev(device), cq(queue), lcg_period(1024), region_mb(64), event_log(NULL), kernel_families(MT_ALL_FAMILIES), launch_limit_ms(0), hang_factor(0), trace(NULL), ctx_retained(true), initTime(0)
     { //{{{
         clRetainContext(ctx);
+        clRetainCommandQueue(cq);
         cl_ulong maxalloc;
         clGetDeviceInfo(dev,CL_DEVICE_MAX_MEM_ALLOC_SIZE,sizeof(cl_ulong),&maxalloc,NULL);
         // in MiB
@@ -161,12 +546,25 @@ class memtestMultiTester {
     }; //}}}
     virtual ~memtestMultiTester() {
         deallocate();
+        if (cq) clReleaseCommandQueue(cq);
         if (ctx_retained) clReleaseContext(ctx);
     }
 
     int getLCGPeriod() const {return lcg_period;}
     uint get_allocation_unit() const {return allocation_unit;}
+    // Listeners are not owned by the tester
+    void addListener(memtestListener* l) {listeners.push_back(l);}
+    void removeListener(memtestListener* l) {listeners.remove(l);}
+    // Not owned by the tester; NULL to run every test over every chunk
+    void setInterrupt(memtestInterrupt* i) {interrupt = i;}
+    // Starts the tests at the given chunk, skipping those before it, until set back to 0;
+    // to finish a test that failed in failedChunk() without repeating the chunks before
+    void setFirstChunk(uint chunk) {first_chunk = chunk;}
+    // Chunk the last test was on when it failed; the errors it counted are those of the
+    // chunks before
+    uint failedChunk() const {return current_chunk;}
 	bool isAllocated() const {return testers.size()>0;}
+    uint chunks() const {return (uint)testers.size();}
 	uint size() const {
         uint totalsize = 0;
         for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) {
@@ -174,6 +572,28 @@ class memtestMultiTester {
         }
         return totalsize;
     }
+    // Restricts the tests to the first mb MiB of memory, filling chunks in order, without
+    // reallocating; 0 tests all of it again. Returns the MiB now tested.
+    uint setTestedSize(uint mb);
+    uint tested() const {
+        uint total = 0;
+        for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) total += (*i)->tested();
+        return total;
+    }
+    // Error heatmaps of every chunk, in chunk order; see memtestState::setRegionSize
+    void setRegionSize(uint mb);
+    uint getRegionSize() const {return region_mb;}
+    void getRegionErrors(vector<vector<unsigned long long> >& heatmap) const;
+    void resetRegionErrors();
+    // Per-bit-lane error counts summed over all chunks; see memtestState::getBitErrors
+    bool getBitErrors(unsigned long long* lanes) const;
+    void resetBitErrors();
+    bool hasBitErrors() const {
+        for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) {
+            if (!(*i)->hasBitErrors()) return false;
+        }
+        return isAllocated();
+    }
     uint max_bandwidth_size() const {
             if (!isAllocated()) return 0;
             return testers.front()->size()/2;
@@ -188,9 +608,47 @@ class memtestMultiTester {
             (*i)->setLCGPeriod(period);
         }
     }
+    // Compiles only the kernels of these families (see kernelFamily) for chunks allocated
+    // from now on, so that the launch geometry and self-test cover just those kernels
+    void setKernelFamilies(uint families) {kernel_families = families;}
+    uint getKernelFamilies() const {return kernel_families;}
+    // See memtestState::setLaunchLimit; also applies to chunks allocated later. False if
+    // some chunk cannot split its launches.
+    bool setLaunchLimit(uint ms);
+    uint getLaunchLimit() const {return launch_limit_ms;}
+    // See memtestState::setHangFactor; also applies to chunks allocated later
+    void setHangFactor(double factor) {
+        hang_factor = factor;
+        for (list<memtestState*>::iterator i = testers.begin(); i != testers.end(); i++) (*i)->setHangFactor(factor);
+    }
+    unsigned long long deviceFaults() const {
+        unsigned long long total = 0;
+        for (list<memtestState*>::const_iterator i = testers.begin(); i != testers.end(); i++) total += (*i)->deviceFaults();
+        return total;
+    }
+    // Traces every queue operation of every chunk, each chunk on a device track of its
+    // own; not owned by the tester, NULL to stop. Add the trace as a listener too for
+    // per-chunk spans.
+    void setTrace(memtestTrace* t) {
+        trace = t;
+        uint track = 0;
+        for (list<memtestState*>::iterator i = testers.begin(); i != testers.end(); i++) (*i)->setTrace(t,track++);
+    }
+    // Logs every kernel launch and completion of every chunk; not owned by the tester,
+    // NULL to stop. Add the log as a listener too for per-chunk records.
+    void setEventLog(memtestEventLog* log) {
+        event_log = log;
+        for (list<memtestState*>::iterator i = testers.begin(); i != testers.end(); i++) {
+            (*i)->setEventLog(log);
+        }
+    }
 
 	virtual uint allocate(uint mbToTest);
 	virtual void deallocate();
+    // Adds one more chunk of up to mbToTest MiB (at most the allocation unit) to the
+    // memory tested; returns its size, or 0 if it could not be allocated
+    uint addChunk(uint mbToTest);
+    bool selfTest(string& failure);
     bool gpuMemoryBandwidth(double& bandwidth,uint mbToTest,uint iters=5);
 	bool gpuShortLCG0(uint& errorCount,const uint repeats) const;
 	bool gpuShortLCG0Shmem(uint& errorCount,const uint repeats) const;
@@ -212,5 +670,21 @@ class memtestMultiContextTester : public memtestMultiTester {
         virtual uint allocate(uint mbToTest);
 };
 
+// Test registry: the tests run by the CLI, in their default order. Each test is a
+// sweep of steps (the shifts of the walking and modulo tests) that can be run
+// independently; random patterns come from rand(), so callers seed it per step.
+struct memtestTestInfo {
+    const char* name;       // as printed, and as recorded in history and output files
+    const char* key;        // short name for test selection
+    uint steps;             // steps in one full run of the test
+    double passes;          // cost estimate: kernel passes over the tested memory per step
+    uint families;          // kernel families it launches, bit f for family f
+    bool (*run)(memtestMultiTester* tester,uint step,uint& errorCount);
+};
+extern const memtestTestInfo memtestTests[];
+extern const int memtestNTests;
+// Index of the test with the given key or name, or -1
+int memtestFindTest(const string& keyOrName);
+
 
 #endif
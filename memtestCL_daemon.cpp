@@ -0,0 +1,89 @@
+/*
+ * memtestCL_daemon.cpp
+ * Daemon mode for MemtestCL.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include "memtestCL_daemon.h"
+#include "memtestCL_core.h"
+#include <stdio.h>
+
+memtestDaemon::memtestDaemon(double duty) :
+    dutyCycle(duty), releaseWanted(0), releaseWantedMs(0), stopWanted(0), released(0), slices(0), errors(0), busyMs(0), idleMs(0)
+{
+    if (dutyCycle <= 0 || dutyCycle > 1) dutyCycle = 1;
+}
+
+void memtestDaemon::requestRelease() {
+    if (!releaseRequested()) memtestAtomicStore(releaseWantedMs,getTimeMilliseconds());
+    memtestAtomicStore(releaseWanted,1);
+}
+
+void memtestDaemon::sliceDone(unsigned sliceMs,unsigned sliceErrors) {
+    memtestAtomicAdd(slices,1);
+    memtestAtomicAdd(errors,sliceErrors);
+    memtestAtomicAdd(busyMs,sliceMs);
+    // Idle until busy/(busy+idle) is back down to the duty cycle. Working from the
+    // totals lets time spent released or in setup pay for later slices.
+    const double targetIdle = memtestAtomicLoad(busyMs)*(1.0-dutyCycle)/dutyCycle;
+    while (memtestAtomicLoad(idleMs) < targetIdle && !releaseRequested() && !stopRequested()) {
+        const unsigned int start = getTimeMilliseconds();
+        SLEEPMS(poll_ms);
+        memtestAtomicAdd(idleMs,getTimeMilliseconds()-start);
+    }
+}
+
+bool memtestDaemon::waitWhileReleased() {
+    memtestAtomicStore(released,1);
+    while (releaseRequested() && !stopRequested()) {
+        const unsigned int start = getTimeMilliseconds();
+        SLEEPMS(poll_ms);
+        memtestAtomicAdd(idleMs,getTimeMilliseconds()-start);
+    }
+    memtestAtomicStore(released,0);
+    return !stopRequested();
+}
+
+std::string memtestDaemon::status() {
+    const char* state = "running";
+    if (stopRequested()) state = "stopping";
+    else if (memtestAtomicLoad(released)) state = "released";
+    else if (releaseRequested()) state = "releasing";
+    char line[256];
+    sprintf(line,"%s duty=%.3f slices=%llu errors=%llu busy_ms=%llu idle_ms=%llu",state,dutyCycle,
+            memtestAtomicLoad(slices),memtestAtomicLoad(errors),memtestAtomicLoad(busyMs),memtestAtomicLoad(idleMs));
+    return line;
+}
+
+// Longest time a release command waits for the test loop to free device memory
+static const unsigned int release_wait_ms = 60000;
+
+void memtestDaemonControl::handle(long long fd) {
+    std::string request;
+    if (!recvUntil(fd,request,"\n",1000)) return;
+    std::string command = request.substr(0,request.find_first_of("\r\n"));
+    std::string reply;
+    if (command == "release") {
+        // Reply once the memory is actually free, so callers can start their job
+        daemon.requestRelease();
+        const unsigned int start = getTimeMilliseconds();
+        while (!daemon.isReleased() && daemon.releaseRequested() && !daemon.stopRequested() && getTimeMilliseconds()-start < release_wait_ms)
+            SLEEPMS(memtestDaemon::poll_ms);
+        reply = daemon.isReleased() ? "ok released" : "ok releasing";
+    } else if (command == "resume") {
+        daemon.requestResume();
+        reply = "ok";
+    } else if (command == "stop") {
+        daemon.requestStop();
+        reply = "ok";
+    } else if (command == "status") {
+        reply = daemon.status();
+    } else {
+        reply = "error unknown command; use release, resume, status or stop";
+    }
+    sendAll(fd,reply + "\n");
+}
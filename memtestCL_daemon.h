@@ -0,0 +1,71 @@
+/*
+ * memtestCL_daemon.h
+ * Daemon mode for MemtestCL: runs tests continuously in short slices at a
+ * bounded duty cycle, and gives device memory back on request.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_DAEMON_H_
+#define _MEMTESTCL_DAEMON_H_
+
+#include "memtestCL_thread.h"
+#include "memtestCL_socket.h"
+#include <string>
+
+// State shared by the test loop, signal handlers and the control socket. The
+// request functions only read the clock and do atomic stores, so they are safe
+// in signal handlers.
+class memtestDaemon { //{{{
+protected:
+    double dutyCycle;
+    memtestCounter releaseWanted;
+    memtestCounter releaseWantedMs;
+    memtestCounter stopWanted;
+    memtestCounter released;
+    memtestCounter slices;
+    memtestCounter errors;
+    memtestCounter busyMs;
+    memtestCounter idleMs;
+public:
+    // Polling interval while sleeping; bounds the latency of requests between slices
+    static const unsigned poll_ms = 20;
+
+    // dutyCycle is the largest fraction of time spent running tests, in (0,1]
+    memtestDaemon(double duty);
+
+    void requestRelease();
+    void requestResume() {memtestAtomicStore(releaseWanted,0);}
+    void requestStop() {memtestAtomicStore(stopWanted,1);}
+    bool releaseRequested() {return memtestAtomicLoad(releaseWanted) != 0;}
+    bool stopRequested() {return memtestAtomicLoad(stopWanted) != 0;}
+    // True while device memory is freed
+    bool isReleased() {return memtestAtomicLoad(released) != 0;}
+    // getTimeMilliseconds() when the pending release was first requested
+    unsigned int releaseRequestTime() {return (unsigned int)memtestAtomicLoad(releaseWantedMs);}
+
+    // Records a slice of sliceMs device time, then sleeps long enough to keep the
+    // duty cycle. Returns early if release or stop is requested.
+    void sliceDone(unsigned sliceMs,unsigned sliceErrors);
+    // Call with device memory freed: blocks until resume or stop is requested.
+    // Returns false on stop.
+    bool waitWhileReleased();
+
+    // One line: state, duty cycle, slices, errors, busy and idle time
+    std::string status();
+}; //}}}
+
+// Line-oriented control socket. Commands are "release", "resume", "status" and
+// "stop"; each gets a one-line reply. "release" replies once memory is freed.
+class memtestDaemonControl : public memtestSocketServer { //{{{
+protected:
+    memtestDaemon& daemon;
+    virtual void handle(long long fd);
+public:
+    memtestDaemonControl(memtestDaemon& d) : daemon(d) {}
+    virtual ~memtestDaemonControl() {stop();}
+}; //}}}
+
+#endif
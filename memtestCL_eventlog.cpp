@@ -0,0 +1,122 @@
+/*
+ * memtestCL_eventlog.cpp
+ * Crash-safe binary event log for MemtestCL.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include "memtestCL_eventlog.h"
+#include <stdio.h>
+#include <algorithm>
+
+#if !defined (WINDOWS) && !defined (WINNV)
+    #include <sys/mman.h>
+    #include <fcntl.h>
+#endif
+
+static const char logMagic[8] = {'M','T','C','L','L','O','G','2'};
+
+memtestEventLog::memtestEventLog() : header(NULL), records(NULL), capacity(0), next(0), iteration(0), mappedBytes(0)
+#if defined (WINDOWS) || defined (WINNV)
+    , file(INVALID_HANDLE_VALUE), mapping(NULL)
+#else
+    , fd(-1)
+#endif
+{}
+
+bool memtestEventLog::open(const char* filename,uint nRecords,const std::string& device) {
+    close();
+    if (nRecords == 0) return false;
+    mappedBytes = sizeof(memtestLogHeader) + (size_t)nRecords*sizeof(memtestLogRecord);
+    void* base = NULL;
+    #if defined (WINDOWS) || defined (WINNV)
+    file = CreateFileA(filename,GENERIC_READ|GENERIC_WRITE,FILE_SHARE_READ,NULL,CREATE_ALWAYS,FILE_ATTRIBUTE_NORMAL,NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    // The mapping extends the new file to its full size, filled with zeros
+    mapping = CreateFileMappingA(file,NULL,PAGE_READWRITE,(DWORD)((unsigned long long)mappedBytes >> 32),(DWORD)(mappedBytes & 0xFFFFFFFF),NULL);
+    if (mapping != NULL) base = MapViewOfFile(mapping,FILE_MAP_WRITE,0,0,mappedBytes);
+    #else
+    fd = ::open(filename,O_RDWR|O_CREAT|O_TRUNC,0644);
+    if (fd < 0) return false;
+    // Truncating to the full size fills the file with zeros, ie empty slots
+    if (ftruncate(fd,(off_t)mappedBytes) == 0) {
+        base = mmap(NULL,mappedBytes,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+        if (base == MAP_FAILED) base = NULL;
+    }
+    #endif
+    if (base == NULL) {
+        close();
+        return false;
+    }
+    header = (memtestLogHeader*)base;
+    header->recordSize = sizeof(memtestLogRecord);
+    header->capacity = nRecords;
+    header->startUs = getTimeMicroseconds();
+    header->startTimeUs = getWallClockMicroseconds();
+    strncpy(header->device,device.c_str(),sizeof(header->device)-1);
+    memcpy(header->magic,logMagic,sizeof(logMagic));
+    records = (volatile memtestLogRecord*)(header+1);
+    capacity = nRecords;
+    memtestAtomicStore(next,0);
+    return true;
+}
+
+void memtestEventLog::close() {
+    if (header != NULL) {
+        #if defined (WINDOWS) || defined (WINNV)
+        FlushViewOfFile(header,mappedBytes);
+        UnmapViewOfFile(header);
+        #else
+        msync(header,mappedBytes,MS_SYNC);
+        munmap(header,mappedBytes);
+        #endif
+    }
+    header = NULL;
+    records = NULL;
+    capacity = 0;
+    #if defined (WINDOWS) || defined (WINNV)
+    if (mapping != NULL) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = NULL;
+    file = INVALID_HANDLE_VALUE;
+    #else
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    #endif
+}
+
+void memtestEventLog::chunkDone(const memtestChunkResult& r) {
+    record(LOG_CHUNK,(r.method < MT_N_METHODS) ? (unsigned short)r.method : LOG_NO_TEST,LOG_NO_KERNEL,r.chunk,r.chunkMB,0,r.params,r.nParams,r.errorCount,(unsigned long long)(r.ms*1000));
+}
+
+static bool recordBefore(const memtestLogRecord& a,const memtestLogRecord& b) {
+    return a.seq < b.seq;
+}
+
+bool memtestEventLog::load(const char* filename,memtestLogHeader& header,vector<memtestLogRecord>& records,std::string& error) {
+    records.clear();
+    FILE* f = fopen(filename,"rb");
+    if (f == NULL) {
+        error = "cannot open file";
+        return false;
+    }
+    bool ok = (fread(&header,sizeof(header),1,f) == 1);
+    if (!ok || memcmp(header.magic,logMagic,sizeof(logMagic)) != 0) {
+        error = "not a MemtestCL event log";
+        ok = false;
+    } else if (header.recordSize != sizeof(memtestLogRecord)) {
+        error = "written with a different record size";
+        ok = false;
+    }
+    memtestLogRecord r;
+    for (uint i = 0; ok && i < header.capacity && fread(&r,sizeof(r),1,f) == 1; i++) {
+        if (r.seq != 0) records.push_back(r);
+    }
+    fclose(f);
+    header.device[sizeof(header.device)-1] = '\0';
+    std::sort(records.begin(),records.end(),recordBefore);
+    return ok;
+}
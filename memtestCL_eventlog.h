@@ -0,0 +1,115 @@
+/*
+ * memtestCL_eventlog.h
+ * Crash-safe binary event log for MemtestCL: a fixed-size ring of compact
+ * records in a memory-mapped file, written with plain stores, so that the
+ * kernels launched just before a driver hang or crash survive the process.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_EVENTLOG_H_
+#define _MEMTESTCL_EVENTLOG_H_
+
+#include "memtestCL_core.h"
+#include "memtestCL_thread.h"
+#include <string.h>
+#include <string>
+
+enum memtestLogType {LOG_NONE, LOG_RUN, LOG_LAUNCH, LOG_KERNEL, LOG_CHUNK, LOG_ITERATION, LOG_FAULT};
+
+const unsigned short LOG_NO_TEST = 0xFFFF;
+const unsigned short LOG_NO_KERNEL = 0xFFFF;
+
+// One 64-byte record. A slot's seq is cleared before the rest is written and set last,
+// so a record cut short by the process dying reads as empty, not as a mix of two.
+struct memtestLogRecord {
+    unsigned long long seq;     // 1, 2, ... in order of writing; 0 for an empty slot
+    unsigned long long timeUs;  // getTimeMicroseconds() when written
+    uint durationUs;            // of kernels, chunks and iterations; waited, of faults
+    uint errorCount;            // incorrect bits, of verify kernels, chunks and iterations; cl_int status of faults
+    unsigned short type;        // memtestLogType
+    unsigned short test;        // memtestMethod, or LOG_NO_TEST
+    unsigned short kernel;      // memtestKernel, or LOG_NO_KERNEL
+    unsigned short chunk;
+    uint iteration;
+    uint N;                     // words per work-item of kernels; MiB of chunks and runs
+    uint blocks;                // work-groups of kernels; chunks of runs
+    uint params[5];
+};
+
+// File layout: this header, then capacity records
+struct memtestLogHeader {
+    char magic[8];              // "MTCLLOG2"
+    uint recordSize;
+    uint capacity;
+    unsigned long long startUs;     // getTimeMicroseconds() when the log was opened
+    unsigned long long startTimeUs; // the same moment in microseconds since the epoch
+    char device[32];
+};
+
+// Writes records into the mapped file, overwriting the oldest once it is full. Writing
+// a record makes no system calls, and the pages of a mapped file outlive the process,
+// so the log holds everything up to the instant it died. Safe to use from any thread.
+class memtestEventLog : public memtestListener { //{{{
+protected:
+    memtestLogHeader* header;
+    volatile memtestLogRecord* records;
+    uint capacity;
+    memtestCounter next;
+    uint iteration;
+    size_t mappedBytes;
+#if defined (WINDOWS) || defined (WINNV)
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+    memtestEventLog(const memtestEventLog&);
+    memtestEventLog& operator=(const memtestEventLog&);
+public:
+    memtestEventLog();
+    virtual ~memtestEventLog() {close();}
+    // Creates (or truncates) filename to hold capacity records and maps it
+    bool open(const char* filename,uint capacity,const std::string& device);
+    bool isOpen() const {return records != NULL;}
+    // Flushes the mapping to disk and unmaps it
+    void close();
+
+    // Claims the next slot and fills it in; returns the time it was stamped with
+    unsigned long long record(memtestLogType type,unsigned short test,unsigned short kernel,uint chunk,uint N,uint blocks,
+                              const uint* params,int nParams,uint errorCount,unsigned long long durationUs) {
+        if (records == NULL) return 0;
+        const unsigned long long seq = memtestAtomicIncrement(next);
+        volatile memtestLogRecord& r = records[(seq-1) % capacity];
+        r.seq = 0;
+        const unsigned long long now = getTimeMicroseconds();
+        r.timeUs = now;
+        r.durationUs = (durationUs < 0xFFFFFFFFULL) ? (uint)durationUs : 0xFFFFFFFF;
+        r.errorCount = errorCount;
+        r.type = (unsigned short)type;
+        r.test = test;
+        r.kernel = kernel;
+        r.chunk = (unsigned short)chunk;
+        r.iteration = iteration;
+        r.N = N;
+        r.blocks = blocks;
+        for (int i = 0; i < 5; i++) r.params[i] = (i < nParams) ? params[i] : 0;
+        r.seq = seq;
+        return now;
+    }
+    void setIteration(uint iter) {iteration = iter;}
+    void runStarted(uint megs,uint chunks) {record(LOG_RUN,LOG_NO_TEST,LOG_NO_KERNEL,0,megs,chunks,NULL,0,0,0);}
+    void iterationDone(unsigned long long errors,double ms) {
+        record(LOG_ITERATION,LOG_NO_TEST,LOG_NO_KERNEL,0,0,0,NULL,0,(errors < 0xFFFFFFFFULL) ? (uint)errors : 0xFFFFFFFF,(unsigned long long)(ms*1000));
+    }
+    // One record per chunk of every test
+    virtual void chunkDone(const memtestChunkResult& r);
+
+    // Reads a log written by this class (whether or not its writer exited cleanly); the
+    // records come back oldest first, without empty slots
+    static bool load(const char* filename,memtestLogHeader& header,vector<memtestLogRecord>& records,std::string& error);
+}; //}}}
+
+#endif
@@ -0,0 +1,223 @@
+/*
+ * memtestCL_faults.cpp
+ * Fault injection backend and fault coverage harness for MemtestCL.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include "memtestCL_faults.h"
+#include <stdlib.h>
+
+const char* faultTypeName(memtestFaultType type) {
+    switch (type) {
+        case FAULT_STUCK_AT:      return "Stuck-at";
+        case FAULT_TRANSITION:    return "Transition";
+        case FAULT_COUPLING:      return "Coupling";
+        case FAULT_ADDRESS_ALIAS: return "Address alias";
+        case FAULT_TRANSIENT:     return "Transient";
+        default:                  return "Unknown";
+    }
+}
+
+memtestFaultyBackend::memtestFaultyBackend(memtestBackend* be,unsigned long long seed) :
+    inner(be), rng(seed), nWords(0), nBlocks(0), nThreads(0), flips(0) {}
+
+cl_int memtestFaultyBackend::allocate(uint megs,uint blocks,uint threads) {
+    cl_int status = inner->allocate(megs,blocks,threads);
+    nWords = (status == CL_SUCCESS) ? megs*262144ULL : 0;
+    nBlocks = blocks;
+    nThreads = threads;
+    return status;
+}
+cl_int memtestFaultyBackend::launch(memtestKernel k,uint N,const uint* params) {
+    if (isVerifyKernel(k) || faults.empty()) return inner->launch(k,N,params);
+    vector<uint> before;
+    cl_int status = snapshot(before);
+    if (status != CL_SUCCESS) return status;
+    status = inner->launch(k,N,params);
+    if (status != CL_SUCCESS) return status;
+    status = inner->wait();
+    if (status != CL_SUCCESS) return status;
+    return inject(before,0,nWords);
+}
+cl_int memtestFaultyBackend::launchRange(memtestKernel k,uint N,const uint* params,uint firstBlock,uint blocks) {
+    if (isVerifyKernel(k) || faults.empty()) return inner->launchRange(k,N,params,firstBlock,blocks);
+    vector<uint> before;
+    cl_int status = snapshot(before);
+    if (status != CL_SUCCESS) return status;
+    status = inner->launchRange(k,N,params,firstBlock,blocks);
+    if (status != CL_SUCCESS) return status;
+    status = inner->wait();
+    if (status != CL_SUCCESS) return status;
+    const size_t blockWords = (size_t)N*nThreads;
+    return inject(before,firstBlock*blockWords,(firstBlock+blocks)*blockWords);
+}
+cl_int memtestFaultyBackend::snapshot(vector<uint>& before) {
+    // Transition and coupling faults depend on the cell contents before the write
+    before.assign(faults.size(),0);
+    for (size_t i = 0; i < faults.size(); i++) {
+        cl_int status = CL_SUCCESS;
+        if (faults[i].type == FAULT_TRANSITION)
+            status = inner->readWords(faults[i].address,1,&before[i]);
+        else if (faults[i].type == FAULT_COUPLING)
+            status = inner->readWords(faults[i].aggressor,1,&before[i]);
+        if (status != CL_SUCCESS) return status;
+    }
+    return CL_SUCCESS;
+}
+// Applies the faults whose victim or aggressor word lies in [first,last) after a write
+cl_int memtestFaultyBackend::inject(const vector<uint>& before,size_t first,size_t last) {
+    for (size_t i = 0; i < faults.size(); i++) {
+        const memtestFault& f = faults[i];
+        const bool coupled = f.type == FAULT_COUPLING || f.type == FAULT_ADDRESS_ALIAS;
+        size_t address = f.address;
+        if (f.type == FAULT_TRANSIENT) {
+            // Flip within the part of the span this launch wrote, scaling the rate so
+            // that a pass split over several launches flips as often as a whole one
+            const size_t lo = (f.address > first) ? f.address : first;
+            const size_t hi = (f.address+f.span < last) ? f.address+f.span : last;
+            if (lo >= hi || rng.uniform() >= f.rate*(hi-lo)/f.span) continue;
+            address = lo + rng.below(hi-lo);
+        } else if ((f.address < first || f.address >= last) && !(coupled && f.aggressor >= first && f.aggressor < last)) continue;
+        const uint mask = 1u << f.bit;
+        uint word, corrupted;
+        cl_int status;
+        if ((status = inner->readWords(address,1,&word)) != CL_SUCCESS) return status;
+        corrupted = word;
+        switch (f.type) {
+            case FAULT_STUCK_AT:
+                corrupted = f.value ? (word | mask) : (word & ~mask);
+                break;
+            case FAULT_TRANSITION:
+                // The write into value did not take; the cell keeps its old bit
+                if (((before[i] ^ word) & mask) && ((word & mask) != 0) == (f.value != 0))
+                    corrupted = word ^ mask;
+                break;
+            case FAULT_COUPLING: {
+                uint aggressor;
+                if ((status = inner->readWords(f.aggressor,1,&aggressor)) != CL_SUCCESS) return status;
+                if ((before[i] ^ aggressor) & (1u << f.aggressorBit)) corrupted = word ^ mask;
+                break;
+            }
+            case FAULT_ADDRESS_ALIAS:
+                // Both addresses reach the aggressor's cell, which was written last
+                if ((status = inner->readWords(f.aggressor,1,&corrupted)) != CL_SUCCESS) return status;
+                break;
+            case FAULT_TRANSIENT:
+                corrupted = word ^ (1u << rng.below(32));
+                break;
+            default:
+                break;
+        }
+        if (corrupted == word) continue;
+        for (uint diff = corrupted ^ word; diff; diff &= diff-1) flips++;
+        if ((status = inner->writeWords(address,1,&corrupted)) != CL_SUCCESS) return status;
+    }
+    return CL_SUCCESS;
+}
+
+// memtestMultiTester whose one chunk runs over the injector, so that the harness
+// runs the registry's tests exactly as the CLI does
+class memtestFaultyMultiTester : public memtestMultiTester {
+    protected:
+        memtestFaultyBackend* backend;  // owned by the chunk once created
+        virtual memtestState* newTester() {
+            memtestState* s = new memtestState(backend,kernel_families);
+            backend = NULL;
+            return s;
+        }
+    public:
+        memtestFaultyMultiTester(memtestFaultyBackend* be) : memtestMultiTester(be->max_allocation()), backend(be) {}
+        virtual ~memtestFaultyMultiTester() {deallocate(); delete backend;}
+};
+
+static memtestFault randomFault(memtestFaultType type,size_t nWords,memtestFaultRNG& rng,const memtestCoverageConfig& config) {
+    memtestFault f(type,rng.below(nWords),(uint)rng.below(32),(uint)rng.below(2));
+    switch (type) {
+        case FAULT_COUPLING:
+            do { f.aggressor = rng.below(nWords); } while (f.aggressor == f.address);
+            f.aggressorBit = (uint)rng.below(32);
+            break;
+        case FAULT_ADDRESS_ALIAS: {
+            // Decoder faults alias addresses that differ in a single address line
+            uint lines = 0;
+            while (((size_t)2 << lines) <= nWords) lines++;
+            do { f.aggressor = f.address ^ ((size_t)1 << rng.below(lines)); } while (f.aggressor >= nWords);
+            break;
+        }
+        case FAULT_TRANSIENT:
+            f.address = 0;
+            f.span = nWords;
+            f.rate = config.transientRate;
+            break;
+        default:
+            break;
+    }
+    return f;
+}
+
+bool measureFaultCoverage(memtestBackend* backend,const memtestCoverageConfig& config,memtestCoverageMatrix& result) {
+    memtestFaultyBackend* faulty = new memtestFaultyBackend(backend,config.seed);
+    memtestFaultyMultiTester tester(faulty);
+    // One chunk, or the injector would only reach the first
+    if (config.megs > faulty->max_allocation() || !tester.allocate(config.megs)) return false;
+
+    result.tests.clear();
+    result.cells.assign(memtestNTests,vector<memtestCoverageCell>(FAULT_N_TYPES));
+    for (int t = 0; t < memtestNTests; t++) result.tests.push_back(memtestTests[t].name);
+
+    memtestFaultRNG placement;
+    for (int type = 0; type < FAULT_N_TYPES; type++) {
+        for (uint trial = 0; trial < config.trials; trial++) {
+            // Every test sees the same fault, and the same transient flip sequence
+            const unsigned long long trialSeed = config.seed*1000003ULL + type*7919ULL + trial;
+            placement.seed(trialSeed);
+            vector<memtestFault> faults(1,randomFault((memtestFaultType)type,faulty->words(),placement,config));
+            for (int t = 0; t < memtestNTests; t++) {
+                memtestCoverageCell& cell = result.cells[t][type];
+                faulty->clearFaults();
+                // Start each run from a region this fault has not touched yet
+                uint errors;
+                if (!tester.gpuMovingInversionsOnesZeros(errors)) return false;
+                faulty->setFaults(faults);
+                faulty->reseed(trialSeed);
+                srand((unsigned)trialSeed);
+                cell.trials++;
+                for (uint iter = 0; iter < config.maxIters; iter++) {
+                    // One execution is a full sweep of the test's steps
+                    uint stepErrors;
+                    errors = 0;
+                    for (uint step = 0; step < memtestTests[t].steps; step++) {
+                        if (!memtestTests[t].run(&tester,step,stepErrors)) return false;
+                        errors += stepErrors;
+                    }
+                    if (errors) {
+                        cell.detected++;
+                        cell.totalLatency += iter+1;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void printCoverageMatrix(FILE* f,const memtestCoverageMatrix& m) {
+    fprintf(f,"Fault coverage (%% of faults detected / mean test executions to detect)\n");
+    fprintf(f,"%40s","");
+    for (int type = 0; type < FAULT_N_TYPES; type++) fprintf(f," %15s",faultTypeName((memtestFaultType)type));
+    fprintf(f,"\n");
+    for (size_t t = 0; t < m.tests.size(); t++) {
+        fprintf(f,"%40s",m.tests[t].c_str());
+        for (int type = 0; type < FAULT_N_TYPES; type++) {
+            const memtestCoverageCell& cell = m.cells[t][type];
+            if (cell.detected) fprintf(f,"   %5.1f%% / %4.1f",100*cell.coverage(),cell.meanLatency());
+            else fprintf(f,"   %5.1f%% /    -",100*cell.coverage());
+        }
+        fprintf(f,"\n");
+    }
+}
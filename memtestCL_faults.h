@@ -0,0 +1,137 @@
+/*
+ * memtestCL_faults.h
+ * Deterministic fault injection for MemtestCL, and a harness measuring
+ * which injected faults each memtestState test detects, and how quickly.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_FAULTS_H_
+#define _MEMTESTCL_FAULTS_H_
+
+#include "memtestCL_core.h"
+#include <string>
+
+enum memtestFaultType {
+    FAULT_STUCK_AT,       // victim bit always holds value
+    FAULT_TRANSITION,     // victim bit cannot make the transition into value
+    FAULT_COUPLING,       // any transition of the aggressor bit inverts the victim bit
+    FAULT_ADDRESS_ALIAS,  // victim word decodes to the same cell as the aggressor word
+    FAULT_TRANSIENT,      // with probability rate per write pass, one bit in [address,address+span) flips
+    FAULT_N_TYPES
+};
+const char* faultTypeName(memtestFaultType type);
+
+// One injected fault; addresses are word offsets into a test region
+struct memtestFault {
+    memtestFaultType type;
+    size_t address;
+    uint bit;
+    uint value;
+    size_t aggressor;
+    uint aggressorBit;
+    size_t span;
+    double rate;
+    memtestFault(memtestFaultType t = FAULT_STUCK_AT,size_t addr = 0,uint b = 0,uint v = 0) :
+        type(t), address(addr), bit(b), value(v), aggressor(0), aggressorBit(0), span(1), rate(0) {}
+};
+
+// Small deterministic generator (splitmix64) for fault placement and transient flips
+class memtestFaultRNG {
+    unsigned long long state;
+public:
+    memtestFaultRNG(unsigned long long seed = 1) : state(seed) {}
+    void seed(unsigned long long s) {state = s;}
+    unsigned long long next() {
+        unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    // Uniform in [0,n)
+    size_t below(size_t n) {return (size_t)(next() % n);}
+    // Uniform in [0,1)
+    double uniform() {return (next() >> 11) * (1.0/9007199254740992.0);}
+};
+
+// memtestBackend decorator that injects faults into the test region after every write
+// kernel completes, i.e. between each write kernel and the verify kernel that follows it.
+// Works over any backend, since faults are applied with readWords/writeWords.
+class memtestFaultyBackend : public memtestBackend { //{{{
+protected:
+    memtestBackend* inner;
+    vector<memtestFault> faults;
+    memtestFaultRNG rng;
+    size_t nWords;
+    uint nBlocks;
+    uint nThreads;
+    unsigned long long flips;
+    cl_int snapshot(vector<uint>& before);
+    cl_int inject(const vector<uint>& before,size_t first,size_t last);
+public:
+    // Takes ownership of the wrapped backend
+    memtestFaultyBackend(memtestBackend* be,unsigned long long seed = 1);
+    virtual ~memtestFaultyBackend() {delete inner;}
+    void setFaults(const vector<memtestFault>& f) {faults = f;}
+    void clearFaults() {faults.clear();}
+    void reseed(unsigned long long seed) {rng.seed(seed);}
+    size_t words() const {return nWords;}
+    // Number of bits corrupted by the injector so far
+    unsigned long long injectedFlips() const {return flips;}
+
+    virtual const char* name() const {return inner->name();}
+    virtual void geometry(uint& nBlocks,uint& nThreads) const {inner->geometry(nBlocks,nThreads);}
+    virtual uint max_allocation() const {return inner->max_allocation();}
+    virtual void prepare(uint families) {inner->prepare(families);}
+    virtual cl_int allocate(uint megs,uint nBlocks,uint nThreads);
+    virtual void deallocate() {inner->deallocate(); nWords = 0;}
+    virtual cl_int launch(memtestKernel k,uint N,const uint* params);
+    // Injects only the faults in the work-groups launched
+    virtual cl_int launchRange(memtestKernel k,uint N,const uint* params,uint firstBlock,uint blocks);
+    virtual bool canLaunchRange() const {return inner->canLaunchRange();}
+    virtual void setWaitLimit(unsigned ms) {inner->setWaitLimit(ms);}
+    virtual cl_int recover() {return inner->recover();}
+    virtual void setTrace(memtestTrace* trace,uint track) {inner->setTrace(trace,track);}
+    virtual cl_int launchCopy(size_t bytes) {return inner->launchCopy(bytes);}
+    virtual cl_int wait() {return inner->wait();}
+    virtual cl_int poll(bool& done) {return inner->poll(done);}
+    virtual cl_int readCounts(uint* counts) {return inner->readCounts(counts);}
+    virtual cl_int launchReadCounts(uint* counts) {return inner->launchReadCounts(counts);}
+    virtual cl_int readWords(size_t offset,size_t count,uint* dst) {return inner->readWords(offset,count,dst);}
+    virtual cl_int writeWords(size_t offset,size_t count,const uint* src) {return inner->writeWords(offset,count,src);}
+    virtual cl_int readBitErrors(uint* lanes) {return inner->readBitErrors(lanes);}
+}; //}}}
+
+// Fault coverage harness {{{
+struct memtestCoverageConfig {
+    uint trials;               // randomly placed faults per fault type
+    uint maxIters;             // test executions before a fault counts as missed
+    uint megs;                 // size of the test region
+    double transientRate;      // flip probability per write pass for transient faults
+    unsigned long long seed;
+    memtestCoverageConfig() : trials(8), maxIters(16), megs(2), transientRate(0.05), seed(1) {}
+};
+struct memtestCoverageCell {
+    uint trials;
+    uint detected;
+    uint totalLatency;         // sum over detected trials of the executions needed to detect
+    memtestCoverageCell() : trials(0), detected(0), totalLatency(0) {}
+    double coverage() const {return trials ? (double)detected/trials : 0;}
+    double meanLatency() const {return detected ? (double)totalLatency/detected : 0;}
+};
+struct memtestCoverageMatrix {
+    vector<std::string> tests;
+    vector< vector<memtestCoverageCell> > cells; // [test][fault type]
+};
+
+// Runs every test of the registry (memtestTests), each a full sweep of its steps,
+// against faults of every type, injected through a memtestFaultyBackend around
+// backend (which it takes ownership of). Returns false if the region cannot be
+// allocated in one chunk or a test fails to execute.
+bool measureFaultCoverage(memtestBackend* backend,const memtestCoverageConfig& config,memtestCoverageMatrix& result);
+void printCoverageMatrix(FILE* f,const memtestCoverageMatrix& m);
+//}}}
+
+#endif
@@ -23,6 +23,9 @@
 #define THREAD_ADDRESS(base,N,i) (base + get_group_id(0) * N * get_local_size(0) + i * get_local_size(0) + get_local_id(0))
 #define THREAD_OFFSET(N,i) (get_group_id(0) * N * get_local_size(0) + i * get_local_size(0) + get_local_id(0))
 #define BITSDIFF(x,y) __popc((x) ^ (y))
+// Launches over part of a region pass the work-group they start at; the kernels then
+// address and number the memory from there on as if the region began at it
+#define SLICE_BASE(base,firstBlock,N) base += (size_t)(firstBlock) * N * get_local_size(0)
 
 #define threadIdx get_local_id(0)
 #define blockIdx get_group_id(0)
@@ -50,24 +53,76 @@ unsigned __popc(uint x) { //{{{
 #undef f
 } //}}}
 
+// Per-bit-lane error histogram {{{
+// Each verify work-group counts the failing bits of every bit position (lane) in 32 words of
+// local memory, then adds its non-zero lanes into bitErrorCount[32] in global memory, which
+// accumulates over launches until the host reads and clears it. Stuck data lines and bad
+// DQ pins show up as errors concentrated in one lane. Only failing words touch the histogram,
+// so on a clean region it costs clearing and merging 32 words per work-group.
+// Without 32-bit atomics (OpenCL 1.0 devices lacking the extensions) only totals are counted.
+#if __OPENCL_VERSION__ >= 110
+#define BITLANES_ENABLED
+#elif defined(cl_khr_global_int32_base_atomics) && defined(cl_khr_local_int32_base_atomics)
+#pragma OPENCL EXTENSION cl_khr_global_int32_base_atomics : enable
+#pragma OPENCL EXTENSION cl_khr_local_int32_base_atomics : enable
+#define atomic_inc atom_inc
+#define atomic_add atom_add
+#define BITLANES_ENABLED
+#endif
+
+#ifdef BITLANES_ENABLED
+// Counts the bits set in diff, the incorrect bits of one word, into their lanes; returns how many there are
+uint deviceBitErrors(__local uint* bitLanes,uint diff) {
+    uint n = 0;
+    while (diff) {
+        const uint lane = 31 - clz(diff);
+        atomic_inc(bitLanes + lane);
+        diff ^= 1u << lane;
+        n++;
+    }
+    return n;
+}
+#define BITERRORS(bitLanes,x,y) deviceBitErrors(bitLanes,(x) ^ (y))
+// Must be followed by a barrier before the first BITERRORS
+#define BITLANES_CLEAR(bitLanes) for (uint lane = threadIdx; lane < 32; lane += blockDim) bitLanes[lane] = 0
+// Must follow a barrier after the last BITERRORS
+#define BITLANES_MERGE(bitLanes,bitErrorCount) for (uint lane = threadIdx; lane < 32; lane += blockDim) {\
+    if (bitLanes[lane]) atomic_add(bitErrorCount + lane,bitLanes[lane]);\
+}
+#else
+#define BITERRORS(bitLanes,x,y) BITSDIFF(x,y)
+#define BITLANES_CLEAR(bitLanes)
+#define BITLANES_MERGE(bitLanes,bitErrorCount)
+#endif
+//}}}
 
+
+// The kernels come in families of a test's write and verify kernels, in memtestKernel
+// order. Built with -DMT_FAMILY=n, the program holds family n alone, so each family
+// can be compiled separately and on demand; without it, every kernel is built.
+#if !defined(MT_FAMILY) || MT_FAMILY == 0
 // Utility functions to write/verify pure constants in memory 
-__kernel void deviceWriteConstant(__global uint* base, uint N, const uint konstant) { //{{{
+__kernel void deviceWriteConstant(__global uint* base,const uint firstBlock,uint N, const uint konstant) { //{{{
+    SLICE_BASE(base,firstBlock,N);
     for (uint i = 0 ; i < N; i++) {      
         *(THREAD_ADDRESS(base,N,i)) = konstant;
     }
 } //}}}
-__kernel void deviceVerifyConstant(__global uint* base,uint N,const uint konstant,__global uint* blockErrorCount,__local uint* threadErrorCount) { //{{{
+__kernel void deviceVerifyConstant(__global uint* base,const uint firstBlock,uint N,const uint konstant,__global uint* blockErrorCount,__global uint* bitErrorCount,__local uint* threadErrorCount,__local uint* bitLanes) { //{{{
+    SLICE_BASE(base,firstBlock,N);
     // Verifies memory at base to make sure it has a constant pattern
     // Sums number of errors found in block and stores error count into blockErrorCount[group_id]
+    // Adds the errors in each bit lane into bitErrorCount[lane]
     // Sum-reduce this array afterwards to get total error count over tested region
-    // Uses 4*blockDim bytes of shared memory
+    // Uses 4*blockDim+128 bytes of shared memory
 
     threadErrorCount[threadIdx] = 0;
+    BITLANES_CLEAR(bitLanes);
+    barrier(CLK_LOCAL_MEM_FENCE);
 
     for (uint i = 0; i < N; i++) {
         //if ( *(THREAD_ADDRESS(base,N,i)) != constant ) threadErrorCount[threadIdx]++;
-        threadErrorCount[threadIdx] += BITSDIFF(*(THREAD_ADDRESS(base,N,i)),konstant);
+        threadErrorCount[threadIdx] += BITERRORS(bitLanes,*(THREAD_ADDRESS(base,N,i)),konstant);
     }
     // Parallel-reduce error counts over threads in block
     for (uint stride = blockDim>>1; stride > 0; stride >>= 1) {
@@ -76,6 +131,7 @@ __kernel void deviceVerifyConstant(__global uint* base,uint N,const uint konstan
             threadErrorCount[threadIdx] += threadErrorCount[threadIdx + stride];
     }
     barrier(CLK_LOCAL_MEM_FENCE);
+    BITLANES_MERGE(bitLanes,bitErrorCount);
     
     if (threadIdx == 0)
         blockErrorCount[blockIdx] = threadErrorCount[0];
@@ -85,6 +141,8 @@ __kernel void deviceVerifyConstant(__global uint* base,uint N,const uint konstan
 //}}}
 
 
+#endif
+#if !defined(MT_FAMILY) || MT_FAMILY == 1
 // Logic test //{{{
 // Idea: Run a varying number of iterations (k*N) of a short-period (per=N) LCG that returns to zero (or F's) quickly
 // Store only the result of the last iteration
@@ -107,7 +165,8 @@ __kernel void deviceVerifyConstant(__global uint* base,uint N,const uint konstan
 }
 //}}} }}}
 
-__kernel void deviceShortLCG0(__global uint* base,uint N,uint repeats,const int period) { //{{{
+__kernel void deviceShortLCG0(__global uint* base,const uint firstBlock,uint N,uint repeats,const int period) { //{{{
+    SLICE_BASE(base,firstBlock,N);
     // Pick a different block for different LCG lengths
     // Short periods are useful if LCG goes inside for i in 0..N loop
     int a,c;
@@ -129,7 +188,8 @@ __kernel void deviceShortLCG0(__global uint* base,uint N,uint repeats,const int
 } //}}} 
 // _shmem version uses shared memory to store inter-iteration values
 // is more sensitive to shared memory errors from (eg) shader overclocking 
-__kernel void deviceShortLCG0Shmem(__global uint* base,uint N,uint repeats,const int period,__local uint* shmem) { //{{{
+__kernel void deviceShortLCG0Shmem(__global uint* base,const uint firstBlock,uint N,uint repeats,const int period,__local uint* shmem) { //{{{
+    SLICE_BASE(base,firstBlock,N);
     // Pick a different block for different LCG lengths
     // Short periods are useful if LCG goes inside for i in 0..N loop
     int a,c;
@@ -152,9 +212,12 @@ __kernel void deviceShortLCG0Shmem(__global uint* base,uint N,uint repeats,const
 
 
 
+#endif
+#if !defined(MT_FAMILY) || MT_FAMILY == 2
 // Writes paired constants to memory, such that each offset that is X mod 2 receives patterns[X]
 // Used for true walking-ones/zeros 8-bit test
-__kernel void deviceWritePairedConstants(__global uint* base,uint N,uint pattern0,uint pattern1) { //{{{
+__kernel void deviceWritePairedConstants(__global uint* base,const uint firstBlock,uint N,uint pattern0,uint pattern1) { //{{{
+    SLICE_BASE(base,firstBlock,N);
     //const uint pattern = (threadIdx & 0x1) ? pattern1 : pattern0;
     uint isodd = threadIdx & 0x1;
     isodd *= 0xFFFFFFFF;
@@ -166,13 +229,17 @@ __kernel void deviceWritePairedConstants(__global uint* base,uint N,uint pattern
 
 } //}}}
 
-__kernel void deviceVerifyPairedConstants(__global uint* base,uint N,uint pattern0,uint pattern1,__global uint* blockErrorCount,__local uint* threadErrorCount) { //{{{
+__kernel void deviceVerifyPairedConstants(__global uint* base,const uint firstBlock,uint N,uint pattern0,uint pattern1,__global uint* blockErrorCount,__global uint* bitErrorCount,__local uint* threadErrorCount,__local uint* bitLanes) { //{{{
+    SLICE_BASE(base,firstBlock,N);
     // Verifies memory at base to make sure it has a correct paired-constant pattern
     // Sums number of errors found in block and stores error count into blockErrorCount[blockIdx]
+    // Adds the errors in each bit lane into bitErrorCount[lane]
     // Sum-reduce this array afterwards to get total error count over tested region
-    // Uses 4*blockDim bytes of shared memory
+    // Uses 4*blockDim+128 bytes of shared memory
     
     threadErrorCount[threadIdx] = 0;
+    BITLANES_CLEAR(bitLanes);
+    barrier(CLK_LOCAL_MEM_FENCE);
     //const uint pattern = patterns[threadIdx & 0x1];
     uint isodd = threadIdx & 0x1;
     isodd *= 0xFFFFFFFF;
@@ -181,7 +248,7 @@ __kernel void deviceVerifyPairedConstants(__global uint* base,uint N,uint patter
     
     for (uint i = 0; i < N; i++) {
         //if ( *(THREAD_ADDRESS(base,N,i)) != pattern ) threadErrorCount[threadIdx]++;
-        threadErrorCount[threadIdx] += BITSDIFF(*(THREAD_ADDRESS(base,N,i)),pattern);
+        threadErrorCount[threadIdx] += BITERRORS(bitLanes,*(THREAD_ADDRESS(base,N,i)),pattern);
     }
     // Parallel-reduce error counts over threads in block
     for (uint stride = blockDim>>1; stride > 0; stride >>= 1) {
@@ -190,6 +257,7 @@ __kernel void deviceVerifyPairedConstants(__global uint* base,uint N,uint patter
             threadErrorCount[threadIdx] += threadErrorCount[threadIdx + stride];
     }
     barrier(CLK_LOCAL_MEM_FENCE);
+    BITLANES_MERGE(bitLanes,bitErrorCount);
     
     if (threadIdx == 0)
         blockErrorCount[blockIdx] = threadErrorCount[0];
@@ -198,7 +266,10 @@ __kernel void deviceVerifyPairedConstants(__global uint* base,uint N,uint patter
 }
 //}}}
 
-__kernel void deviceWriteWalking32Bit(__global uint* base,uint N,int ones,uint shift) { //{{{
+#endif
+#if !defined(MT_FAMILY) || MT_FAMILY == 3
+__kernel void deviceWriteWalking32Bit(__global uint* base,const uint firstBlock,uint N,int ones,uint shift) { //{{{
+    SLICE_BASE(base,firstBlock,N);
     // Writes one iteration of the walking-{ones/zeros} 32-bit pattern to gpu memory
 
     // Want to write in a 1 << (offset from base + shift % 32)
@@ -213,20 +284,24 @@ __kernel void deviceWriteWalking32Bit(__global uint* base,uint N,int ones,uint s
     }
 } //}}}
 
-__kernel void deviceVerifyWalking32Bit(__global uint* base,uint N,int ones,uint shift,__global uint* blockErrorCount,__local uint* threadErrorCount) { //{{{
+__kernel void deviceVerifyWalking32Bit(__global uint* base,const uint firstBlock,uint N,int ones,uint shift,__global uint* blockErrorCount,__global uint* bitErrorCount,__local uint* threadErrorCount,__local uint* bitLanes) { //{{{
+    SLICE_BASE(base,firstBlock,N);
     // Verifies memory at base to make sure it has a constant pattern
     // Sums number of errors found in block and stores error count into blockErrorCount[blockIdx]
+    // Adds the errors in each bit lane into bitErrorCount[lane]
     // Sum-reduce this array afterwards to get total error count over tested region
-    // Uses 4*blockDim bytes of shared memory
+    // Uses 4*blockDim+128 bytes of shared memory
     
     threadErrorCount[threadIdx] = 0;
+    BITLANES_CLEAR(bitLanes);
+    barrier(CLK_LOCAL_MEM_FENCE);
 
     uint pattern = 1 << ((threadIdx + shift) & 0x1f);
     pattern = ones ? pattern : ~pattern;
     
     for (uint i = 0; i < N; i++) {
         //if ( *(THREAD_ADDRESS(base,N,i)) != pattern ) threadErrorCount[threadIdx]++;
-        threadErrorCount[threadIdx] += BITSDIFF(*(THREAD_ADDRESS(base,N,i)),pattern);
+        threadErrorCount[threadIdx] += BITERRORS(bitLanes,*(THREAD_ADDRESS(base,N,i)),pattern);
     }
     // Parallel-reduce error counts over threads in block
     for (uint stride = blockDim>>1; stride > 0; stride >>= 1) {
@@ -235,6 +310,7 @@ __kernel void deviceVerifyWalking32Bit(__global uint* base,uint N,int ones,uint
             threadErrorCount[threadIdx] += threadErrorCount[threadIdx + stride];
     }
     barrier(CLK_LOCAL_MEM_FENCE);
+    BITLANES_MERGE(bitLanes,bitErrorCount);
     
     if (threadIdx == 0)
         blockErrorCount[blockIdx] = threadErrorCount[0];
@@ -243,6 +319,8 @@ __kernel void deviceVerifyWalking32Bit(__global uint* base,uint N,int ones,uint
 }
 //}}}
 
+#endif
+#if !defined(MT_FAMILY) || MT_FAMILY == 4
 // Math functions modulo the Mersenne prime 2^31 -1 {{{
 void deviceMul3131 (uint v1, uint v2,uint* LO, uint* HI)
 {
@@ -325,7 +403,8 @@ int deviceIrbit2_local(__local uint* seed) {
     }
 }
 //}}}
-__kernel void deviceWriteRandomBlocks(__global uint* base,uint N,int seed,__local uint* randomBlock) { //{{{
+__kernel void deviceWriteRandomBlocks(__global uint* base,const uint firstBlock,uint N,int seed,__local uint* randomBlock) { //{{{
+    SLICE_BASE(base,firstBlock,N);
     // Requires 4*nThreads bytes of local memory
     // Make sure seed is not zero.
     if (seed == 0) seed = 123459876+blockIdx;
@@ -348,13 +427,17 @@ __kernel void deviceWriteRandomBlocks(__global uint* base,uint N,int seed,__loca
     }
 }
 //}}}
-__kernel void deviceVerifyRandomBlocks(__global uint* base,uint N,int seed,__global uint* blockErrorCount,__local uint* threadErrorCount,__local uint* randomBlock,__local uint* bitSeeds) { //{{{
+__kernel void deviceVerifyRandomBlocks(__global uint* base,const uint firstBlock,uint N,int seed,__global uint* blockErrorCount,__global uint* bitErrorCount,__local uint* threadErrorCount,__local uint* randomBlock,__local uint* bitSeeds,__local uint* bitLanes) { //{{{
+    SLICE_BASE(base,firstBlock,N);
     // Verifies memory at base to make sure it has a correct random pattern given the seed
     // Sums number of errors found in block and stores error count into blockErrorCount[blockIdx]
+    // Adds the errors in each bit lane into bitErrorCount[lane]
     // Sum-reduce this array afterwards to get total error count over tested region
-    // Uses 12*blockDim bytes of local memory
+    // Uses 12*blockDim+128 bytes of local memory
     
     threadErrorCount[threadIdx] = 0;
+    BITLANES_CLEAR(bitLanes);
+    barrier(CLK_LOCAL_MEM_FENCE);
 
     // Make sure seed is not zero.
     if (seed == 0) seed = 123459876+blockIdx;
@@ -373,7 +456,7 @@ __kernel void deviceVerifyRandomBlocks(__global uint* base,uint N,int seed,__glo
         // Prevent a race condition in which last work-item can overwrite seed before others have read it
         barrier(CLK_LOCAL_MEM_FENCE);
         
-        threadErrorCount[threadIdx] += BITSDIFF(*(THREAD_ADDRESS(base,N,i)),randomBlock[threadIdx]);
+        threadErrorCount[threadIdx] += BITERRORS(bitLanes,*(THREAD_ADDRESS(base,N,i)),randomBlock[threadIdx]);
         
     }
 
@@ -384,6 +467,7 @@ __kernel void deviceVerifyRandomBlocks(__global uint* base,uint N,int seed,__glo
             threadErrorCount[threadIdx] += threadErrorCount[threadIdx + stride];
     }
     barrier(CLK_LOCAL_MEM_FENCE);
+    BITLANES_MERGE(bitLanes,bitErrorCount);
     
     if (threadIdx == 0)
         blockErrorCount[blockIdx] = threadErrorCount[0];
@@ -392,8 +476,11 @@ __kernel void deviceVerifyRandomBlocks(__global uint* base,uint N,int seed,__glo
 }
 //}}}
 
+#endif
+#if !defined(MT_FAMILY) || MT_FAMILY == 5
 #ifndef MODX_WITHOUT_MOD
-__kernel void deviceWritePairedModulo(__global uint* base,const uint N,const uint shift,const uint pattern1,const uint pattern2,const uint modulus,const uint iters) { //{{{
+__kernel void deviceWritePairedModulo(__global uint* base,const uint firstBlock,const uint N,const uint shift,const uint pattern1,const uint pattern2,const uint modulus,const uint iters) { //{{{
+    SLICE_BASE(base,firstBlock,N);
     // First writes pattern1 into every offset that is 0 mod modulus
     // Next  (iters times) writes ~pattern1 into every other address
     uint offset;
@@ -410,7 +497,8 @@ __kernel void deviceWritePairedModulo(__global uint* base,const uint N,const uin
     }
 } //}}}
 #else
-__kernel void deviceWritePairedModulo(__global uint* base,const uint N,const uint shift,const uint pattern1,const uint pattern2,const uint modulus,const uint iters) { //{{{
+__kernel void deviceWritePairedModulo(__global uint* base,const uint firstBlock,const uint N,const uint shift,const uint pattern1,const uint pattern2,const uint modulus,const uint iters) { //{{{
+    SLICE_BASE(base,firstBlock,N);
     // First writes pattern1 into every offset that is 0 mod modulus
     // Next  (iters times) writes ~pattern1 into every other address
 
@@ -455,17 +543,21 @@ __kernel void deviceWritePairedModulo(__global uint* base,const uint N,const uin
     }
 } //}}}
 #endif
-__kernel void deviceVerifyPairedModulo(__global uint* base,uint N,const uint shift,const uint pattern1,const uint modulus,__global uint* blockErrorCount,__local uint* threadErrorCount) { //{{{
+__kernel void deviceVerifyPairedModulo(__global uint* base,const uint firstBlock,uint N,const uint shift,const uint pattern1,const uint modulus,__global uint* blockErrorCount,__global uint* bitErrorCount,__local uint* threadErrorCount,__local uint* bitLanes) { //{{{
+    SLICE_BASE(base,firstBlock,N);
     // Verifies that memory at each (offset mod modulus == shift) stores pattern1
     // Sums number of errors found in block and stores error count into blockErrorCount[blockIdx]
+    // Adds the errors in each bit lane into bitErrorCount[lane]
     // Sum-reduce this array afterwards to get total error count over tested region
-    // Uses 4*blockDim bytes of shared memory
+    // Uses 4*blockDim+128 bytes of shared memory
     threadErrorCount[threadIdx] = 0;
+    BITLANES_CLEAR(bitLanes);
+    barrier(CLK_LOCAL_MEM_FENCE);
     uint offset;
     
     for (uint i = 0; i < N; i++) {
         offset = THREAD_OFFSET(N,i);
-        if ((offset % modulus) == shift) threadErrorCount[threadIdx] += BITSDIFF(*(base+offset),pattern1);
+        if ((offset % modulus) == shift) threadErrorCount[threadIdx] += BITERRORS(bitLanes,*(base+offset),pattern1);
     }
     // Parallel-reduce error counts over threads in block
     for (uint stride = blockDim>>1; stride > 0; stride >>= 1) {
@@ -474,6 +566,7 @@ __kernel void deviceVerifyPairedModulo(__global uint* base,uint N,const uint shi
             threadErrorCount[threadIdx] += threadErrorCount[threadIdx + stride];
     }
     barrier(CLK_LOCAL_MEM_FENCE);
+    BITLANES_MERGE(bitLanes,bitErrorCount);
     
     if (threadIdx == 0)
         blockErrorCount[blockIdx] = threadErrorCount[0];
@@ -481,3 +574,4 @@ __kernel void deviceVerifyPairedModulo(__global uint* base,uint N,const uint shi
     return;
 }
 //}}}
+#endif
@@ -0,0 +1,151 @@
+/*
+ * memtestCL_logdump.cpp
+ * Decoder for MemtestCL binary event logs (--event-log): prints the records
+ * oldest first as text or JSON Lines, and names any kernel that was launched
+ * but never completed, as a kernel that hung or crashed the driver would be.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <map>
+
+#include "ezOptionParser.hpp"
+
+#include "memtestCL_eventlog.h"
+
+static const char* typeName(unsigned short type) {
+    switch (type) {
+        case LOG_RUN:       return "run";
+        case LOG_LAUNCH:    return "launch";
+        case LOG_KERNEL:    return "kernel";
+        case LOG_CHUNK:     return "chunk";
+        case LOG_ITERATION: return "iteration";
+        case LOG_FAULT:     return "fault";
+        default:            return "unknown";
+    }
+}
+static const char* testName(unsigned short test) {
+    return (test < MT_N_METHODS) ? methodName((memtestMethod)test) : "";
+}
+static const char* recordKernelName(unsigned short kernel) {
+    return (kernel < MT_N_KERNELS) ? kernelName((memtestKernel)kernel) : "";
+}
+static int recordParamCount(const memtestLogRecord& r) {
+    if (r.kernel < MT_N_KERNELS) return kernelParamCount((memtestKernel)r.kernel);
+    int n = 5;
+    while (n > 0 && r.params[n-1] == 0) n--;
+    return n;
+}
+
+// Seconds since the epoch at which r was written
+static double recordTime(const memtestLogHeader& h,const memtestLogRecord& r) {
+    return ((double)h.startTimeUs + ((double)r.timeUs-(double)h.startUs))/1e6;
+}
+
+static void printText(const memtestLogHeader& h,const memtestLogRecord& r) {
+    const double t = recordTime(h,r);
+    const time_t seconds = (time_t)t;
+    char when[32];
+    strftime(when,sizeof(when),"%Y-%m-%d %H:%M:%S",localtime(&seconds));
+    printf("%s.%06u %-9s iter %u",when,(uint)((t-seconds)*1e6),typeName(r.type),r.iteration+1);
+    if (r.type == LOG_RUN) {
+        printf(": %u MiB in %u chunks\n",r.N,r.blocks);
+        return;
+    }
+    if (r.type == LOG_ITERATION) {
+        printf(": %u errors, %.1f ms\n",r.errorCount,r.durationUs/1000.0);
+        return;
+    }
+    printf(" chunk %u %s",r.chunk,testName(r.test));
+    if (r.type == LOG_CHUNK) printf(" (%u MiB)",r.N);
+    else printf(" %s N=%u blocks=%u",recordKernelName(r.kernel),r.N,r.blocks);
+    const int nParams = recordParamCount(r);
+    // Kernels take patterns and seeds; chunks the test's own parameters
+    for (int i = 0; i < nParams; i++) printf((r.type == LOG_CHUNK) ? "%s%u" : "%s0x%X",i ? "," : " params=",r.params[i]);
+    // A fault's error count is the status it failed with
+    if (r.type == LOG_FAULT) printf(": %s after %.1f ms",descriptionOfError((cl_int)r.errorCount),r.durationUs/1000.0);
+    else if (r.type != LOG_LAUNCH) printf(": %u errors, %.1f ms",r.errorCount,r.durationUs/1000.0);
+    printf("\n");
+}
+
+static void printJSON(const memtestLogHeader& h,const memtestLogRecord& r) {
+    printf("{\"seq\": %llu, \"time\": %.6f, \"type\": \"%s\", \"iteration\": %u",r.seq,recordTime(h,r),typeName(r.type),r.iteration+1);
+    if (r.type == LOG_RUN) {
+        printf(", \"megs\": %u, \"chunks\": %u}\n",r.N,r.blocks);
+        return;
+    }
+    if (r.type != LOG_ITERATION) {
+        printf(", \"chunk\": %u",r.chunk);
+        if (r.test < MT_N_METHODS) printf(", \"test\": \"%s\"",testName(r.test));
+        if (r.type == LOG_CHUNK) printf(", \"megs\": %u",r.N);
+        else printf(", \"kernel\": \"%s\", \"N\": %u, \"blocks\": %u",recordKernelName(r.kernel),r.N,r.blocks);
+        const int nParams = recordParamCount(r);
+        printf(", \"params\": [");
+        for (int i = 0; i < nParams; i++) printf("%s%u",i ? ", " : "",r.params[i]);
+        printf("]");
+    }
+    if (r.type == LOG_FAULT) printf(", \"status\": %d, \"error\": \"%s\", \"duration_us\": %u",(cl_int)r.errorCount,descriptionOfError((cl_int)r.errorCount),r.durationUs);
+    else if (r.type != LOG_LAUNCH) printf(", \"errors\": %u, \"duration_us\": %u",r.errorCount,r.durationUs);
+    printf("}\n");
+}
+
+void print_usage() { //{{{
+    printf("Usage: memtestCL_logdump [--json] [--tail N] FILE\n");
+    printf("Prints the records of a MemtestCL event log (written with --event-log), oldest first.\n");
+    printf("        --json           : one JSON object per record instead of text\n");
+    printf("        --tail N         : only the last N records\n");
+} //}}}
+
+int main(int argc,const char** argv) {
+    ez::ezOptionParser opt;
+    opt.add("",0,0,0,"one JSON object per record\n","--json");
+    opt.add("0",0,1,0,"only the last N records\n","--tail");
+    opt.add("",0,0,0,"show usage\n","--help","-h");
+    opt.parse(argc,argv);
+    if (opt.isSet("--help") || opt.lastArgs.size() != 1) {
+        print_usage();
+        return opt.isSet("--help") ? 0 : 2;
+    }
+    const bool json = opt.isSet("--json");
+    int tail = 0;
+    opt.get("--tail")->getInt(tail);
+    const char* filename = opt.lastArgs[0]->c_str();
+
+    memtestLogHeader header;
+    vector<memtestLogRecord> records;
+    std::string error;
+    if (!memtestEventLog::load(filename,header,records,error)) {
+        printf("Error: could not read %s: %s\n",filename,error.c_str());
+        return 2;
+    }
+    if (!json) {
+        printf("Event log of %s: %u records (ring of %u)\n",header.device,(uint)records.size(),header.capacity);
+        if (!records.empty() && records[0].seq > 1)
+            printf("The oldest %llu records were overwritten\n",records[0].seq-1);
+    }
+
+    // The latest launch on each chunk that has no completion record after it
+    std::map<uint,size_t> inFlight;
+    const size_t first = (tail > 0 && (size_t)tail < records.size()) ? records.size()-tail : 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        const memtestLogRecord& r = records[i];
+        if (r.type == LOG_LAUNCH) inFlight[r.chunk] = i;
+        if (r.type == LOG_KERNEL || r.type == LOG_FAULT) inFlight.erase(r.chunk);
+        if (i < first) continue;
+        if (json) printJSON(header,r);
+        else printText(header,r);
+    }
+    if (!json) {
+        for (std::map<uint,size_t>::const_iterator i = inFlight.begin(); i != inFlight.end(); i++) {
+            printf("Never completed: ");
+            printText(header,records[i->second]);
+        }
+    }
+    return 0;
+}
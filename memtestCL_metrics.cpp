@@ -0,0 +1,126 @@
+/*
+ * memtestCL_metrics.cpp
+ * Live Prometheus metrics for MemtestCL.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include "memtestCL_metrics.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Upper bounds of the test duration histogram buckets, in seconds; the last is +Inf
+static const double bucketBounds[memtestMetrics::n_buckets-1] = {0.001,0.005,0.01,0.05,0.1,0.5,1,5,10};
+
+memtestMetrics::memtestMetrics(const std::string& deviceName,int nTests,const char* const* testNames) :
+    device(deviceName), currentTest(0), iterations(0), failedIterations(0), allocatedMB(0), bandwidthBps(0)
+{
+    for (int t = 0; t < nTests; t++) names.push_back(testNames[t]);
+    tests = new testCounters[nTests];
+    memset((void*)tests,0,nTests*sizeof(testCounters));
+}
+
+void memtestMetrics::chunkDone(const memtestChunkResult& r) {
+    const unsigned long long t = memtestAtomicLoad(currentTest);
+    if (t >= names.size()) return;
+    testCounters& c = tests[t];
+    const double seconds = r.ms/1000.0;
+    int b = 0;
+    while (b < n_buckets-1 && seconds > bucketBounds[b]) b++;
+    memtestAtomicAdd(c.errors,r.errorCount);
+    memtestAtomicAdd(c.runs,1);
+    memtestAtomicAdd(c.bytes,r.bytes);
+    memtestAtomicAdd(c.durationUs,(unsigned long long)(r.ms*1000.0));
+    memtestAtomicAdd(c.buckets[b],1);
+    if (seconds > 0) setBandwidth(r.bytes/seconds);
+}
+
+void memtestMetrics::iterationDone(bool failed) {
+    memtestAtomicAdd(iterations,1);
+    if (failed) memtestAtomicAdd(failedIterations,1);
+}
+
+static std::string labelValue(const std::string& s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '\\' || s[i] == '"') out += '\\';
+        if (s[i] == '\n') {
+            out += "\\n";
+            continue;
+        }
+        out += s[i];
+    }
+    return out;
+}
+
+std::string memtestMetrics::render() {
+    std::string out;
+    char line[512];
+    #define METRIC_HEADER(name,type,help) out += "# HELP " name " " help "\n# TYPE " name " " type "\n"
+
+    METRIC_HEADER("memtestcl_info","gauge","Device under test.");
+    out += "memtestcl_info{device=\"" + labelValue(device) + "\"} 1\n";
+
+    METRIC_HEADER("memtestcl_allocated_mebibytes","gauge","Device memory under test.");
+    sprintf(line,"memtestcl_allocated_mebibytes %llu\n",memtestAtomicLoad(allocatedMB));
+    out += line;
+
+    METRIC_HEADER("memtestcl_iterations_total","counter","Test iterations completed.");
+    sprintf(line,"memtestcl_iterations_total %llu\n",memtestAtomicLoad(iterations));
+    out += line;
+
+    METRIC_HEADER("memtestcl_failed_iterations_total","counter","Test iterations with at least one error.");
+    sprintf(line,"memtestcl_failed_iterations_total %llu\n",memtestAtomicLoad(failedIterations));
+    out += line;
+
+    METRIC_HEADER("memtestcl_bandwidth_bytes_per_second","gauge","Device memory bandwidth achieved by the latest test.");
+    sprintf(line,"memtestcl_bandwidth_bytes_per_second %llu\n",memtestAtomicLoad(bandwidthBps));
+    out += line;
+
+    METRIC_HEADER("memtestcl_softwait_seconds_total","counter","Time spent waiting for device commands in softwaitForEvents.");
+    sprintf(line,"memtestcl_softwait_seconds_total %.6f\n",softwaitMicroseconds()/1e6);
+    out += line;
+
+    METRIC_HEADER("memtestcl_errors_total","counter","Incorrect bits found, by test.");
+    for (size_t t = 0; t < names.size(); t++) {
+        sprintf(line,"memtestcl_errors_total{test=\"%s\"} %llu\n",labelValue(names[t]).c_str(),memtestAtomicLoad(tests[t].errors));
+        out += line;
+    }
+    METRIC_HEADER("memtestcl_bytes_total","counter","Device memory read and written, by test.");
+    for (size_t t = 0; t < names.size(); t++) {
+        sprintf(line,"memtestcl_bytes_total{test=\"%s\"} %llu\n",labelValue(names[t]).c_str(),memtestAtomicLoad(tests[t].bytes));
+        out += line;
+    }
+    METRIC_HEADER("memtestcl_test_duration_seconds","histogram","Duration of one test on one chunk of memory.");
+    for (size_t t = 0; t < names.size(); t++) {
+        const std::string name = labelValue(names[t]);
+        unsigned long long cumulative = 0;
+        for (int b = 0; b < n_buckets; b++) {
+            cumulative += memtestAtomicLoad(tests[t].buckets[b]);
+            if (b < n_buckets-1)
+                sprintf(line,"memtestcl_test_duration_seconds_bucket{test=\"%s\",le=\"%g\"} %llu\n",name.c_str(),bucketBounds[b],cumulative);
+            else
+                sprintf(line,"memtestcl_test_duration_seconds_bucket{test=\"%s\",le=\"+Inf\"} %llu\n",name.c_str(),cumulative);
+            out += line;
+        }
+        sprintf(line,"memtestcl_test_duration_seconds_sum{test=\"%s\"} %.6f\n",name.c_str(),memtestAtomicLoad(tests[t].durationUs)/1e6);
+        out += line;
+        sprintf(line,"memtestcl_test_duration_seconds_count{test=\"%s\"} %llu\n",name.c_str(),memtestAtomicLoad(tests[t].runs));
+        out += line;
+    }
+    #undef METRIC_HEADER
+    return out;
+}
+
+void memtestMetricsServer::handle(long long fd) {
+    // Every path gets the metrics
+    std::string request;
+    if (!recvUntil(fd,request,"\r\n\r\n",1000)) return;
+    const std::string body = metrics.render();
+    char header[256];
+    sprintf(header,"HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",(uint)body.size());
+    sendAll(fd,std::string(header) + body);
+}
@@ -0,0 +1,65 @@
+/*
+ * memtestCL_metrics.h
+ * Live metrics for MemtestCL in the Prometheus text exposition format,
+ * served over HTTP on a Unix domain socket or a TCP port.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_METRICS_H_
+#define _MEMTESTCL_METRICS_H_
+
+#include "memtestCL_core.h"
+#include "memtestCL_thread.h"
+#include "memtestCL_socket.h"
+#include <string>
+
+// Counters of a run. All updates are single atomic operations, so the test thread
+// never waits for a scrape; render() reads them from the server thread.
+class memtestMetrics : public memtestListener { //{{{
+public:
+    static const int n_buckets = 10;
+protected:
+    struct testCounters {
+        memtestCounter errors;
+        memtestCounter runs;
+        memtestCounter bytes;
+        memtestCounter durationUs;
+        memtestCounter buckets[n_buckets]; // per-bucket (not cumulative) counts
+    };
+    std::string device;
+    vector<std::string> names;
+    testCounters* tests;
+    memtestCounter currentTest;
+    memtestCounter iterations;
+    memtestCounter failedIterations;
+    memtestCounter allocatedMB;
+    memtestCounter bandwidthBps;
+public:
+    memtestMetrics(const std::string& deviceName,int nTests,const char* const* testNames);
+    virtual ~memtestMetrics() {delete[] tests;}
+
+    // Test that subsequent chunk results belong to
+    void setTest(int test) {memtestAtomicStore(currentTest,(unsigned long long)test);}
+    virtual void chunkDone(const memtestChunkResult& r);
+    void iterationDone(bool failed);
+    void setAllocated(uint megs) {memtestAtomicStore(allocatedMB,megs);}
+    void setBandwidth(double bytesPerSecond) {memtestAtomicStore(bandwidthBps,(unsigned long long)bytesPerSecond);}
+
+    // Prometheus text exposition format
+    std::string render();
+}; //}}}
+
+// Serves memtestMetrics::render() over HTTP to every request, on a background thread
+class memtestMetricsServer : public memtestSocketServer { //{{{
+protected:
+    memtestMetrics& metrics;
+    virtual void handle(long long fd);
+public:
+    memtestMetricsServer(memtestMetrics& m) : metrics(m) {}
+    virtual ~memtestMetricsServer() {stop();}
+}; //}}}
+
+#endif
@@ -0,0 +1,293 @@
+/*
+ * memtestCL_output.cpp
+ * Machine-readable result output for MemtestCL.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include "memtestCL_output.h"
+#include <string.h>
+#include <time.h>
+
+// Background writer {{{
+memtestBackgroundWriter::memtestBackgroundWriter(const char* filename) :
+    f(NULL), ownsFile(false), closing(false), failed(false)
+{
+    if (strcmp(filename,"-") == 0) {
+        f = stdout;
+    } else {
+        f = fopen(filename,"w");
+        ownsFile = true;
+    }
+    if (f == NULL) {
+        failed = true;
+        return;
+    }
+    if (!thread.start(run,this)) failed = true;
+}
+void memtestBackgroundWriter::run(void* self) {
+    ((memtestBackgroundWriter*)self)->drain();
+}
+void memtestBackgroundWriter::drain() {
+    std::string chunk;
+    mutex.lock();
+    for (;;) {
+        while (pending.empty() && !closing) wakeup.wait(mutex);
+        if (pending.empty()) break;
+        // Swap the buffer out so writers never wait on file I/O
+        chunk.swap(pending);
+        mutex.unlock();
+        bool ok = fwrite(chunk.data(),1,chunk.size(),f) == chunk.size() && fflush(f) == 0;
+        chunk.clear();
+        mutex.lock();
+        if (!ok) failed = true;
+    }
+    mutex.unlock();
+}
+bool memtestBackgroundWriter::ok() {
+    // Still meaningful after close(), which is when callers check it
+    memtestLock lock(mutex);
+    return !failed;
+}
+void memtestBackgroundWriter::write(const std::string& data) {
+    if (f == NULL) return;
+    if (!thread.isRunning()) {
+        // No writer thread; write synchronously
+        if (fwrite(data.data(),1,data.size(),f) != data.size()) failed = true;
+        return;
+    }
+    memtestLock lock(mutex);
+    pending += data;
+    wakeup.signal();
+}
+void memtestBackgroundWriter::close() {
+    if (f == NULL) return;
+    mutex.lock();
+    closing = true;
+    wakeup.signal();
+    mutex.unlock();
+    thread.join();
+    if (ownsFile) {
+        if (fclose(f) != 0) failed = true;
+    } else {
+        fflush(f);
+    }
+    f = NULL;
+}
+//}}}
+
+// Record formatting {{{
+std::string jsonQuote(const std::string& s) {
+    std::string out = "\"";
+    for (size_t i = 0; i < s.size(); i++) {
+        const unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char esc[8];
+            sprintf(esc,"\\u%04x",c);
+            out += esc;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+static std::string csvQuote(const std::string& s) {
+    if (s.find_first_of(",\"\n") == std::string::npos) return s;
+    std::string out = "\"";
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '"') out += '"';
+        out += s[i];
+    }
+    return out + "\"";
+}
+
+memtestResultSink::field::field(const char* n,const std::string& value) : name(n), json(jsonQuote(value)), csv(csvQuote(value)) {}
+memtestResultSink::field::field(const char* n,const char* value) : name(n), json(jsonQuote(value)), csv(csvQuote(value)) {}
+memtestResultSink::field::field(const char* n,double value) : name(n) {
+    char buf[64];
+    sprintf(buf,"%.6g",value);
+    json = csv = buf;
+}
+memtestResultSink::field::field(const char* n,unsigned long long value) : name(n) {
+    char buf[64];
+    sprintf(buf,"%llu",value);
+    json = csv = buf;
+}
+
+// Columns of the CSV output; each record fills in the ones it has
+static const char* csvColumns[] = {
+    "type","time","device","iteration","test_id","test","step","chunk","chunk_mb","kernel","params",
+    "errors","duration_ms","bytes","gbps","failed","iterations","failed_iterations","steps_run","megs","chunks","completed","state",
+    "gib_hours","errors_per_gib_hour","rate_lower","rate_upper","fit_per_mbit","sporadic","persistent_fraction",
+    "decision","failures","llr","accept_bound","reject_bound",
+    "region","offset_mb","region_mb"
+};
+static const int n_csv_columns = sizeof(csvColumns)/sizeof(csvColumns[0]);
+
+memtestResultSink::memtestResultSink(memtestBackgroundWriter& writer,memtestOutputFormat fmt,const std::string& deviceName) :
+    out(writer), format(fmt), device(deviceName), iteration(0), testId(-1), step(0)
+{
+    if (format == OUTPUT_CSV) {
+        std::string header;
+        for (int c = 0; c < n_csv_columns; c++) {
+            if (c) header += ',';
+            header += csvColumns[c];
+        }
+        out.write(header + "\n");
+    }
+}
+
+void memtestResultSink::emit(const char* type,const vector<field>& fields) {
+    std::string line;
+    const unsigned long long now = (unsigned long long)time(NULL);
+    if (format == OUTPUT_JSONL) {
+        line = "{\"type\":" + jsonQuote(type) + ",\"time\":" + field("time",now).json + ",\"device\":" + jsonQuote(device);
+        for (size_t i = 0; i < fields.size(); i++) {
+            line += ",\"";
+            line += fields[i].name;
+            line += "\":" + fields[i].json;
+        }
+        line += "}\n";
+    } else {
+        vector<std::string> columns(n_csv_columns);
+        columns[0] = type;
+        columns[1] = field("time",now).csv;
+        columns[2] = csvQuote(device);
+        for (size_t i = 0; i < fields.size(); i++) {
+            for (int c = 3; c < n_csv_columns; c++) {
+                if (strcmp(csvColumns[c],fields[i].name) == 0) columns[c] = fields[i].csv;
+            }
+        }
+        for (int c = 0; c < n_csv_columns; c++) {
+            if (c) line += ',';
+            line += columns[c];
+        }
+        line += "\n";
+    }
+    out.write(line);
+}
+//}}}
+
+void memtestResultSink::setContext(uint iter,int test,const std::string& name,uint stepIndex) {
+    iteration = iter;
+    testId = test;
+    testName = name;
+    step = stepIndex;
+}
+
+void memtestResultSink::runStarted(uint megs,uint chunks) {
+    vector<field> f;
+    f.push_back(field("megs",(unsigned long long)megs));
+    f.push_back(field("chunks",(unsigned long long)chunks));
+    emit("run",f);
+}
+
+void memtestResultSink::chunkDone(const memtestChunkResult& r) {
+    std::string json = "{", csv;
+    for (int p = 0; p < r.nParams; p++) {
+        char value[32];
+        sprintf(value,"%u",r.params[p]);
+        if (p) {
+            json += ",";
+            csv += ";";
+        }
+        json += jsonQuote(r.paramNames[p]) + ":" + value;
+        csv += std::string(r.paramNames[p]) + "=" + value;
+    }
+    json += "}";
+
+    vector<field> f;
+    f.push_back(field("iteration",(unsigned long long)iteration+1));
+    f.push_back(field("test_id",(unsigned long long)testId));
+    f.push_back(field("test",testName));
+    f.push_back(field("step",(unsigned long long)step));
+    f.push_back(field("chunk",(unsigned long long)r.chunk));
+    f.push_back(field("chunk_mb",(unsigned long long)r.chunkMB));
+    f.push_back(field("kernel",r.test));
+    f.push_back(field("params",json,csvQuote(csv)));
+    f.push_back(field("errors",(unsigned long long)r.errorCount));
+    f.push_back(field("duration_ms",r.ms));
+    f.push_back(field("bytes",r.bytes));
+    f.push_back(field("gbps",(r.ms > 0) ? r.bytes/(r.ms*1e6) : 0.0));
+    emit("test",f);
+}
+
+void memtestResultSink::iterationDone(uint iter,unsigned long long errors,bool failed,double ms) {
+    vector<field> f;
+    f.push_back(field("iteration",(unsigned long long)iter+1));
+    f.push_back(field("errors",errors));
+    f.push_back(field("failed",failed ? "true" : "false",failed ? "1" : "0"));
+    f.push_back(field("duration_ms",ms));
+    emit("iteration",f);
+}
+
+void memtestResultSink::testSummary(int test,const std::string& name,unsigned long long errors,unsigned long long failedIters,uint stepsRun) {
+    vector<field> f;
+    f.push_back(field("test_id",(unsigned long long)test));
+    f.push_back(field("test",name));
+    f.push_back(field("errors",errors));
+    f.push_back(field("failed_iterations",failedIters));
+    f.push_back(field("steps_run",(unsigned long long)stepsRun));
+    emit("test_summary",f);
+}
+
+void memtestResultSink::testStatistics(int test,const std::string& name,const memtestErrorStats& stats) {
+    const memtestRate r = stats.errorRate();
+    vector<field> f;
+    if (test >= 0) f.push_back(field("test_id",(unsigned long long)test));
+    f.push_back(field("test",name));
+    f.push_back(field("errors",stats.errorCount()));
+    f.push_back(field("iterations",stats.runCount()));
+    f.push_back(field("failed_iterations",stats.failedRunCount()));
+    f.push_back(field("gib_hours",stats.exposure()));
+    f.push_back(field("errors_per_gib_hour",r.rate));
+    f.push_back(field("rate_lower",r.lower));
+    f.push_back(field("rate_upper",r.upper));
+    f.push_back(field("fit_per_mbit",fitPerMbit(r.rate)));
+    f.push_back(field("sporadic",stats.sporadicFailures()));
+    f.push_back(field("persistent_fraction",stats.persistentFraction()));
+    emit("test_stats",f);
+}
+
+void memtestResultSink::summary(uint iters,unsigned long long errors,unsigned long long failedIters,bool completed) {
+    vector<field> f;
+    f.push_back(field("iterations",(unsigned long long)iters));
+    f.push_back(field("errors",errors));
+    f.push_back(field("failed_iterations",failedIters));
+    f.push_back(field("completed",completed ? "true" : "false",completed ? "1" : "0"));
+    emit("summary",f);
+}
+
+void memtestResultSink::screenDecision(const memtestScreen& screen,memtestScreenDecision decision,const memtestErrorStats& evidence) {
+    vector<field> f;
+    f.push_back(field("decision",memtestScreen::decisionName(decision)));
+    f.push_back(field("failures",evidence.failedRunCount()));
+    f.push_back(field("gib_hours",evidence.exposure()));
+    f.push_back(field("llr",screen.logLikelihoodRatio(evidence.failedRunCount(),evidence.exposure())));
+    f.push_back(field("accept_bound",screen.getAcceptBound()));
+    f.push_back(field("reject_bound",screen.getRejectBound()));
+    emit("screen",f);
+}
+
+void memtestResultSink::regionErrors(uint chunk,uint region,uint regionMB,unsigned long long errors) {
+    vector<field> f;
+    f.push_back(field("chunk",(unsigned long long)chunk));
+    f.push_back(field("region",(unsigned long long)region));
+    f.push_back(field("offset_mb",(unsigned long long)region*regionMB));
+    f.push_back(field("region_mb",(unsigned long long)regionMB));
+    f.push_back(field("errors",errors));
+    emit("region",f);
+}
+
+void memtestResultSink::daemonState(const char* state,uint megs) {
+    vector<field> f;
+    f.push_back(field("state",state));
+    f.push_back(field("megs",(unsigned long long)megs));
+    emit("daemon",f);
+}
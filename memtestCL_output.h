@@ -0,0 +1,94 @@
+/*
+ * memtestCL_output.h
+ * Machine-readable result output for MemtestCL: JSON Lines or CSV records
+ * for every test execution on every chunk of memory, every iteration and
+ * the run summary, written by a background thread.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_OUTPUT_H_
+#define _MEMTESTCL_OUTPUT_H_
+
+#include "memtestCL_core.h"
+#include "memtestCL_thread.h"
+#include "memtestCL_stats.h"
+#include <string>
+
+// Buffered writer whose file I/O happens on a background thread, so that writers
+// only ever wait for an append to an in-memory buffer
+class memtestBackgroundWriter { //{{{
+protected:
+    FILE* f;
+    bool ownsFile;
+    std::string pending;
+    bool closing;
+    bool failed;
+    memtestMutex mutex;
+    memtestCondition wakeup;
+    memtestThread thread;
+    static void run(void* self);
+    void drain();
+public:
+    // Opens filename for writing ("-" is standard output)
+    memtestBackgroundWriter(const char* filename);
+    ~memtestBackgroundWriter() {close();}
+    bool isOpen() const {return f != NULL;}
+    // False once any write has failed
+    bool ok();
+    void write(const std::string& data);
+    // Writes everything buffered and stops the writer thread
+    void close();
+}; //}}}
+
+enum memtestOutputFormat {OUTPUT_JSONL, OUTPUT_CSV};
+
+// s as a JSON string, quoted and escaped
+std::string jsonQuote(const std::string& s);
+
+// Formats run, test, iteration and summary records. As a memtestListener, it emits
+// one test record per chunk of memory; setContext() says which CLI test is running.
+class memtestResultSink : public memtestListener { //{{{
+protected:
+    memtestBackgroundWriter& out;
+    memtestOutputFormat format;
+    std::string device;
+    uint iteration;
+    int testId;
+    std::string testName;
+    uint step;
+    // One named value of a record, preformatted for each format
+    struct field {
+        const char* name;
+        std::string json;
+        std::string csv;
+        field(const char* n,const std::string& value);
+        field(const char* n,const char* value);
+        field(const char* n,double value);
+        field(const char* n,unsigned long long value);
+        field(const char* n,const std::string& j,const std::string& c) : name(n), json(j), csv(c) {}
+    };
+    void emit(const char* type,const vector<field>& fields);
+public:
+    memtestResultSink(memtestBackgroundWriter& writer,memtestOutputFormat fmt,const std::string& deviceName);
+    virtual ~memtestResultSink() {}
+
+    void setContext(uint iter,int test,const std::string& name,uint stepIndex);
+    void runStarted(uint megs,uint chunks);
+    virtual void chunkDone(const memtestChunkResult& r);
+    void iterationDone(uint iter,unsigned long long errors,bool failed,double ms);
+    void testSummary(int test,const std::string& name,unsigned long long errors,unsigned long long failedIters,uint stepsRun);
+    // Error rates of a test, or of all tests if test < 0
+    void testStatistics(int test,const std::string& name,const memtestErrorStats& stats);
+    void summary(uint iters,unsigned long long errors,unsigned long long failedIters,bool completed);
+    // Outcome of --screen and the evidence behind it
+    void screenDecision(const memtestScreen& screen,memtestScreenDecision decision,const memtestErrorStats& evidence);
+    // Incorrect bits found in one region of a chunk's error heatmap
+    void regionErrors(uint chunk,uint region,uint regionMB,unsigned long long errors);
+    // Daemon mode state changes ("running", "released") with the MiB held
+    void daemonState(const char* state,uint megs);
+}; //}}}
+
+#endif
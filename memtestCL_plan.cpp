@@ -0,0 +1,153 @@
+/*
+ * memtestCL_plan.cpp
+ * Test-plan files for MemtestCL.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include "memtestCL_plan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static std::string trim(const std::string& s) {
+    const size_t first = s.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) return "";
+    return s.substr(first,s.find_last_not_of(" \t\r\n")-first+1);
+}
+
+// Whole-string numbers only, so that "10s" or "0.5x" are reported rather than truncated
+static bool parseUint(const std::string& s,uint& value) {
+    char* end;
+    if (s.empty() || s[0] == '-') return false;
+    const unsigned long v = strtoul(s.c_str(),&end,0);
+    if (*end != '\0' || v > 0xFFFFFFFFul) return false;
+    value = (uint)v;
+    return true;
+}
+static bool parseDouble(const std::string& s,double& value) {
+    char* end;
+    if (s.empty()) return false;
+    value = strtod(s.c_str(),&end);
+    return *end == '\0';
+}
+
+// One entry of a tests list: KEY, KEY:STEP or KEY:FIRST-LAST
+static bool parseTestEntry(const std::string& entry,memtestScheduledTest& out) {
+    const size_t colon = entry.find(':');
+    out.test = memtestFindTest(trim(entry.substr(0,colon)));
+    if (out.test < 0) return false;
+    const uint steps = memtestTests[out.test].steps;
+    out.firstStep = 0;
+    out.nSteps = steps;
+    if (colon == std::string::npos) return true;
+    const std::string range = trim(entry.substr(colon+1));
+    const size_t dash = range.find('-');
+    uint last;
+    if (!parseUint(trim(range.substr(0,dash)),out.firstStep)) return false;
+    if (dash == std::string::npos) last = out.firstStep;
+    else if (!parseUint(trim(range.substr(dash+1)),last)) return false;
+    if (last < out.firstStep || last >= steps) return false;
+    out.nSteps = last-out.firstStep+1;
+    return true;
+}
+
+static void allTests(vector<memtestScheduledTest>& tests) {
+    tests.clear();
+    for (int t = 0; t < memtestNTests; t++) {
+        memtestScheduledTest entry;
+        entry.test = t;
+        entry.firstStep = 0;
+        entry.nSteps = memtestTests[t].steps;
+        tests.push_back(entry);
+    }
+}
+
+bool memtestPlan::load(const char* filename,std::string& error) {
+    FILE* f = fopen(filename,"r");
+    if (f == NULL) {
+        error = std::string("could not open ") + filename;
+        return false;
+    }
+    phases.clear();
+    char line[1024];
+    char msg[1200];
+    int lineno = 0;
+    bool ok = true;
+    while (ok && fgets(line,sizeof(line),f)) {
+        lineno++;
+        char* comment = strchr(line,'#');
+        if (comment) *comment = '\0';
+        const std::string text = trim(line);
+        if (text.empty()) continue;
+        const size_t space = text.find_first_of(" \t");
+        const std::string key = text.substr(0,space);
+        const std::string value = (space == std::string::npos) ? "" : trim(text.substr(space));
+
+        if (key == "phase") {
+            phases.push_back(memtestPlanPhase());
+            if (value.empty()) sprintf(msg,"phase %u",(uint)phases.size());
+            phases.back().name = value.empty() ? msg : value;
+            allTests(phases.back().tests);
+            continue;
+        }
+        if (phases.empty()) {
+            sprintf(msg,"line %d: %s before the first phase",lineno,key.c_str());
+            ok = false;
+            break;
+        }
+        memtestPlanPhase& p = phases.back();
+        bool valid = true;
+        if (key == "tests") {
+            if (value == "all") {
+                allTests(p.tests);
+            } else {
+                p.tests.clear();
+                size_t pos = 0;
+                while (valid && pos <= value.size()) {
+                    size_t comma = value.find(',',pos);
+                    if (comma == std::string::npos) comma = value.size();
+                    memtestScheduledTest entry;
+                    valid = parseTestEntry(value.substr(pos,comma-pos),entry);
+                    if (valid) p.tests.push_back(entry);
+                    pos = comma+1;
+                }
+            }
+        } else if (key == "repeat") {
+            valid = parseUint(value,p.repeat) && p.repeat > 0;
+        } else if (key == "memory") {
+            valid = parseDouble(value,p.memory) && p.memory > 0 && p.memory <= 1;
+        } else if (key == "seconds") {
+            valid = parseDouble(value,p.seconds) && p.seconds >= 0;
+        } else if (key == "seed") {
+            valid = parseUint(value,p.seed);
+        } else if (key == "on-error") {
+            if (value == "continue") p.onError = PLAN_CONTINUE;
+            else if (value == "next-phase") p.onError = PLAN_NEXT_PHASE;
+            else if (value == "stop") p.onError = PLAN_STOP;
+            else valid = false;
+        } else {
+            sprintf(msg,"line %d: unknown setting %s",lineno,key.c_str());
+            ok = false;
+            break;
+        }
+        if (!valid) {
+            sprintf(msg,"line %d: bad value for %s: %.900s",lineno,key.c_str(),value.c_str());
+            ok = false;
+        }
+    }
+    if (ok && ferror(f)) {
+        sprintf(msg,"could not read %.900s",filename);
+        ok = false;
+    }
+    if (ok && phases.empty()) {
+        sprintf(msg,"no phases in %.900s",filename);
+        ok = false;
+    }
+    fclose(f);
+    if (!ok) error = msg;
+    return ok;
+}
@@ -0,0 +1,52 @@
+/*
+ * memtestCL_plan.h
+ * Test-plan files for MemtestCL: burn-in policies written as a sequence of
+ * phases, each a set of tests with its own memory fraction, repeat count,
+ * time budget and stop condition, all run by one process on one allocation.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_PLAN_H_
+#define _MEMTESTCL_PLAN_H_
+
+#include "memtestCL_sched.h"
+#include <string>
+
+// What a phase does once one of its passes finds errors
+enum memtestPlanOnError {
+    PLAN_CONTINUE,      // finish the phase as planned
+    PLAN_NEXT_PHASE,    // go on to the next phase
+    PLAN_STOP           // end the plan
+};
+
+struct memtestPlanPhase {
+    std::string name;
+    // Registry tests and the steps of each to run, in order; steps wrap around
+    vector<memtestScheduledTest> tests;
+    uint repeat;                // passes over the tests
+    double memory;              // fraction of the allocated memory to test
+    double seconds;             // time budget of the phase, or 0 for none
+    uint seed;                  // random patterns of pass p are seeded from seed+p; 0 for the run position
+    memtestPlanOnError onError;
+    memtestPlanPhase() : repeat(1), memory(1.0), seconds(0), seed(0), onError(PLAN_CONTINUE) {}
+};
+
+// Plan file format: one setting per line, "#" starts a comment, indentation is free.
+// "phase NAME" starts a phase; the settings after it, all optional, are
+//     tests KEY[:STEP[-STEP]],...   registry keys or "all" (the default), with steps
+//     repeat N                      passes over the tests (default 1)
+//     memory F                      fraction of the allocated memory, 0 < F <= 1
+//     seconds S                     time budget; no test step starts that cannot finish
+//     seed N                        fixed random patterns
+//     on-error continue|next-phase|stop
+struct memtestPlan {
+    vector<memtestPlanPhase> phases;
+
+    // Returns false and describes the first problem, with its line number, in error
+    bool load(const char* filename,std::string& error);
+};
+
+#endif
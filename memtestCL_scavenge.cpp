@@ -0,0 +1,97 @@
+/*
+ * memtestCL_scavenge.cpp
+ * Scavenger mode for MemtestCL.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include "memtestCL_scavenge.h"
+#include <stdio.h>
+
+memtestScavenger::memtestScavenger(memtestDaemon& d,uint chunkMB,uint maxMB,unsigned releaseTargetMs) :
+    daemon(d), maxChunkMB(chunkMB), limitMB(maxMB), targetMs(releaseTargetMs), msPerMB(0), growAfter(0),
+    releases(0), lateReleases(0), lastReleaseMs(0), maxReleaseMs(0), watching(0) {}
+
+memtestScavenger::~memtestScavenger() {
+    memtestAtomicStore(watching,0);
+    watcher.join();
+}
+
+bool memtestScavenger::watchFile(const std::string& path) {
+    pressureFile = path;
+    memtestAtomicStore(watching,1);
+    return watcher.start(watch,this);
+}
+
+void memtestScavenger::watch(void* self) {
+    memtestScavenger* s = (memtestScavenger*)self;
+    // Only resume releases that this file asked for
+    bool pressure = false;
+    while (memtestAtomicLoad(s->watching)) {
+        FILE* f = fopen(s->pressureFile.c_str(),"r");
+        if (f) fclose(f);
+        if (f && !pressure) {
+            s->daemon.requestRelease();
+            pressure = true;
+        } else if (!f && pressure) {
+            s->daemon.requestResume();
+            pressure = false;
+        }
+        SLEEPMS(memtestDaemon::poll_ms);
+    }
+}
+
+void memtestScavenger::chunkDone(const memtestChunkResult& r) {
+    if (r.chunkMB == 0) return;
+    // Follow the slowest test, forgetting old measurements slowly
+    const double perMB = r.ms/r.chunkMB;
+    msPerMB = (perMB > msPerMB*0.99) ? perMB : msPerMB*0.99;
+}
+
+uint memtestScavenger::chunkSize() const {
+    uint megs = maxChunkMB;
+    if (msPerMB > 0 && targetMs/2.0/msPerMB < megs) megs = (uint)(targetMs/2.0/msPerMB);
+    megs &= ~1u;
+    return megs < 2 ? 2 : megs;
+}
+
+uint memtestScavenger::grow(memtestMultiTester& tester) {
+    if (interrupted() || getTimeMilliseconds() < growAfter) return 0;
+    uint megs = chunkSize();
+    if (limitMB > 0) {
+        const uint room = (limitMB > tester.size()) ? limitMB-tester.size() : 0;
+        if (room < megs) megs = room;
+    }
+    if (megs < 2) return 0;
+    const uint added = tester.addChunk(megs);
+    // Out of free memory for now; other jobs may finish later
+    if (added == 0) growAfter = getTimeMilliseconds()+grow_retry_ms;
+    return added;
+}
+
+bool memtestScavenger::growFirst(memtestMultiTester& tester) {
+    while (!interrupted()) {
+        if (grow(tester)) return true;
+        SLEEPMS(memtestDaemon::poll_ms);
+    }
+    return false;
+}
+
+void memtestScavenger::release(memtestMultiTester& tester) {
+    tester.deallocate();
+    lastReleaseMs = getTimeMilliseconds()-daemon.releaseRequestTime();
+    releases++;
+    if (lastReleaseMs > maxReleaseMs) maxReleaseMs = lastReleaseMs;
+    if (lastReleaseMs > targetMs) lateReleases++;
+    growAfter = 0;
+}
+
+std::string memtestScavenger::status() const {
+    char line[256];
+    sprintf(line,"releases=%u late=%u target_ms=%u last_ms=%u max_ms=%u chunk_mb=%u",
+            releases,lateReleases,targetMs,lastReleaseMs,maxReleaseMs,chunkSize());
+    return line;
+}
@@ -0,0 +1,70 @@
+/*
+ * memtestCL_scavenge.h
+ * Scavenger mode for MemtestCL: grows the memory tested chunk by chunk into
+ * whatever device memory is free, and hands all of it back quickly when
+ * another job needs it.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_SCAVENGE_H_
+#define _MEMTESTCL_SCAVENGE_H_
+
+#include "memtestCL_core.h"
+#include "memtestCL_daemon.h"
+#include <string>
+
+// Grows a memtestMultiTester into free device memory and frees it when the daemon is
+// asked to release, by a signal, the control socket, or a pressure file whose
+// existence means the memory is wanted elsewhere. As the tester's interrupt it ends
+// a test after the current chunk once release is requested; as a listener it times
+// the chunks, and sizes new ones so that finishing a chunk takes at most half the
+// release latency target.
+class memtestScavenger : public memtestInterrupt, public memtestListener { //{{{
+protected:
+    memtestDaemon& daemon;
+    uint maxChunkMB;
+    uint limitMB;               // most memory to take, or 0 for all that is free
+    unsigned targetMs;
+    double msPerMB;             // slowest recent test of a chunk, per MiB
+    unsigned int growAfter;     // no allocation attempts before this time
+    uint releases;
+    uint lateReleases;
+    unsigned lastReleaseMs;
+    unsigned maxReleaseMs;
+    std::string pressureFile;
+    memtestCounter watching;
+    memtestThread watcher;
+    static void watch(void* self);
+public:
+    // Pause after a failed allocation before trying to grow again
+    static const unsigned grow_retry_ms = 5000;
+
+    memtestScavenger(memtestDaemon& d,uint chunkMB,uint maxMB,unsigned releaseTargetMs);
+    virtual ~memtestScavenger();
+
+    // Starts a thread that requests release while path exists, and resume once it is
+    // gone. Returns false if the thread cannot be started.
+    bool watchFile(const std::string& path);
+
+    virtual bool interrupted() {return daemon.releaseRequested() || daemon.stopRequested();}
+    virtual void chunkDone(const memtestChunkResult& r);
+
+    // Size in MiB of the next chunk to allocate
+    uint chunkSize() const;
+    // Adds a chunk unless the limit is reached or a recent attempt failed; returns its size
+    uint grow(memtestMultiTester& tester);
+    // Blocks until a chunk is allocated; false if release or stop was requested first
+    bool growFirst(memtestMultiTester& tester);
+    // Frees every chunk, and records the latency since release was requested
+    void release(memtestMultiTester& tester);
+
+    unsigned lastReleaseLatency() const {return lastReleaseMs;}
+    bool lastReleaseLate() const {return lastReleaseMs > targetMs;}
+    // One line: releases, latencies and the current chunk size
+    std::string status() const;
+}; //}}}
+
+#endif
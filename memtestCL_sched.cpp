@@ -0,0 +1,168 @@
+/*
+ * memtestCL_sched.cpp
+ * Adaptive test scheduler for MemtestCL.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include "memtestCL_sched.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+memtestScheduler::memtestScheduler(const std::string& deviceModel,int nTests,const char* const* testNames,const uint* steps) :
+    totalSteps(steps,steps+nTests), nextStep(nTests,0), history(nTests), weight(nTests,1.0), enabled(nTests,true), device(deviceModel), minCoverage(0.125)
+{
+    for (int t = 0; t < nTests; t++) names.push_back(testNames[t]);
+}
+
+// History file {{{
+// Format: device<TAB>test<TAB>steps<TAB>GiB-steps<TAB>ms<TAB>errors
+static bool splitHistoryLine(char* line,char** fields,int nFields) {
+    for (int i = 0; i < nFields; i++) {
+        fields[i] = line;
+        line = strchr(line,(i == nFields-1) ? '\n' : '\t');
+        if (line == NULL) return i == nFields-1;
+        *line++ = '\0';
+    }
+    return true;
+}
+bool memtestScheduler::load(const char* filename) {
+    FILE* f = fopen(filename,"r");
+    if (f == NULL) return true; // No history yet
+    char line[1024];
+    char* fields[6];
+    while (fgets(line,sizeof(line),f)) {
+        if (line[0] == '#' || !splitHistoryLine(line,fields,6)) continue;
+        if (device != fields[0]) continue;
+        for (size_t t = 0; t < names.size(); t++) {
+            if (names[t] != fields[1]) continue;
+            history[t].steps   = atof(fields[2]);
+            history[t].gbSteps = atof(fields[3]);
+            history[t].ms      = atof(fields[4]);
+            history[t].errors  = atof(fields[5]);
+        }
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+bool memtestScheduler::save(const char* filename) const {
+    // Keep the history of other device models
+    vector<std::string> others;
+    FILE* f = fopen(filename,"r");
+    if (f != NULL) {
+        char line[1024];
+        while (fgets(line,sizeof(line),f)) {
+            if (line[0] == '#') continue;
+            const char* tab = strchr(line,'\t');
+            if (tab == NULL || device == std::string(line,tab-line)) continue;
+            others.push_back(line);
+        }
+        fclose(f);
+    }
+
+    // Write a new file and rename it into place, so an interrupted run cannot truncate history
+    const std::string tmpname = std::string(filename) + ".tmp";
+    f = fopen(tmpname.c_str(),"w");
+    if (f == NULL) return false;
+    fprintf(f,"# MemtestCL test history: device, test, steps, GiB-steps, ms, errors\n");
+    for (size_t i = 0; i < others.size(); i++) fputs(others[i].c_str(),f);
+    for (size_t t = 0; t < names.size(); t++) {
+        const memtestTestHistory& h = history[t];
+        if (h.steps == 0) continue;
+        fprintf(f,"%s\t%s\t%.0f\t%.6g\t%.6g\t%.0f\n",device.c_str(),names[t].c_str(),h.steps,h.gbSteps,h.ms,h.errors);
+    }
+    bool ok = !ferror(f);
+    if (fclose(f) != 0) ok = false;
+    #if defined(WINDOWS) || defined(WINNV)
+    if (ok) remove(filename);
+    #endif
+    if (ok && rename(tmpname.c_str(),filename) != 0) ok = false;
+    if (!ok) remove(tmpname.c_str());
+    return ok;
+}
+//}}}
+
+void memtestScheduler::record(int test,uint steps,double gb,double ms,double errors) {
+    memtestTestHistory& h = history[test];
+    h.steps += steps;
+    h.gbSteps += steps*gb;
+    h.ms += ms;
+    h.errors += errors;
+}
+
+double memtestScheduler::msPerStep(int t,double gb,double fallback) const {
+    const memtestTestHistory& h = history[t];
+    if (h.gbSteps <= 0 || h.ms <= 0) return fallback;
+    return h.ms/h.gbSteps*gb;
+}
+double memtestScheduler::errorsPerMs(int t,double gb,double fallback) const {
+    const memtestTestHistory& h = history[t];
+    // Half an error per GiB-step of prior, so that untried tests look promising
+    // and a test's record only outweighs the prior once it has run for a while
+    const double errorsPerStep = (h.errors + 0.5)/(h.gbSteps + 1.0)*gb;
+    return errorsPerStep/msPerStep(t,gb,fallback);
+}
+
+struct byDescendingRate {
+    const vector<double>& rate;
+    byDescendingRate(const vector<double>& r) : rate(r) {}
+    bool operator()(int a,int b) const {return rate[a] > rate[b] || (rate[a] == rate[b] && a < b);}
+};
+
+void memtestScheduler::plan(double budgetMs,double gb,vector<memtestScheduledTest>& out) {
+    const int all = (int)names.size();
+    double allSteps = 0;
+    for (int t = 0; t < all; t++)
+        if (enabled[t]) allSteps += totalSteps[t]*weight[t];
+    // Without history, assume that one full pass just fits the budget
+    const double fallback = (budgetMs > 0 && allSteps > 0) ? budgetMs/allSteps : 1.0;
+
+    vector<double> cost(all), rate(all);
+    vector<uint> steps(all);
+    vector<int> order;
+    for (int t = 0; t < all; t++) {
+        cost[t] = msPerStep(t,gb,fallback*weight[t]);
+        rate[t] = errorsPerMs(t,gb,fallback*weight[t]);
+        if (enabled[t]) order.push_back(t);
+    }
+    const int n = (int)order.size();
+    std::sort(order.begin(),order.end(),byDescendingRate(rate));
+
+    if (budgetMs <= 0) {
+        steps = totalSteps;
+    } else {
+        double used = 0;
+        for (int i = 0; i < n; i++) {
+            const int t = order[i];
+            steps[t] = (uint)ceil(minCoverage*totalSteps[t]);
+            steps[t] = std::max(1u,std::min(steps[t],totalSteps[t]));
+            used += steps[t]*cost[t];
+        }
+        // Spend what is left on the most productive tests first
+        for (int i = 0; i < n && used < budgetMs; i++) {
+            const int t = order[i];
+            const double affordable = floor((budgetMs-used)/cost[t]);
+            const uint extra = (uint)std::min(affordable,(double)(totalSteps[t]-steps[t]));
+            steps[t] += extra;
+            used += extra*cost[t];
+        }
+    }
+
+    out.clear();
+    for (int i = 0; i < n; i++) {
+        const int t = order[i];
+        memtestScheduledTest s;
+        s.test = t;
+        s.firstStep = nextStep[t];
+        s.nSteps = steps[t];
+        out.push_back(s);
+        // Rotate through the steps so partially run tests still cover all of them over time
+        nextStep[t] = (nextStep[t] + steps[t]) % totalSteps[t];
+    }
+}
@@ -0,0 +1,80 @@
+/*
+ * memtestCL_sched.h
+ * Adaptive test scheduler for MemtestCL: keeps per-device-model history of
+ * what each test costs and how many errors it finds, and splits a time
+ * budget across tests in proportion to their expected error yield.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_SCHED_H_
+#define _MEMTESTCL_SCHED_H_
+
+#include "memtestCL_core.h"
+#include <string>
+
+// Accumulated history of one test on one device model
+struct memtestTestHistory {
+    double steps;      // test steps (single shifts/patterns) executed
+    double gbSteps;    // sum over steps of the GiB tested
+    double ms;         // total time spent
+    double errors;     // total bit errors found
+    memtestTestHistory() : steps(0), gbSteps(0), ms(0), errors(0) {}
+};
+
+// One entry of an iteration plan: run steps [firstStep, firstStep+nSteps) of test,
+// modulo the number of steps in the test
+struct memtestScheduledTest {
+    int test;
+    uint firstStep;
+    uint nSteps;
+};
+
+class memtestScheduler { //{{{
+protected:
+    vector<std::string> names;
+    vector<uint> totalSteps;
+    vector<uint> nextStep;
+    vector<memtestTestHistory> history;
+    vector<double> weight;
+    vector<bool> enabled;
+    std::string device;
+    double minCoverage;
+    double msPerStep(int t,double gb,double fallback) const;
+    double errorsPerMs(int t,double gb,double fallback) const;
+public:
+    // names[i] and steps[i] describe test i; steps is the number of independently
+    // runnable steps that make up one full execution of the test (e.g. 32 shifts)
+    memtestScheduler(const std::string& deviceModel,int nTests,const char* const* names,const uint* steps);
+
+    // Fraction of each test's steps run in every iteration, however unproductive
+    void setMinCoverage(double fraction) {minCoverage = fraction;}
+    double getMinCoverage() const {return minCoverage;}
+    // Relative cost of one step of a test, used to split the budget until it has history
+    void setCostEstimate(int test,double cost) {weight[test] = cost;}
+    // Disabled tests are left out of plans
+    void setEnabled(int test,bool on) {enabled[test] = on;}
+    const memtestTestHistory& getHistory(int test) const {return history[test];}
+    // Rotation and history state, for checkpoints
+    void setHistory(int test,const memtestTestHistory& h) {history[test] = h;}
+    uint getNextStep(int test) const {return nextStep[test];}
+    void setNextStep(int test,uint step) {nextStep[test] = step % totalSteps[test];}
+
+    // History file: one line per device model and test. Lines for other device
+    // models are preserved on save. Both return false on I/O errors; loading a
+    // nonexistent file succeeds with empty history.
+    bool load(const char* filename);
+    bool save(const char* filename) const;
+
+    void record(int test,uint steps,double gb,double ms,double errors);
+
+    // Plans one iteration over gb GiB of memory within budgetMs milliseconds. Every
+    // enabled test gets at least its minimum coverage; the rest of the budget goes to the
+    // tests with the highest expected errors per second, which also run first.
+    // budgetMs <= 0 runs every step of every test in the same productive-first order.
+    void plan(double budgetMs,double gb,vector<memtestScheduledTest>& out);
+}; //}}}
+
+#endif
@@ -0,0 +1,323 @@
+/*
+ * memtestCL_sim.cpp
+ * Host implementation of the MemtestCL kernels for the simulated backend.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include "memtestCL_sim.h"
+#include "memtestCL_trace.h"
+
+// Host ports of the device helpers in memtestCL_kernels.cl {{{
+static inline uint hostPopc(uint x) {
+    #ifdef __GNUC__
+    return __builtin_popcount(x);
+    #else
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    return (((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+    #endif
+}
+static inline uint hostMulMP31(uint a,uint b) {
+    // Same 62-bit intermediate and reduction mod 2^31-1 as deviceMulMP31
+    unsigned long long product = (unsigned long long)a*b;
+    uint LO = (uint)product & 0x7FFFFFFF;
+    uint HI = (uint)(product >> 31);
+    uint sum = LO+HI;
+    return (sum >= 0x80000000) ? sum - 0x80000000 + 1 : sum;
+}
+static uint hostExpoModMP31(uint base,uint exponent) {
+    uint result = 1;
+    while (exponent > 0) {
+        if (exponent & 1) result = hostMulMP31(result,base);
+        exponent >>= 1;
+        base = hostMulMP31(base,base);
+    }
+    return result;
+}
+static inline uint hostIrbit2(uint* seed) {
+    const uint IB1  = 1;
+    const uint IB2  = 2;
+    const uint IB5  = 16;
+    const uint IB18 = 131072;
+    const uint MASK = IB1+IB2+IB5;
+    if ((*seed) & IB18) {
+        *seed = (((*seed) ^ MASK) << 1) | IB1;
+        return 1;
+    } else {
+        *seed <<= 1;
+        return 0;
+    }
+}
+static uint hostLCG(uint repeats,int period) {
+    uint a,c;
+    switch (period) {
+        case 1024: a = 0x0fbfffff; c = 0x3bf75696; break;
+        case 512:  a = 0x61c8647f; c = 0x2b3e0000; break;
+        case 256:  a = 0x7161ac7f; c = 0x43840000; break;
+        case 128:  a = 0x0432b47f; c = 0x1ce80000; break;
+        case 2048: a = 0x763fffff; c = 0x4769466f; break;
+        default:   a = 0; c = 0; break;
+    }
+    uint value = 0;
+    for (uint rep = 0; rep < repeats; rep++) {
+        value = ~value;
+        for (int iter = 0; iter < period; iter++) {
+            value = ~value;
+            value = a*value+c;
+            value ^= 0xFFFFFFF0;
+            value ^= 0xF;
+        }
+        value = ~value;
+    }
+    return value;
+}
+// Incorrect bits of one word, also counted into their bit lanes as the verify kernels do
+static inline uint hostBitErrors(uint* lanes,uint diff) {
+    if (diff == 0) return 0;
+    for (int b = 0; b < MT_BIT_LANES; b++) lanes[b] += (diff >> b) & 1;
+    return hostPopc(diff);
+}
+//}}}
+
+memtestSimBackend::memtestSimBackend(const memtestSimParams& p) :
+    params(p), nBlocks(0), nThreads(0), busyUntil(0), allocated(false),
+    launches(0), hung(false), waitLimit(MT_WAIT_LIMIT_MS), trace(NULL), traceTrack(0) {}
+
+cl_int memtestSimBackend::allocate(uint megs,uint blocks,uint threads) {
+    deallocate();
+    if (megs > params.maxAllocMB) return CL_INVALID_BUFFER_SIZE;
+    nBlocks = blocks;
+    nThreads = threads;
+    try {
+        mem.assign(megs*262144ULL,0);
+        blockErrorCount.assign(nBlocks,0);
+        std::fill(bitErrorCount,bitErrorCount+MT_BIT_LANES,0);
+    } catch (std::bad_alloc&) {
+        mem.clear();
+        cerr << "Unable to allocate simulated device memory"<<endl;
+        return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    }
+    busyUntil = getTimeMicroseconds();
+    allocated = true;
+    return CL_SUCCESS;
+}
+void memtestSimBackend::deallocate() {
+    if (!allocated) return;
+    vector<uint>().swap(mem);
+    vector<uint>().swap(blockErrorCount);
+    allocated = false;
+}
+void memtestSimBackend::advance(double bytes,const char* name) {
+    // Queue the modeled duration of one command behind any still-running ones
+    unsigned long long now = getTimeMicroseconds();
+    if (busyUntil < now) busyUntil = now;
+    double us = params.launchLatencyUs;
+    if (params.bandwidthMBps > 0) us += bytes/params.bandwidthMBps;
+    const unsigned long long start = busyUntil;
+    busyUntil += (unsigned long long)us;
+    // The modeled timeline is the device's
+    if (trace) trace->span(memtestTrace::DEVICE,traceTrack,"device",name,start,busyUntil);
+}
+cl_int memtestSimBackend::launch(memtestKernel k,uint N,const uint* p) {
+    return launchRange(k,N,p,0,nBlocks);
+}
+cl_int memtestSimBackend::launchRange(memtestKernel k,uint N,const uint* p,uint firstBlock,uint blocks) {
+    if (!allocated) return CL_INVALID_MEM_OBJECT;
+    if (blocks == 0 || firstBlock+blocks > nBlocks) return CL_INVALID_VALUE;
+    if ((size_t)nBlocks*nThreads*N > mem.size()) return CL_INVALID_VALUE;
+    if (++launches == params.hangLaunch) hung = true;
+    // Nothing queued behind a hung launch runs until recover()
+    if (hung) return CL_SUCCESS;
+    runKernel(k,N,p,firstBlock,blocks);
+    double bytes = 4.0*blocks*nThreads*N;
+    if (k == MT_WRITE_MOD) bytes *= 1+p[4];
+    advance(bytes,kernelName(k));
+    return CL_SUCCESS;
+}
+cl_int memtestSimBackend::recover() {
+    // Comes back as freshly allocated, as a recreated device would
+    hung = false;
+    return allocated ? allocate((uint)(mem.size()/262144),nBlocks,nThreads) : CL_SUCCESS;
+}
+cl_int memtestSimBackend::launchCopy(size_t bytes) {
+    if (!allocated) return CL_INVALID_MEM_OBJECT;
+    if (2*bytes > mem.size()*sizeof(uint)) return CL_INVALID_VALUE;
+    std::copy(mem.begin(),mem.begin()+bytes/sizeof(uint),mem.begin()+bytes/sizeof(uint));
+    advance(2.0*bytes,"copy");
+    return CL_SUCCESS;
+}
+cl_int memtestSimBackend::wait() {
+    if (hung) {
+        SLEEPMS(waitLimit);
+        return MT_TIMEOUT;
+    }
+    unsigned long long now = getTimeMicroseconds();
+    if (busyUntil > now) SLEEPUS((unsigned)(busyUntil-now));
+    return CL_SUCCESS;
+}
+cl_int memtestSimBackend::poll(bool& done) {
+    done = !hung && getTimeMicroseconds() >= busyUntil;
+    return CL_SUCCESS;
+}
+cl_int memtestSimBackend::readCounts(uint* counts) {
+    cl_int status = launchReadCounts(counts);
+    if (status != CL_SUCCESS) return status;
+    return wait();
+}
+cl_int memtestSimBackend::launchReadCounts(uint* counts) {
+    if (!allocated) return CL_INVALID_MEM_OBJECT;
+    // The counts are copied now but, as far as poll() is concerned, arrive after the readback latency
+    unsigned long long now = getTimeMicroseconds();
+    if (busyUntil < now) busyUntil = now;
+    const unsigned long long start = busyUntil;
+    busyUntil += (unsigned long long)params.readbackLatencyUs;
+    if (trace) trace->span(memtestTrace::DEVICE,traceTrack,"device","read counts",start,busyUntil);
+    std::copy(blockErrorCount.begin(),blockErrorCount.end(),counts);
+    return CL_SUCCESS;
+}
+cl_int memtestSimBackend::readBitErrors(uint* lanes) {
+    if (!allocated) return CL_INVALID_MEM_OBJECT;
+    busyUntil += (unsigned long long)params.readbackLatencyUs;
+    wait();
+    std::copy(bitErrorCount,bitErrorCount+MT_BIT_LANES,lanes);
+    std::fill(bitErrorCount,bitErrorCount+MT_BIT_LANES,0);
+    return CL_SUCCESS;
+}
+cl_int memtestSimBackend::readWords(size_t offset,size_t count,uint* dst) {
+    if (!allocated) return CL_INVALID_MEM_OBJECT;
+    if (offset+count > mem.size()) return CL_INVALID_VALUE;
+    busyUntil += (unsigned long long)params.readbackLatencyUs;
+    wait();
+    std::copy(mem.begin()+offset,mem.begin()+offset+count,dst);
+    return CL_SUCCESS;
+}
+cl_int memtestSimBackend::writeWords(size_t offset,size_t count,const uint* src) {
+    if (!allocated) return CL_INVALID_MEM_OBJECT;
+    if (offset+count > mem.size()) return CL_INVALID_VALUE;
+    busyUntil += (unsigned long long)params.readbackLatencyUs;
+    wait();
+    std::copy(src,src+count,mem.begin()+offset);
+    return CL_SUCCESS;
+}
+
+// Expected contents of each work-item's words for the kernels whose pattern depends only on
+// the index of the work-item in its group
+vector<uint> memtestSimBackend::threadPatterns(memtestKernel k,const uint* p) const {
+    vector<uint> pattern(nThreads);
+    for (uint t = 0; t < nThreads; t++) {
+        switch (k) {
+            case MT_WRITE_PAIRED_CONSTANTS:
+            case MT_VERIFY_PAIRED_CONSTANTS:
+                pattern[t] = (t & 0x1) ? p[1] : p[0];
+                break;
+            case MT_WRITE_W32:
+            case MT_VERIFY_W32:
+                pattern[t] = 1 << ((t + p[1]) & 0x1f);
+                pattern[t] = p[0] ? pattern[t] : ~pattern[t];
+                break;
+            default:
+                pattern[t] = p[0];
+                break;
+        }
+    }
+    return pattern;
+}
+
+// Word offset of work-item t of work-group b at iteration i, as THREAD_OFFSET(N,i)
+#define SIM_OFFSET(b,N,i,t) ((size_t)(b)*(N)*nThreads + (size_t)(i)*nThreads + (t))
+
+// Runs work-groups [firstBlock,firstBlock+blocks) of kernel k as a launch of blocks work-groups
+// from firstBlock on, as the kernels do when memtestCLBackend::launchRange passes firstBlock
+void memtestSimBackend::runKernel(memtestKernel k,uint N,const uint* p,uint firstBlock,uint blocks) { //{{{
+    uint* base = &mem[0] + (size_t)firstBlock*N*nThreads;
+    switch (k) {
+        case MT_WRITE_CONSTANT:
+            std::fill(base,base+(size_t)blocks*nThreads*N,p[0]);
+            break;
+        case MT_LOGIC:
+        case MT_LOGIC_SHARED:
+            std::fill(base,base+(size_t)blocks*nThreads*N,hostLCG(p[0],(int)p[1]));
+            break;
+        case MT_WRITE_PAIRED_CONSTANTS:
+        case MT_WRITE_W32: {
+            // Both patterns depend only on the work-item index
+            const vector<uint> pattern = threadPatterns(k,p);
+            for (uint b = 0; b < blocks; b++) {
+                for (uint i = 0; i < N; i++) {
+                    std::copy(pattern.begin(),pattern.end(),base + SIM_OFFSET(b,N,i,0));
+                }
+            }
+            break;
+        }
+        case MT_WRITE_RANDOM:
+        case MT_VERIFY_RANDOM: {
+            vector<uint> bitSeeds(nThreads);
+            vector<uint> randomBlock(nThreads);
+            // deviceRan0p(seed,t) == deviceMulMP31(16807^(t+1),seed); hoist the exponentiation
+            vector<uint> an(nThreads);
+            for (uint t = 0; t < nThreads; t++) an[t] = hostExpoModMP31(16807,t+1);
+            for (uint b = 0; b < blocks; b++) {
+                int seed = (int)p[0];
+                // Make sure seed is not zero.
+                if (seed == 0) seed = 123459876+b;
+                for (uint t = 0; t < nThreads; t++) bitSeeds[t] = hostMulMP31(an[t],(uint)(seed + t));
+                uint errors = 0;
+                for (uint i = 0; i < N; i++) {
+                    for (uint t = 0; t < nThreads; t++)
+                        randomBlock[t] = hostMulMP31(an[t],(uint)seed) | (hostIrbit2(&bitSeeds[t]) << 31);
+                    seed = randomBlock[nThreads-1];
+                    uint* row = base + SIM_OFFSET(b,N,i,0);
+                    if (k == MT_WRITE_RANDOM) {
+                        std::copy(randomBlock.begin(),randomBlock.end(),row);
+                    } else {
+                        for (uint t = 0; t < nThreads; t++) errors += hostBitErrors(bitErrorCount,row[t] ^ randomBlock[t]);
+                    }
+                }
+                if (k == MT_VERIFY_RANDOM) blockErrorCount[b] = errors;
+            }
+            break;
+        }
+        case MT_WRITE_MOD: {
+            // Final contents of deviceWritePairedModulo: pattern1 in every offset that is
+            // shift mod modulus, and (if overwritten at all) pattern2 everywhere else
+            const uint shift = p[0], pattern1 = p[1], pattern2 = p[2], modulus = p[3], iters = p[4];
+            const size_t words = (size_t)blocks*nThreads*N;
+            if (iters > 0) std::fill(base,base+words,pattern2);
+            for (size_t offset = shift; offset < words; offset += modulus) base[offset] = pattern1;
+            break;
+        }
+        case MT_VERIFY_CONSTANT:
+        case MT_VERIFY_PAIRED_CONSTANTS:
+        case MT_VERIFY_W32: {
+            const vector<uint> expected = threadPatterns(k,p);
+            for (uint b = 0; b < blocks; b++) {
+                uint errors = 0;
+                for (uint i = 0; i < N; i++) {
+                    const uint* row = base + SIM_OFFSET(b,N,i,0);
+                    for (uint t = 0; t < nThreads; t++) errors += hostBitErrors(bitErrorCount,row[t] ^ expected[t]);
+                }
+                blockErrorCount[b] = errors;
+            }
+            break;
+        }
+        case MT_VERIFY_MOD: {
+            const uint shift = p[0], pattern1 = p[1], modulus = p[2];
+            const size_t blockWords = (size_t)N*nThreads;
+            for (uint b = 0; b < blocks; b++) {
+                uint errors = 0;
+                // First offset in this block that is shift mod modulus
+                size_t offset = b*blockWords;
+                offset += (shift + modulus - (offset % modulus)) % modulus;
+                for (; offset < (b+1)*blockWords; offset += modulus) errors += hostBitErrors(bitErrorCount,base[offset] ^ pattern1);
+                blockErrorCount[b] = errors;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+} //}}}
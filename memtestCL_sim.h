@@ -0,0 +1,85 @@
+/*
+ * memtestCL_sim.h
+ * Simulated execution backend for MemtestCL: runs the test kernels on
+ * host memory with a configurable device latency and bandwidth model,
+ * so that the host-side layers can be exercised without an OpenCL device.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_SIM_H_
+#define _MEMTESTCL_SIM_H_
+
+#include "memtestCL_core.h"
+
+// Parameters of the simulated device
+struct memtestSimParams {
+    uint nBlocks;              // work-groups per launch
+    uint nThreads;             // work-items per work-group
+    uint maxAllocMB;           // largest single allocation, in MiB
+    double launchLatencyUs;    // fixed cost of each kernel launch or copy
+    double readbackLatencyUs;  // fixed cost of each error count readback
+    double bandwidthMBps;      // device memory bandwidth; 0 = only host speed
+    uint hangLaunch;           // launch (from 1) that hangs on each device until recovered; 0 = none
+    memtestSimParams() : nBlocks(1024), nThreads(512), maxAllocMB(256),
+        launchLatencyUs(10), readbackLatencyUs(20), bandwidthMBps(100000), hangLaunch(0) {}
+};
+
+// Host-memory implementation of memtestBackend. Kernels execute synchronously on the
+// host when launched, with exactly the memory layout and error counting semantics of
+// memtestCL_kernels.cl; the device timeline implied by the latency and bandwidth model
+// is then honored by wait() and readCounts().
+class memtestSimBackend : public memtestBackend { //{{{
+protected:
+    memtestSimParams params;
+    uint nBlocks;
+    uint nThreads;
+    vector<uint> mem;
+    vector<uint> blockErrorCount;
+    uint bitErrorCount[MT_BIT_LANES];
+    unsigned long long busyUntil;
+    bool allocated;
+    unsigned long long launches;
+    bool hung;
+    unsigned waitLimit;
+    memtestTrace* trace;
+    uint traceTrack;
+    void advance(double bytes,const char* name);
+    vector<uint> threadPatterns(memtestKernel k,const uint* p) const;
+    void runKernel(memtestKernel k,uint N,const uint* p,uint firstBlock,uint blocks);
+public:
+    memtestSimBackend(const memtestSimParams& p = memtestSimParams());
+    virtual ~memtestSimBackend() {}
+    virtual const char* name() const {return "Simulated";}
+    virtual void geometry(uint& blocks,uint& threads) const {blocks = params.nBlocks; threads = params.nThreads;}
+    virtual uint max_allocation() const {return params.maxAllocMB;}
+    virtual cl_int allocate(uint megs,uint blocks,uint threads);
+    virtual void deallocate();
+    virtual cl_int launch(memtestKernel k,uint N,const uint* p);
+    virtual cl_int launchRange(memtestKernel k,uint N,const uint* p,uint firstBlock,uint blocks);
+    virtual void setWaitLimit(unsigned ms) {waitLimit = ms;}
+    virtual cl_int recover();
+    virtual void setTrace(memtestTrace* t,uint track) {trace = t; traceTrack = track;}
+    virtual cl_int launchCopy(size_t bytes);
+    virtual cl_int wait();
+    virtual cl_int poll(bool& done);
+    virtual cl_int readCounts(uint* counts);
+    virtual cl_int launchReadCounts(uint* counts);
+    virtual cl_int readWords(size_t offset,size_t count,uint* dst);
+    virtual cl_int writeWords(size_t offset,size_t count,const uint* src);
+    virtual cl_int readBitErrors(uint* lanes);
+}; //}}}
+
+// memtestMultiTester whose chunks all live on simulated devices
+class memtestSimMultiTester : public memtestMultiTester {
+    protected:
+        memtestSimParams params;
+    public:
+        memtestSimMultiTester(const memtestSimParams& p = memtestSimParams()) : memtestMultiTester(p.maxAllocMB), params(p) {}
+        virtual ~memtestSimMultiTester() {}
+        virtual memtestState* newTester() {return new memtestState(new memtestSimBackend(params),kernel_families);}
+};
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ * memtestCL_socket.cpp
+ * Local stream-socket server for MemtestCL.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+// winsock2.h must come before anything that includes windows.h, which
+// would otherwise pull in the conflicting winsock.h
+#if defined (WINDOWS) || defined (WINNV)
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#endif
+
+#include "memtestCL_socket.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (WINDOWS) || defined (WINNV)
+    typedef SOCKET socket_t;
+    #define CLOSESOCKET closesocket
+#else
+    #include <sys/types.h>
+    #include <sys/stat.h>
+    #include <sys/socket.h>
+    #include <sys/select.h>
+    #include <sys/un.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+    #include <netdb.h>
+    #include <signal.h>
+    #include <unistd.h>
+    typedef int socket_t;
+    #define INVALID_SOCKET (-1)
+    #define CLOSESOCKET ::close
+#endif
+
+memtestSocketServer::memtestSocketServer() : listenFd((long long)INVALID_SOCKET), stopping(false) {}
+
+bool memtestSocketServer::start(const std::string& address,std::string& error) {
+    socket_t fd = INVALID_SOCKET;
+    #if defined (WINDOWS) || defined (WINNV)
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2,2),&wsa) != 0) {
+        error = "could not initialize Winsock";
+        return false;
+    }
+    #else
+    // A client hanging up mid-response must not kill the tester
+    signal(SIGPIPE,SIG_IGN);
+    #endif
+
+    if (address.compare(0,5,"unix:") == 0) {
+        #if defined (WINDOWS) || defined (WINNV)
+        error = "Unix domain sockets are not supported on this platform";
+        return false;
+        #else
+        struct sockaddr_un addr;
+        const std::string path = address.substr(5);
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            error = "invalid socket path";
+            return false;
+        }
+        memset(&addr,0,sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path,path.c_str());
+        // Replace a stale socket left by an earlier run, but never anything else
+        struct stat st;
+        if (lstat(path.c_str(),&st) == 0) {
+            if (!S_ISSOCK(st.st_mode)) {
+                error = path + " exists and is not a socket";
+                return false;
+            }
+            unlink(path.c_str());
+        }
+        fd = socket(AF_UNIX,SOCK_STREAM,0);
+        if (fd == INVALID_SOCKET || bind(fd,(struct sockaddr*)&addr,sizeof(addr)) != 0) {
+            error = "could not bind " + path;
+            if (fd != INVALID_SOCKET) CLOSESOCKET(fd);
+            return false;
+        }
+        unixPath = path;
+        #endif
+    } else {
+        // Listen on localhost unless a host is given
+        std::string host = "127.0.0.1", port = address;
+        const size_t colon = address.rfind(':');
+        if (colon != std::string::npos) {
+            host = address.substr(0,colon);
+            port = address.substr(colon+1);
+        }
+        struct addrinfo hints, *res = NULL;
+        memset(&hints,0,sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host.c_str(),port.c_str(),&hints,&res) != 0 || res == NULL) {
+            error = "could not resolve " + address;
+            return false;
+        }
+        fd = socket(res->ai_family,res->ai_socktype,res->ai_protocol);
+        int yes = 1;
+        if (fd != INVALID_SOCKET) setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,(const char*)&yes,sizeof(yes));
+        if (fd == INVALID_SOCKET || bind(fd,res->ai_addr,(int)res->ai_addrlen) != 0) {
+            error = "could not bind " + address;
+            if (fd != INVALID_SOCKET) CLOSESOCKET(fd);
+            freeaddrinfo(res);
+            return false;
+        }
+        freeaddrinfo(res);
+    }
+    if (listen(fd,8) != 0) {
+        error = "could not listen on " + address;
+        CLOSESOCKET(fd);
+        return false;
+    }
+    listenFd = (long long)fd;
+    stopping = false;
+    if (!thread.start(run,this)) {
+        error = "could not start the server thread";
+        CLOSESOCKET(fd);
+        listenFd = (long long)INVALID_SOCKET;
+        return false;
+    }
+    return true;
+}
+
+void memtestSocketServer::run(void* self) {
+    ((memtestSocketServer*)self)->serve();
+}
+
+void memtestSocketServer::serve() {
+    const socket_t fd = (socket_t)listenFd;
+    while (!stopping) {
+        // Wake up regularly to notice stop()
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(fd,&readable);
+        struct timeval timeout = {0,200000};
+        if (select((int)fd+1,&readable,NULL,NULL,&timeout) <= 0) continue;
+        socket_t client = accept(fd,NULL,NULL);
+        if (client == INVALID_SOCKET) continue;
+        handle((long long)client);
+        CLOSESOCKET(client);
+    }
+}
+
+bool memtestSocketServer::recvUntil(long long clientFd,std::string& data,const char* terminator,unsigned timeoutMs) {
+    const socket_t client = (socket_t)clientFd;
+    char buf[1024];
+    // Requests are short; anything longer is not one of ours
+    while (data.find(terminator) == std::string::npos && data.size() < 16384) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(client,&readable);
+        struct timeval timeout = {(long)(timeoutMs/1000),(long)(timeoutMs%1000)*1000};
+        if (select((int)client+1,&readable,NULL,NULL,&timeout) <= 0) return false;
+        int n = recv(client,buf,sizeof(buf),0);
+        if (n < 0) return false;
+        if (n == 0) break;
+        data.append(buf,n);
+    }
+    return true;
+}
+
+bool memtestSocketServer::sendAll(long long clientFd,const std::string& data) {
+    const socket_t client = (socket_t)clientFd;
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int n = send(client,data.data()+sent,(int)(data.size()-sent),0);
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+void memtestSocketServer::stop() {
+    if ((socket_t)listenFd == INVALID_SOCKET) return;
+    stopping = true;
+    thread.join();
+    CLOSESOCKET((socket_t)listenFd);
+    listenFd = (long long)INVALID_SOCKET;
+    #if defined (WINDOWS) || defined (WINNV)
+    WSACleanup();
+    #else
+    if (!unixPath.empty()) unlink(unixPath.c_str());
+    #endif
+}
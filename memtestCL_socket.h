@@ -0,0 +1,45 @@
+/*
+ * memtestCL_socket.h
+ * Small local stream-socket server for MemtestCL's metrics and control
+ * endpoints: listens on a Unix domain socket or a TCP port and hands each
+ * connection to a subclass on a background thread.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_SOCKET_H_
+#define _MEMTESTCL_SOCKET_H_
+
+#include "memtestCL_thread.h"
+#include <string>
+
+class memtestSocketServer { //{{{
+protected:
+    long long listenFd;
+    std::string unixPath;
+    volatile bool stopping;
+    memtestThread thread;
+    static void run(void* self);
+    void serve();
+
+    // Called on the server thread for every connection; the connection is
+    // closed when it returns
+    virtual void handle(long long fd) = 0;
+
+    // Helpers for handle(). recvUntil reads until data contains terminator,
+    // the peer closes, or timeoutMs passes without input; false on timeout or error.
+    static bool recvUntil(long long fd,std::string& data,const char* terminator,unsigned timeoutMs);
+    static bool sendAll(long long fd,const std::string& data);
+public:
+    memtestSocketServer();
+    // Subclasses must call stop() in their own destructor, before they go away
+    virtual ~memtestSocketServer() {stop();}
+    // address is "unix:/path/to/socket", "host:port" or "port" (which listens on
+    // localhost only). Returns false and describes the problem in error on failure.
+    bool start(const std::string& address,std::string& error);
+    void stop();
+}; //}}}
+
+#endif
@@ -0,0 +1,179 @@
+/*
+ * memtestCL_stats.cpp
+ * Error-rate statistics for MemtestCL.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include "memtestCL_stats.h"
+#include <math.h>
+#include <algorithm>
+
+// 97.5th percentile of the standard normal distribution
+static const double z975 = 1.959964;
+
+memtestRate poissonRate(unsigned long long count,double exposure) {
+    memtestRate r;
+    if (exposure <= 0) return r;
+    // Wilson-Hilferty approximation of the exact (chi-square) Poisson interval; it is
+    // slightly wide for counts of 1 or 2. With no events the upper bound is -ln(0.025).
+    const double k = (double)count;
+    double lower = 0, upper;
+    if (count > 0) {
+        const double a = 1.0 - 1.0/(9.0*k) - z975/(3.0*sqrt(k));
+        lower = k*a*a*a;
+    }
+    if (count == 0) {
+        upper = -log(0.025);
+    } else {
+        const double b = 1.0 - 1.0/(9.0*(k+1)) + z975/(3.0*sqrt(k+1));
+        upper = (k+1)*b*b*b;
+    }
+    r.rate = k/exposure;
+    r.lower = lower/exposure;
+    r.upper = upper/exposure;
+    return r;
+}
+
+void memtestRunningStat::add(double x) {
+    n++;
+    const double delta = x-mu;
+    mu += delta/n;
+    m2 += delta*(x-mu);
+    if (n == 1 || x < lo) lo = x;
+    if (n == 1 || x > hi) hi = x;
+}
+double memtestRunningStat::stddev() const {
+    return sqrt(variance());
+}
+
+void memtestErrorStats::record(unsigned long long errorCount,double gib,double ms) {
+    errors += errorCount;
+    runs++;
+    gibHours += gib*ms/3600000.0;
+    perRun.add((double)errorCount);
+    const bool failed = (errorCount > 0);
+    if (failed) {
+        failedRuns++;
+        if (!lastFailed) onsets++;
+    }
+    lastFailed = failed;
+}
+
+memtestStats::memtestStats(int nTests) : tests(nTests), lastErrorMs(-1) {
+    for (int b = 0; b < n_gap_buckets; b++) gapHistogram[b] = 0;
+}
+
+void memtestStats::record(int test,unsigned long long errorCount,double gib,double ms,double nowMs) {
+    tests[test].record(errorCount,gib,ms);
+    total.record(errorCount,gib,ms);
+    if (errorCount == 0) return;
+    if (lastErrorMs >= 0) {
+        const double seconds = (nowMs-lastErrorMs)/1000.0;
+        gaps.add(seconds);
+        int b = 0;
+        while (b < n_gap_buckets-1 && seconds >= gapBucketStart(b+1)) b++;
+        gapHistogram[b]++;
+    }
+    lastErrorMs = nowMs;
+}
+
+static void printRateLine(FILE* out,const char* name,const memtestErrorStats& s) {
+    const memtestRate r = s.errorRate();
+    fprintf(out,"%40s: %.3g [%.3g, %.3g] bits/GiB-h, %.3g FIT/Mbit (at most %.3g), %llu sporadic, %.0f%% persistent\n",
+            name,r.rate,r.lower,r.upper,fitPerMbit(r.rate),fitPerMbit(r.upper),s.sporadicFailures(),100*s.persistentFraction());
+}
+
+void memtestStats::print(FILE* out,const char* const* names) const {
+    if (total.exposure() <= 0) return;
+    fprintf(out,"Error rates over %.3g GiB-hours of testing (95%% confidence intervals):\n",total.exposure());
+    for (size_t t = 0; t < tests.size(); t++) {
+        if (tests[t].runCount() == 0) continue;
+        printRateLine(out,names[t],tests[t]);
+    }
+    printRateLine(out,"All tests",total);
+    const memtestRate sporadic = total.sporadicRate();
+    fprintf(out,"Sporadic failure onsets: %.3g [%.3g, %.3g] per GiB-hour\n",sporadic.rate,sporadic.lower,sporadic.upper);
+    if (gaps.count() == 0) return;
+    fprintf(out,"Time between errors: mean %.1f s, sd %.1f s, min %.1f s, max %.1f s over %llu intervals\n",
+            gaps.mean(),gaps.stddev(),gaps.min(),gaps.max(),gaps.count());
+    char range[64];
+    for (int b = 0; b < n_gap_buckets; b++) {
+        if (gapHistogram[b] == 0) continue;
+        if (b == n_gap_buckets-1) sprintf(range,">= %.0f s",gapBucketStart(b));
+        else sprintf(range,"%.0f-%.0f s",gapBucketStart(b),gapBucketStart(b+1));
+        fprintf(out,"%40s: %llu\n",range,gapHistogram[b]);
+    }
+}
+
+struct regionCount {
+    unsigned long long errors;
+    size_t chunk;
+    size_t region;
+    // Most errors first, then in address order
+    bool operator<(const regionCount& o) const {
+        if (errors != o.errors) return errors > o.errors;
+        return (chunk != o.chunk) ? chunk < o.chunk : region < o.region;
+    }
+};
+
+void printRegionErrors(FILE* out,const vector<vector<unsigned long long> >& heatmap,uint regionMB,int maxRegions) {
+    vector<regionCount> failing;
+    size_t regions = 0;
+    unsigned long long total = 0;
+    for (size_t c = 0; c < heatmap.size(); c++) {
+        regions += heatmap[c].size();
+        for (size_t r = 0; r < heatmap[c].size(); r++) {
+            if (heatmap[c][r] == 0) continue;
+            regionCount rc;
+            rc.errors = heatmap[c][r];
+            rc.chunk = c;
+            rc.region = r;
+            failing.push_back(rc);
+            total += rc.errors;
+        }
+    }
+    if (total == 0) return;
+    std::sort(failing.begin(),failing.end());
+    fprintf(out,"Errors by memory region: %u of %u %u MiB regions have errors; the worst holds %.1f%% of them\n",
+            (uint)failing.size(),(uint)regions,regionMB,100.0*failing[0].errors/total);
+    char name[64];
+    for (size_t i = 0; i < failing.size() && (int)i < maxRegions; i++) {
+        const unsigned long long start = (unsigned long long)failing[i].region*regionMB;
+        if (heatmap.size() > 1) sprintf(name,"chunk %u, MiB %llu-%llu",(uint)failing[i].chunk,start,start+regionMB);
+        else sprintf(name,"MiB %llu-%llu",start,start+regionMB);
+        fprintf(out,"%40s: %llu (%.1f%%)\n",name,failing[i].errors,100.0*failing[i].errors/total);
+    }
+    if ((int)failing.size() > maxRegions) fprintf(out,"%40s  (%u more regions)\n","",(uint)failing.size()-maxRegions);
+}
+
+memtestScreen::memtestScreen(double rate,double ratio,double confidence) :
+    rejectRate(rate), acceptRate(rate/ratio)
+{
+    // Equal risks of accepting a bad board and rejecting a good one
+    const double risk = 1.0-confidence;
+    acceptBound = log(risk/(1.0-risk));
+    rejectBound = log((1.0-risk)/risk);
+}
+
+double memtestScreen::logLikelihoodRatio(unsigned long long failures,double gibHours) const {
+    return failures*log(rejectRate/acceptRate) - (rejectRate-acceptRate)*gibHours;
+}
+
+memtestScreenDecision memtestScreen::decide(const memtestErrorStats& s) const {
+    const double llr = logLikelihoodRatio(s.failedRunCount(),s.exposure());
+    if (llr >= rejectBound) return SCREEN_REJECT;
+    if (llr <= acceptBound) return SCREEN_ACCEPT;
+    return SCREEN_UNDECIDED;
+}
+
+const char* memtestScreen::decisionName(memtestScreenDecision d) {
+    switch (d) {
+        case SCREEN_ACCEPT: return "accept";
+        case SCREEN_REJECT: return "reject";
+        default:            return "undecided";
+    }
+}
@@ -0,0 +1,139 @@
+/*
+ * memtestCL_stats.h
+ * Error-rate statistics for MemtestCL: 64-bit error counters per test,
+ * error rates per GiB-hour of testing with confidence intervals, FIT
+ * estimates, sporadic versus persistent failures, and the distribution of
+ * times between errors, so that boards can be compared quantitatively.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_STATS_H_
+#define _MEMTESTCL_STATS_H_
+
+#include "memtestCL_core.h"
+#include <string>
+
+// A rate with its two-sided 95% confidence interval
+struct memtestRate {
+    double rate;
+    double lower;
+    double upper;
+    memtestRate() : rate(0), lower(0), upper(0) {}
+};
+
+// Rate of a Poisson process that produced count events over the given exposure
+memtestRate poissonRate(unsigned long long count,double exposure);
+
+// Failures in time (per 10^9 hours) per Mbit of memory, from a rate per GiB-hour
+inline double fitPerMbit(double perGiBHour) {return perGiBHour*1e9/8192.0;}
+
+// Online mean and variance (Welford's method)
+class memtestRunningStat { //{{{
+    unsigned long long n;
+    double mu, m2, lo, hi;
+public:
+    memtestRunningStat() : n(0), mu(0), m2(0), lo(0), hi(0) {}
+    void add(double x);
+    unsigned long long count() const {return n;}
+    double mean() const {return mu;}
+    double variance() const {return (n > 1) ? m2/(n-1) : 0;}
+    double stddev() const;
+    double min() const {return lo;}
+    double max() const {return hi;}
+}; //}}}
+
+// Statistics of one test over a run. Each execution of the test (one iteration's
+// worth of its steps) is one run. A failing run that follows a clean one starts a
+// sporadic failure; failing runs that follow a failing run continue a persistent one.
+class memtestErrorStats { //{{{
+    unsigned long long errors;      // incorrect bits
+    unsigned long long runs;
+    unsigned long long failedRuns;
+    unsigned long long onsets;      // failing runs after a clean run (or first)
+    double gibHours;                // exposure: GiB tested times hours spent testing
+    memtestRunningStat perRun;      // incorrect bits per run
+    bool lastFailed;
+public:
+    memtestErrorStats() : errors(0), runs(0), failedRuns(0), onsets(0), gibHours(0), lastFailed(false) {}
+    void record(unsigned long long errorCount,double gib,double ms);
+
+    unsigned long long errorCount() const {return errors;}
+    unsigned long long runCount() const {return runs;}
+    unsigned long long failedRunCount() const {return failedRuns;}
+    unsigned long long sporadicFailures() const {return onsets;}
+    double exposure() const {return gibHours;}
+    const memtestRunningStat& errorsPerRun() const {return perRun;}
+    // Incorrect bits per GiB-hour
+    memtestRate errorRate() const {return poissonRate(errors,gibHours);}
+    // Onsets of failure per GiB-hour
+    memtestRate sporadicRate() const {return poissonRate(onsets,gibHours);}
+    // Fraction of failing runs that continued a failure of the previous run
+    double persistentFraction() const {return failedRuns ? (double)(failedRuns-onsets)/failedRuns : 0;}
+}; //}}}
+
+// Statistics of every test of a run, and of the times between errors
+class memtestStats { //{{{
+public:
+    // Inter-error time histogram buckets: [0,1) s, then [2^(b-1),2^b) s, and the last open-ended
+    static const int n_gap_buckets = 16;
+protected:
+    vector<memtestErrorStats> tests;
+    memtestErrorStats total;
+    double lastErrorMs;             // time of the previous failing run, or < 0
+    memtestRunningStat gaps;        // seconds between failing runs
+    unsigned long long gapHistogram[n_gap_buckets];
+public:
+    memtestStats(int nTests);
+
+    // One execution of test over gib GiB that took ms and ended at nowMs (any epoch)
+    void record(int test,unsigned long long errorCount,double gib,double ms,double nowMs);
+
+    const memtestErrorStats& test(int t) const {return tests[t];}
+    const memtestErrorStats& overall() const {return total;}
+    const memtestRunningStat& interErrorSeconds() const {return gaps;}
+    unsigned long long gapBucket(int b) const {return gapHistogram[b];}
+    // Lower edge of bucket b in seconds
+    static double gapBucketStart(int b) {return (b == 0) ? 0 : (double)(1ull << (b-1));}
+
+    // Human-readable report of the tests that ran; names[t] names test t
+    void print(FILE* out,const char* const* names) const;
+}; //}}}
+
+// Summary of the error heatmaps of a run (heatmap[chunk][region], see
+// memtestMultiTester::getRegionErrors): how concentrated the errors are, and the
+// maxRegions regions with the most. Clustered faults, such as one bad bank or
+// channel, put most errors in a few neighbouring regions.
+void printRegionErrors(FILE* out,const vector<vector<unsigned long long> >& heatmap,uint regionMB,int maxRegions=8);
+
+enum memtestScreenDecision {SCREEN_UNDECIDED, SCREEN_ACCEPT, SCREEN_REJECT};
+
+// Wald's sequential probability ratio test for pass/fail screening. The evidence is
+// the number of failing test runs over the GiB-hours tested, modelled as a Poisson
+// process: a board is rejected once its failure rate is shown to be at least
+// rejectRate, and accepted once it is shown to be at most rejectRate/ratio, each
+// with the given confidence. Counting failing runs rather than incorrect bits keeps
+// one bad word from standing in for many independent failures.
+class memtestScreen { //{{{
+    double rejectRate;          // failing runs per GiB-hour
+    double acceptRate;
+    double acceptBound;         // log likelihood ratio thresholds
+    double rejectBound;
+public:
+    memtestScreen(double rate,double ratio,double confidence);
+
+    // Log likelihood ratio of "bad" to "good" given the failures over gibHours
+    double logLikelihoodRatio(unsigned long long failures,double gibHours) const;
+    memtestScreenDecision decide(const memtestErrorStats& s) const;
+    double getRejectRate() const {return rejectRate;}
+    double getAcceptRate() const {return acceptRate;}
+    double getAcceptBound() const {return acceptBound;}
+    double getRejectBound() const {return rejectBound;}
+    // GiB-hours a clean board needs to be accepted
+    double cleanExposure() const {return -acceptBound/(rejectRate-acceptRate);}
+    static const char* decisionName(memtestScreenDecision d);
+}; //}}}
+
+#endif
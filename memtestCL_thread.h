@@ -0,0 +1,173 @@
+/*
+ * memtestCL_thread.h
+ * Minimal portable threads, mutexes and condition variables for MemtestCL
+ * (pthreads on Linux/OS X, Win32 threads on Windows).
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_THREAD_H_
+#define _MEMTESTCL_THREAD_H_
+
+#if defined (WINDOWS) || defined (WINNV)
+    #include <windows.h>
+#elif defined (LINUX) || defined (OSX)
+    #include <pthread.h>
+    #include <sys/time.h>
+    #include <errno.h>
+#else
+    #error Must #define LINUX, WINDOWS, WINNV, or OSX
+#endif
+
+class memtestMutex { //{{{
+    friend class memtestCondition;
+#if defined (WINDOWS) || defined (WINNV)
+    CRITICAL_SECTION cs;
+public:
+    memtestMutex() {InitializeCriticalSection(&cs);}
+    ~memtestMutex() {DeleteCriticalSection(&cs);}
+    void lock() {EnterCriticalSection(&cs);}
+    void unlock() {LeaveCriticalSection(&cs);}
+#else
+    pthread_mutex_t m;
+public:
+    memtestMutex() {pthread_mutex_init(&m,NULL);}
+    ~memtestMutex() {pthread_mutex_destroy(&m);}
+    void lock() {pthread_mutex_lock(&m);}
+    void unlock() {pthread_mutex_unlock(&m);}
+#endif
+private:
+    memtestMutex(const memtestMutex&);
+    memtestMutex& operator=(const memtestMutex&);
+}; //}}}
+
+// Holds a mutex for the lifetime of the object
+class memtestLock {
+    memtestMutex& m;
+    memtestLock(const memtestLock&);
+    memtestLock& operator=(const memtestLock&);
+public:
+    memtestLock(memtestMutex& mutex) : m(mutex) {m.lock();}
+    ~memtestLock() {m.unlock();}
+};
+
+class memtestCondition { //{{{
+#if defined (WINDOWS) || defined (WINNV)
+    CONDITION_VARIABLE cv;
+public:
+    memtestCondition() {InitializeConditionVariable(&cv);}
+    ~memtestCondition() {}
+    void wait(memtestMutex& m) {SleepConditionVariableCS(&cv,&m.cs,INFINITE);}
+    // Returns false on timeout
+    bool wait(memtestMutex& m,unsigned ms) {return SleepConditionVariableCS(&cv,&m.cs,ms) != 0;}
+    void signal() {WakeConditionVariable(&cv);}
+    void broadcast() {WakeAllConditionVariable(&cv);}
+#else
+    pthread_cond_t cv;
+public:
+    memtestCondition() {pthread_cond_init(&cv,NULL);}
+    ~memtestCondition() {pthread_cond_destroy(&cv);}
+    void wait(memtestMutex& m) {pthread_cond_wait(&cv,&m.m);}
+    // Returns false on timeout
+    bool wait(memtestMutex& m,unsigned ms) {
+        struct timeval now;
+        struct timespec until;
+        gettimeofday(&now,NULL);
+        unsigned long long ns = (now.tv_usec + (ms%1000)*1000ULL)*1000ULL;
+        until.tv_sec = now.tv_sec + ms/1000 + (time_t)(ns/1000000000ULL);
+        until.tv_nsec = (long)(ns%1000000000ULL);
+        return pthread_cond_timedwait(&cv,&m.m,&until) != ETIMEDOUT;
+    }
+    void signal() {pthread_cond_signal(&cv);}
+    void broadcast() {pthread_cond_broadcast(&cv);}
+#endif
+private:
+    memtestCondition(const memtestCondition&);
+    memtestCondition& operator=(const memtestCondition&);
+}; //}}}
+
+// Runs fn(arg) on a new thread; join() waits for it to return
+class memtestThread { //{{{
+public:
+    typedef void (*function)(void*);
+private:
+    function fn;
+    void* arg;
+    bool running;
+#if defined (WINDOWS) || defined (WINNV)
+    HANDLE handle;
+    static DWORD WINAPI trampoline(LPVOID self) {
+        memtestThread* t = (memtestThread*)self;
+        t->fn(t->arg);
+        return 0;
+    }
+public:
+    memtestThread() : fn(NULL), arg(NULL), running(false), handle(NULL) {}
+    bool start(function f,void* a) {
+        fn = f; arg = a;
+        handle = CreateThread(NULL,0,trampoline,this,0,NULL);
+        running = (handle != NULL);
+        return running;
+    }
+    void join() {
+        if (!running) return;
+        WaitForSingleObject(handle,INFINITE);
+        CloseHandle(handle);
+        running = false;
+    }
+#else
+    pthread_t handle;
+    static void* trampoline(void* self) {
+        memtestThread* t = (memtestThread*)self;
+        t->fn(t->arg);
+        return NULL;
+    }
+public:
+    memtestThread() : fn(NULL), arg(NULL), running(false) {}
+    bool start(function f,void* a) {
+        fn = f; arg = a;
+        running = (pthread_create(&handle,NULL,trampoline,this) == 0);
+        return running;
+    }
+    void join() {
+        if (!running) return;
+        pthread_join(handle,NULL);
+        running = false;
+    }
+#endif
+    bool isRunning() const {return running;}
+    // Identifies the calling thread among those running
+    static unsigned long long currentId() {
+#if defined (WINDOWS) || defined (WINNV)
+        return (unsigned long long)GetCurrentThreadId();
+#else
+        return (unsigned long long)(size_t)pthread_self();
+#endif
+    }
+    ~memtestThread() {join();}
+private:
+    memtestThread(const memtestThread&);
+    memtestThread& operator=(const memtestThread&);
+}; //}}}
+
+// Lock-free 64-bit counters, safe to update from any thread {{{
+typedef volatile unsigned long long memtestCounter;
+#if defined (WINDOWS) || defined (WINNV)
+inline void memtestAtomicAdd(memtestCounter& c,unsigned long long v) {InterlockedExchangeAdd64((volatile LONG64*)&c,(LONG64)v);}
+inline unsigned long long memtestAtomicIncrement(memtestCounter& c) {return (unsigned long long)InterlockedIncrement64((volatile LONG64*)&c);}
+inline void memtestAtomicStore(memtestCounter& c,unsigned long long v) {InterlockedExchange64((volatile LONG64*)&c,(LONG64)v);}
+inline unsigned long long memtestAtomicLoad(memtestCounter& c) {return (unsigned long long)InterlockedCompareExchange64((volatile LONG64*)&c,0,0);}
+#else
+inline void memtestAtomicAdd(memtestCounter& c,unsigned long long v) {__sync_fetch_and_add(&c,v);}
+inline unsigned long long memtestAtomicIncrement(memtestCounter& c) {return __sync_add_and_fetch(&c,1ULL);}
+inline void memtestAtomicStore(memtestCounter& c,unsigned long long v) {
+    unsigned long long old = c;
+    while (!__sync_bool_compare_and_swap(&c,old,v)) old = c;
+}
+inline unsigned long long memtestAtomicLoad(memtestCounter& c) {return __sync_fetch_and_add(&c,0ULL);}
+#endif
+//}}}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * memtestCL_trace.cpp
+ * Timeline recorder for MemtestCL.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+
+#include "memtestCL_trace.h"
+#include "memtestCL_output.h"
+#include <stdio.h>
+
+void memtestTrace::chunkDone(const memtestChunkResult& r) {
+    const unsigned long long now = getTimeMicroseconds();
+    char args[64];
+    sprintf(args,"\"chunk\": %u, \"errors\": %u",r.chunk,r.errorCount);
+    hostSpan("test",r.test,now-(unsigned long long)(r.ms*1000),now,args);
+}
+
+bool memtestTrace::write(const char* filename) {
+    FILE* f = fopen(filename,"w");
+    if (f == NULL) return false;
+    memtestLock lock(mutex);
+    unsigned long long originUs = 0;
+    for (size_t i = 0; i < events.size(); i++) {
+        if (i == 0 || events[i].startUs < originUs) originUs = events[i].startUs;
+    }
+
+    // Track names and order go first, as metadata events
+    fprintf(f,"{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(f,"{\"ph\": \"M\", \"name\": \"process_name\", \"pid\": %d, \"args\": {\"name\": \"Host\"}},\n",HOST);
+    fprintf(f,"{\"ph\": \"M\", \"name\": \"process_name\", \"pid\": %d, \"args\": {\"name\": \"Device queues\"}}",DEVICE);
+    for (std::map<std::pair<uint,uint>,std::string>::const_iterator i = trackNames.begin(); i != trackNames.end(); i++) {
+        fprintf(f,",\n{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": %u, \"tid\": %u, \"args\": {\"name\": %s}}",
+                i->first.first,i->first.second,jsonQuote(i->second).c_str());
+        fprintf(f,",\n{\"ph\": \"M\", \"name\": \"thread_sort_index\", \"pid\": %u, \"tid\": %u, \"args\": {\"sort_index\": %u}}",
+                i->first.first,i->first.second,i->first.second);
+    }
+    for (size_t i = 0; i < events.size(); i++) {
+        const event& e = events[i];
+        fprintf(f,",\n{\"ph\": \"%c\", \"cat\": \"%s\", \"name\": %s, \"pid\": %u, \"tid\": %u, \"ts\": %llu",
+                e.phase,e.category,jsonQuote(e.name).c_str(),e.pid,e.track,e.startUs-originUs);
+        // Instants mark only their own track
+        if (e.phase == 'X') fprintf(f,", \"dur\": %llu",e.endUs-e.startUs);
+        else fprintf(f,", \"s\": \"t\"");
+        if (!e.args.empty()) fprintf(f,", \"args\": {%s}",e.args.c_str());
+        fprintf(f,"}");
+    }
+    fprintf(f,"\n]}\n");
+    const bool ok = !ferror(f);
+    return (fclose(f) == 0) && ok;
+}
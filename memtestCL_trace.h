@@ -0,0 +1,104 @@
+/*
+ * memtestCL_trace.h
+ * Timeline recorder for MemtestCL: every kernel, readback and copy on each
+ * device queue, the host's launches and waits, and the scheduling decisions
+ * of a run, written as Chrome trace-event JSON for chrome://tracing or
+ * Perfetto, to show where time goes across chunks, queues and the host.
+ *
+ * This file is licensed under the terms of the LGPL. Please see
+ * the COPYING file in the accompanying source distribution for
+ * full license terms.
+ *
+ */
+#ifndef _MEMTESTCL_TRACE_H_
+#define _MEMTESTCL_TRACE_H_
+
+#include "memtestCL_core.h"
+#include "memtestCL_thread.h"
+#include <string>
+#include <map>
+
+// Collects events in memory until write(). Recording takes a lock and appends to a
+// vector, so it is cheap enough for every launch; safe to use from any thread.
+class memtestTrace : public memtestListener { //{{{
+public:
+    // Process ids of the trace: one track per host thread, and one per device queue
+    enum {HOST = 1, DEVICE = 2};
+protected:
+    struct event {
+        char phase;                 // 'X' for a span, 'i' for an instant
+        uint pid;
+        uint track;
+        const char* category;
+        std::string name;
+        std::string args;           // members of the args object, or empty
+        unsigned long long startUs; // getTimeMicroseconds()
+        unsigned long long endUs;
+    };
+    vector<event> events;
+    std::map<unsigned long long,uint> threads;  // memtestThread::currentId() to track
+    std::map<std::pair<uint,uint>,std::string> trackNames;
+    memtestMutex mutex;
+    memtestTrace(const memtestTrace&);
+    memtestTrace& operator=(const memtestTrace&);
+    void add(char phase,uint pid,uint track,const char* category,const std::string& name,
+             unsigned long long startUs,unsigned long long endUs,const std::string& args) {
+        event e;
+        e.phase = phase;
+        e.pid = pid;
+        e.track = track;
+        e.category = category;
+        e.name = name;
+        e.args = args;
+        e.startUs = startUs;
+        e.endUs = endUs;
+        memtestLock lock(mutex);
+        events.push_back(e);
+    }
+public:
+    memtestTrace() {}
+    virtual ~memtestTrace() {}
+
+    // Track of the calling thread; the first thread to ask is the main one
+    uint hostTrack() {
+        const unsigned long long id = memtestThread::currentId();
+        memtestLock lock(mutex);
+        std::map<unsigned long long,uint>::iterator i = threads.find(id);
+        if (i != threads.end()) return i->second;
+        const uint track = (uint)threads.size();
+        threads[id] = track;
+        char name[32];
+        if (track == 0) sprintf(name,"Main thread");
+        else sprintf(name,"Thread %u",track);
+        trackNames[std::make_pair((uint)HOST,track)] = name;
+        return track;
+    }
+    void nameTrack(uint pid,uint track,const std::string& name) {
+        memtestLock lock(mutex);
+        trackNames[std::make_pair(pid,track)] = name;
+    }
+    // A span of time on a track; args are JSON object members such as "\"blocks\": 4"
+    void span(uint pid,uint track,const char* category,const std::string& name,
+              unsigned long long startUs,unsigned long long endUs,const std::string& args = std::string()) {
+        add('X',pid,track,category,name,startUs,(endUs > startUs) ? endUs : startUs,args);
+    }
+    void instant(uint pid,uint track,const char* category,const std::string& name,
+                 unsigned long long timeUs,const std::string& args = std::string()) {
+        add('i',pid,track,category,name,timeUs,timeUs,args);
+    }
+    // Spans and instants on the calling thread's track
+    void hostSpan(const char* category,const std::string& name,unsigned long long startUs,
+                  unsigned long long endUs,const std::string& args = std::string()) {
+        span(HOST,hostTrack(),category,name,startUs,endUs,args);
+    }
+    void hostInstant(const char* category,const std::string& name,const std::string& args = std::string()) {
+        instant(HOST,hostTrack(),category,name,getTimeMicroseconds(),args);
+    }
+    // One span per chunk of every test
+    virtual void chunkDone(const memtestChunkResult& r);
+
+    // Writes the events as a Chrome trace-event JSON object, times relative to the first
+    bool write(const char* filename);
+}; //}}}
+
+#endif